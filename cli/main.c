@@ -0,0 +1,858 @@
+/*
+ * A headless batch runner. Every ROM image or assembly file given on the
+ * command line is executed on its own cpu until it halts, reaches a stop
+ * condition or runs out of cycles. The runs are spread over a pool of worker
+ * threads and the final state of each one is reported as CSV or JSON.
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/cpu.h"
+#include "../src/disassembler.h"
+#include "../src/gdb.h"
+#include "../src/perf.h"
+#include "../src/runner.h"
+#include "../src/trace.h"
+
+#define DEFAULT_CYCLES 100000000ULL
+#define DEFAULT_ORIGIN 0x0600
+#define SLICE_CYCLES   0x40000000U
+#define NO_ADDRESS     -1L
+#define LOG_RECORDS    0x10000  // Records buffered before they are written
+
+typedef enum
+{
+    FORMAT_CSV,
+    FORMAT_JSON,
+} Format;
+
+typedef enum
+{
+    PROFILE_OFF,
+    PROFILE_TOTAL,      // Host counters around every slice
+    PROFILE_CLASSES,    // Around every instruction, per opcode class
+} Profile;
+
+typedef struct Options
+{
+    CPU_Variant variant;
+    u64 cycles;         // Cycle budget of each run
+    long load;          // Load address, NO_ADDRESS: ROMs end at $FFFF
+    long entry;         // Entry point, NO_ADDRESS: reset vector or origin
+    long until;         // Stop once PC reaches this address
+    int trap;           // Stop on jumps and branches to themselves
+    int jobs;           // Number of worker threads
+    const char* gdb;    // Serve a debugger on this port or socket path
+    const char* log;    // Write the state before every instruction here
+    const char* reference;  // Validate against this log instead of running
+    Profile profile;
+    Format format;
+} Options;
+
+typedef enum
+{
+    STATUS_HALTED,      // JAM, STP or WAI
+    STATUS_UNTIL,       // PC reached --until
+    STATUS_TRAP,        // Jumped or branched to itself
+    STATUS_BUDGET,      // Ran out of cycles
+    STATUS_DETACHED,    // The debugger detached or killed the run
+    STATUS_MATCHED,     // Executed in lockstep with the whole reference log
+    STATUS_DIVERGED,    // Differed from the reference log
+    STATUS_ERROR,       // Could not be loaded
+} Status;
+
+typedef struct Job
+{
+    const char* path;
+    Status status;
+    CPU cpu;
+    double seconds;
+    Perf perf;          // Host cost, if profiled
+    Symbols symbols;    // Labels of assembly files, for --log
+    char error[256];
+} Job;
+
+typedef struct Pool
+{
+    Job* jobs;
+    size_t count;
+    size_t next;
+    pthread_mutex_t lock;
+    const Options* options;
+} Pool;
+
+static const char* status_name(const Status status)
+{
+    switch (status)
+    {
+        case STATUS_HALTED: return "halted";
+        case STATUS_UNTIL: return "until";
+        case STATUS_TRAP: return "trap";
+        case STATUS_BUDGET: return "budget";
+        case STATUS_DETACHED: return "detached";
+        case STATUS_MATCHED: return "matched";
+        case STATUS_DIVERGED: return "diverged";
+        case STATUS_ERROR: return "error";
+        default: return "unknown";
+    }
+}
+
+static double now(void)
+{
+    struct timespec time;
+    (void)clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static char* read_file(const char* path, size_t* size)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    char* contents = NULL;
+    long length;
+
+    if (fseek(file, 0, SEEK_END) == 0
+        && (length = ftell(file)) >= 0
+        && fseek(file, 0, SEEK_SET) == 0
+        && (contents = malloc(length + 1)) != NULL)
+    {
+        *size = fread(contents, 1, length, file);
+        contents[*size] = '\0';
+    }
+
+    (void)fclose(file);
+    return contents;
+}
+
+static int is_assembly(const char* path)
+{
+    const char* extension = strrchr(path, '.');
+
+    return extension != NULL
+        && (strcasecmp(extension, ".s") == 0
+            || strcasecmp(extension, ".asm") == 0
+            || strcasecmp(extension, ".a65") == 0);
+}
+
+static int load_binary(Job* job,
+                       Mem* mem,
+                       const char* contents,
+                       const size_t size,
+                       const Options* options)
+{
+    const long address = (options->load == NO_ADDRESS)
+        ? (long)MAX_MEM - (long)size : options->load;
+
+    if (address < 0 || address + size > MAX_MEM)
+    {
+        (void)snprintf(job->error, sizeof(job->error),
+                       "%zu bytes do not fit at $%04lX", size, address);
+        return -1;
+    }
+
+    (void)memcpy(&mem->Data[address], contents, size);
+    job->cpu.PC = (options->entry == NO_ADDRESS)
+        ? Get_Memory(mem, 0xFFFC) | (Get_Memory(mem, 0xFFFD) << 8)
+        : options->entry;
+
+    return 0;
+}
+
+static int load_assembly(Job* job,
+                         Mem* mem,
+                         const char* contents,
+                         const size_t size,
+                         const Options* options)
+{
+    const Word origin = (options->load == NO_ADDRESS)
+        ? DEFAULT_ORIGIN : options->load;
+
+    Lexer lexer = Lexer_Initialise(contents, size);
+    TokenList* tokens = Lexer_Run(&lexer);
+
+    if (tokens == NULL)
+    {
+        (void)snprintf(job->error, sizeof(job->error), "out of memory");
+        return -1;
+    }
+
+    Assembler assembler = Assembler_Initialise(mem, origin);
+    assembler.variant = options->variant;
+    assembler.path = job->path;
+
+    int result = Assembler_Run(&assembler, tokens);
+    if (result != 0)
+        (void)snprintf(job->error, sizeof(job->error), "%s", assembler.error);
+    else if (options->log != NULL
+        && Symbols_Load(&job->symbols, &assembler) != 0)
+    {
+        (void)snprintf(job->error, sizeof(job->error), "out of memory");
+        result = -1;
+    }
+
+    Assembler_Free(&assembler);
+    tokenlist_free(tokens);
+
+    job->cpu.PC = (options->entry == NO_ADDRESS) ? origin : options->entry;
+    return result;
+}
+
+static int load(Job* job, Mem* mem, const Options* options)
+{
+    size_t size = 0;
+    char* contents = read_file(job->path, &size);
+
+    if (contents == NULL)
+    {
+        (void)snprintf(job->error, sizeof(job->error), "cannot read file");
+        return -1;
+    }
+
+    int result = is_assembly(job->path)
+        ? load_assembly(job, mem, contents, size, options)
+        : load_binary(job, mem, contents, size, options);
+
+    free(contents);
+    return result;
+}
+
+/*
+ * The cpu runs at full speed in large slices, --until is a breakpoint.
+ * Only --trap, --log and --perf=classes need to look at every instruction,
+ * so the cpu is stepped one instruction at a time instead. So is --until in
+ * flat builds, which have no breakpoints.
+ */
+static void execute(Job* job,
+                    Mem* mem,
+                    const Options* options,
+                    Trace_Buffer* trace)
+{
+    CPU* cpu = &job->cpu;
+    int step = options->trap || trace != NULL
+        || options->profile == PROFILE_CLASSES;
+
+    if (cpu->PC == options->until)
+    {
+        job->status = STATUS_UNTIL;
+        return;
+    }
+
+    if (options->until != NO_ADDRESS
+        && Mem_Set_Trap(mem, (Word)options->until, TRAP_EXECUTE) != 0)
+        step = 1;
+
+    while (cpu->Cycles < options->cycles && !cpu->Halted)
+    {
+        const Word pc = cpu->PC;
+
+        if (trace != NULL && Trace_Buffer_Append(trace, cpu, mem) != 0)
+        {
+            job->status = STATUS_ERROR;
+            (void)snprintf(job->error, sizeof(job->error),
+                           "could not write the log");
+            return;
+        }
+
+        if (step && options->profile != PROFILE_OFF)
+            Perf_Step(&job->perf, cpu, mem);
+        else if (step)
+            CPU_Execute(cpu, mem, 1);
+        else
+        {
+            const u64 remaining = options->cycles - cpu->Cycles;
+            const u32 slice = remaining < SLICE_CYCLES
+                ? remaining : SLICE_CYCLES;
+
+            if (options->profile != PROFILE_OFF)
+                Perf_Execute(&job->perf, cpu, mem, slice);
+            else
+                CPU_Execute(cpu, mem, slice);
+        }
+
+        if (cpu->PC == options->until)
+        {
+            job->status = STATUS_UNTIL;
+            return;
+        }
+
+        if (options->trap && cpu->PC == pc && !cpu->Halted)
+        {
+            job->status = STATUS_TRAP;
+            return;
+        }
+    }
+
+    if (cpu->Halted == HALT_ILLEGAL)
+    {
+        job->status = STATUS_ERROR;
+        (void)snprintf(job->error, sizeof(job->error),
+                       "too many illegal instructions");
+    }
+    else
+        job->status = cpu->Halted ? STATUS_HALTED : STATUS_BUDGET;
+}
+
+// Renders the records of a run, with the labels of assembly files
+static int render_log(const Job* job,
+                      FILE* records,
+                      FILE* log,
+                      const Options* options)
+{
+    char line[192];
+    Trace_Record record;
+    int result;
+
+    rewind(records);
+    while ((result = Trace_Read(records, &record)) == 1)
+    {
+        (void)Trace_Render(&record, options->variant, &job->symbols,
+                           line, sizeof(line));
+        if (fprintf(log, "%s\n", line) < 0)
+            return -1;
+    }
+
+    return result;
+}
+
+/*
+ * While running, the states are only recorded in binary; the log is
+ * rendered from them once the run is over. It ends with the final state, so
+ * the last instruction is checked too.
+ */
+static void write_log(Job* job, Mem* mem, const Options* options)
+{
+    FILE* log = fopen(options->log, "w");
+    FILE* records = tmpfile();
+    Trace_Buffer trace = {0};
+
+    if (log == NULL || records == NULL
+        || Trace_Buffer_Initialise(&trace, LOG_RECORDS, records) != 0)
+    {
+        job->status = STATUS_ERROR;
+        (void)snprintf(job->error, sizeof(job->error),
+                       "could not open %s", options->log);
+    }
+    else
+    {
+        execute(job, mem, options, &trace);
+
+        if (Trace_Buffer_Append(&trace, &job->cpu, mem) != 0
+            || Trace_Buffer_Flush(&trace) != 0
+            || render_log(job, records, log, options) != 0)
+        {
+            job->status = STATUS_ERROR;
+            (void)snprintf(job->error, sizeof(job->error),
+                           "could not write %s", options->log);
+        }
+    }
+
+    Trace_Buffer_Free(&trace);
+    if (records != NULL)
+        (void)fclose(records);
+    if (log != NULL && fclose(log) != 0)
+    {
+        job->status = STATUS_ERROR;
+        (void)snprintf(job->error, sizeof(job->error),
+                       "could not write %s", options->log);
+    }
+}
+
+/*
+ * The cpu starts from the first state of the reference log and is compared
+ * with it after every instruction. The stop conditions do not apply.
+ */
+static void validate(Job* job, Mem* mem, const Options* options)
+{
+    FILE* reference = fopen(options->reference, "r");
+    Trace_Divergence divergence;
+
+    if (reference == NULL)
+    {
+        job->status = STATUS_ERROR;
+        (void)snprintf(job->error, sizeof(job->error),
+                       "could not open %s", options->reference);
+        return;
+    }
+
+    const int result = Trace_Validate(&job->cpu, mem, reference, &divergence);
+    (void)fclose(reference);
+
+    if (result < 0)
+    {
+        job->status = STATUS_ERROR;
+        (void)snprintf(job->error, sizeof(job->error),
+                       "could not read line %zu of %s",
+                       divergence.line, options->reference);
+    }
+    else if (result > 0)
+    {
+        char expected[64], actual[64];
+
+        (void)Trace_Format(&divergence.expected, expected, sizeof(expected));
+        (void)Trace_Format(&divergence.actual, actual, sizeof(actual));
+
+        job->status = STATUS_DIVERGED;
+        (void)snprintf(job->error, sizeof(job->error),
+                       "line %zu: expected %s, got %s",
+                       divergence.line, expected, actual);
+    }
+    else
+        job->status = STATUS_MATCHED;
+}
+
+/*
+ * The debugger takes over the stop conditions. The run ends once it detaches
+ * or kills the target.
+ */
+static void debug(Job* job, Mem* mem, const Options* options)
+{
+    const int listener = GDB_Listen(options->gdb);
+
+    if (listener < 0)
+    {
+        job->status = STATUS_ERROR;
+        (void)snprintf(job->error, sizeof(job->error),
+                       "could not listen on %s", options->gdb);
+        return;
+    }
+
+    (void)fprintf(stderr, "Waiting for gdb on %s\n", options->gdb);
+    const int fd = GDB_Accept(listener);
+    (void)close(listener);
+
+    const int result = (fd < 0) ? -1 : GDB_Serve(&job->cpu, mem, fd);
+
+    if (fd >= 0)
+        (void)close(fd);
+    if (strchr(options->gdb, '/') != NULL)
+        (void)unlink(options->gdb);
+
+    if (result < 0)
+    {
+        job->status = STATUS_ERROR;
+        (void)snprintf(job->error, sizeof(job->error),
+                       "lost connection to gdb");
+    }
+    else
+        job->status = job->cpu.Halted ? STATUS_HALTED : STATUS_DETACHED;
+}
+
+static void run(Job* job, const Options* options)
+{
+    const double start = now();
+    Mem* mem = malloc(sizeof(Mem));
+
+    if (mem == NULL)
+    {
+        job->status = STATUS_ERROR;
+        (void)snprintf(job->error, sizeof(job->error), "out of memory");
+        return;
+    }
+
+    if (options->profile != PROFILE_OFF)
+        (void)Perf_Open(&job->perf, options->variant);
+
+    if (CPU_Initialise(&job->cpu, mem, options->variant) != 0)
+    {
+        job->status = STATUS_ERROR;
+        (void)snprintf(job->error, sizeof(job->error),
+                       "variant not supported by this build");
+    }
+    else if (load(job, mem, options) != 0)
+        job->status = STATUS_ERROR;
+    else if (options->gdb != NULL)
+        debug(job, mem, options);
+    else if (options->reference != NULL)
+        validate(job, mem, options);
+    else if (options->log != NULL)
+        write_log(job, mem, options);
+    else
+        execute(job, mem, options, NULL);
+
+    if (options->profile != PROFILE_OFF)
+        Perf_Close(&job->perf);
+    Symbols_Free(&job->symbols);
+    free(mem);
+    job->seconds = now() - start;
+}
+
+static void* worker(void* argument)
+{
+    Pool* pool = argument;
+
+    for (;;)
+    {
+        (void)pthread_mutex_lock(&pool->lock);
+        const size_t index = pool->next++;
+        (void)pthread_mutex_unlock(&pool->lock);
+
+        if (index >= pool->count)
+            return NULL;
+
+        run(&pool->jobs[index], pool->options);
+    }
+}
+
+static void print_json_string(const char* text)
+{
+    (void)putchar('"');
+    for (; *text != '\0'; text++)
+    {
+        if (*text == '"' || *text == '\\')
+            (void)printf("\\%c", *text);
+        else if ((unsigned char)*text < 0x20)
+            (void)printf("\\u%04x", *text);
+        else
+            (void)putchar(*text);
+    }
+    (void)putchar('"');
+}
+
+static void print_csv_string(const char* text)
+{
+    (void)putchar('"');
+    for (; *text != '\0'; text++)
+    {
+        if (*text == '"')
+            (void)putchar('"');
+        (void)putchar(*text);
+    }
+    (void)putchar('"');
+}
+
+/*
+ * Host events per emulated instruction, empty or null for counters the host
+ * does not have. CSV fields are preceded by a comma, JSON members followed
+ * by one.
+ */
+static void print_costs(const Perf* perf,
+                        const Perf_Sample* sample,
+                        const Format format)
+{
+    for (int counter = 0; counter < PERF_COUNTERS; counter++)
+    {
+        if (format == FORMAT_JSON)
+            (void)printf("\"host_%s\": ", Perf_Counter_Name(counter));
+        else
+            (void)putchar(',');
+
+        if (Perf_Has(perf, counter))
+            (void)printf("%.3f", Perf_Cost(sample, counter));
+        else if (format == FORMAT_JSON)
+            (void)printf("null");
+
+        if (format == FORMAT_JSON)
+            (void)printf(", ");
+    }
+}
+
+static void print_csv_header(const char* columns)
+{
+    (void)printf("%s", columns);
+    for (int counter = 0; counter < PERF_COUNTERS; counter++)
+        (void)printf(",host_%s", Perf_Counter_Name(counter));
+    (void)putchar('\n');
+}
+
+static void print_json_perf(const Perf* perf, const Profile profile)
+{
+    (void)printf(", \"perf\": {");
+    print_costs(perf, &perf->Total, FORMAT_JSON);
+    (void)printf("\"instructions\": %llu", perf->Total.Instructions);
+
+    if (profile == PROFILE_CLASSES)
+    {
+        (void)printf(", \"classes\": {");
+        for (int class = 0; class < PERF_CLASSES; class++)
+        {
+            const Perf_Sample* sample = &perf->Classes[class];
+
+            (void)printf("%s\"%s\": {", class ? ", " : "",
+                         Perf_Class_Name(class));
+            print_costs(perf, sample, FORMAT_JSON);
+            (void)printf("\"instructions\": %llu, \"cycles\": %llu}",
+                         sample->Instructions, sample->Cycles);
+        }
+        (void)putchar('}');
+    }
+
+    (void)putchar('}');
+}
+
+// The breakdown follows the runs as a second table
+static void print_csv_classes(const Job* jobs, const size_t count)
+{
+    (void)putchar('\n');
+    print_csv_header("file,class,instructions,cycles");
+
+    for (size_t i = 0; i < count; i++)
+        for (int class = 0; class < PERF_CLASSES; class++)
+        {
+            const Perf_Sample* sample = &jobs[i].perf.Classes[class];
+
+            print_csv_string(jobs[i].path);
+            (void)printf(",%s,%llu,%llu", Perf_Class_Name(class),
+                         sample->Instructions, sample->Cycles);
+            print_costs(&jobs[i].perf, sample, FORMAT_CSV);
+            (void)putchar('\n');
+        }
+}
+
+static void report(const Job* jobs, const size_t count, const Options* options)
+{
+    const Format format = options->format;
+    const Profile profile = options->profile;
+
+    if (format == FORMAT_JSON)
+        (void)printf("[\n");
+    else if (profile != PROFILE_OFF)
+        print_csv_header("file,status,a,x,y,sp,p,pc,cycles,seconds,error,"
+                         "instructions");
+    else
+        (void)printf("file,status,a,x,y,sp,p,pc,cycles,seconds,error\n");
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const Job* job = &jobs[i];
+        const CPU* cpu = &job->cpu;
+
+        if (format == FORMAT_CSV)
+        {
+            print_csv_string(job->path);
+            (void)printf(",%s,%u,%u,%u,%u,%u,%u,%llu,%.6f,",
+                         status_name(job->status),
+                         cpu->A, cpu->X, cpu->Y, cpu->SP,
+                         CPU_Get_Status(cpu), cpu->PC,
+                         cpu->Cycles, job->seconds);
+            print_csv_string(job->error);
+            if (profile != PROFILE_OFF)
+            {
+                (void)printf(",%llu", job->perf.Total.Instructions);
+                print_costs(&job->perf, &job->perf.Total, FORMAT_CSV);
+            }
+            (void)putchar('\n');
+            continue;
+        }
+
+        (void)printf("  {\"file\": ");
+        print_json_string(job->path);
+        (void)printf(", \"status\": \"%s\", \"a\": %u, \"x\": %u, \"y\": %u, "
+                     "\"sp\": %u, \"p\": %u, \"pc\": %u, \"cycles\": %llu, "
+                     "\"seconds\": %.6f, \"error\": ",
+                     status_name(job->status),
+                     cpu->A, cpu->X, cpu->Y, cpu->SP,
+                     CPU_Get_Status(cpu), cpu->PC,
+                     cpu->Cycles, job->seconds);
+        print_json_string(job->error);
+        if (profile != PROFILE_OFF)
+            print_json_perf(&job->perf, profile);
+        (void)printf("}%s\n", (i + 1 < count) ? "," : "");
+    }
+
+    if (format == FORMAT_JSON)
+        (void)printf("]\n");
+    else if (profile == PROFILE_CLASSES)
+        print_csv_classes(jobs, count);
+}
+
+static void usage(const char* name)
+{
+    (void)fprintf(stderr,
+        "Usage: %s [options] file...\n"
+        "Runs 6502 ROM images and assembly files (.s, .asm, .a65) headless.\n"
+        "\n"
+        "  -v, --variant nmos|strict|cmos  cpu variant (default nmos, fixed\n"
+        "                      builds only support their own)\n"
+        "  -c, --cycles N      cycle budget per file (default %llu)\n"
+        "  -l, --load ADDR     load address (default: ROMs end at $FFFF,\n"
+        "                      assembly starts at $%04X)\n"
+        "  -e, --entry ADDR    entry point (default: reset vector or origin)\n"
+        "  -u, --until ADDR    stop once PC reaches ADDR\n"
+        "  -t, --trap          stop on jumps and branches to themselves\n"
+        "  -j, --jobs N        worker threads (default: online cpus)\n"
+        "  -g, --gdb PORT|PATH serve gdb on a local TCP port or Unix socket\n"
+        "                      (one file only, replaces the stop conditions)\n"
+        "  -w, --log PATH      log the state and disassembly before every\n"
+        "                      instruction in the nestest format, with the\n"
+        "                      labels of assembly files (one file only)\n"
+        "  -r, --reference PATH  run in lockstep with a nestest style log\n"
+        "                      and stop at the first divergence (one file only)\n"
+        "  -p, --perf[=classes]  report host cycles, instructions, branch and\n"
+        "                      L1d misses per emulated instruction, optionally\n"
+        "                      per opcode class (steps, so much slower)\n"
+        "  -f, --format csv|json  output format (default csv)\n"
+        "  -h, --help          show this help\n",
+        name, DEFAULT_CYCLES, DEFAULT_ORIGIN);
+}
+
+static void fail(const char* message, const char* argument)
+{
+    (void)fprintf(stderr, "%s '%s'\n", message, argument);
+    exit(EXIT_FAILURE);
+}
+
+static long parse_address(const char* text)
+{
+    char* end;
+    const long value = strtol(text[0] == '$' ? text + 1 : text, &end,
+                              text[0] == '$' ? 16 : 0);
+
+    if (*end != '\0' || value < 0 || value > 0xFFFF)
+        fail("Invalid address", text);
+
+    return value;
+}
+
+static CPU_Variant parse_variant(const char* text)
+{
+    if (strcmp(text, "nmos") == 0)
+        return VARIANT_NMOS;
+    if (strcmp(text, "strict") == 0)
+        return VARIANT_NMOS_STRICT;
+    if (strcmp(text, "cmos") == 0)
+        return VARIANT_CMOS;
+
+    fail("Invalid variant", text);
+    return VARIANT_NMOS;
+}
+
+int main(int argc, char** argv)
+{
+    Options options =
+    {
+        .variant = MOS_6502_DEFAULT_VARIANT,
+        .cycles = DEFAULT_CYCLES,
+        .load = NO_ADDRESS,
+        .entry = NO_ADDRESS,
+        .until = NO_ADDRESS,
+        .jobs = sysconf(_SC_NPROCESSORS_ONLN),
+        .format = FORMAT_CSV,
+    };
+
+    static const struct option long_options[] =
+    {
+        { "variant", required_argument, NULL, 'v' },
+        { "cycles", required_argument, NULL, 'c' },
+        { "load", required_argument, NULL, 'l' },
+        { "entry", required_argument, NULL, 'e' },
+        { "until", required_argument, NULL, 'u' },
+        { "trap", no_argument, NULL, 't' },
+        { "jobs", required_argument, NULL, 'j' },
+        { "gdb", required_argument, NULL, 'g' },
+        { "log", required_argument, NULL, 'w' },
+        { "reference", required_argument, NULL, 'r' },
+        { "perf", optional_argument, NULL, 'p' },
+        { "format", required_argument, NULL, 'f' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+
+    int option;
+    while ((option = getopt_long(argc, argv, "v:c:l:e:u:tj:g:w:r:p::f:h",
+                                 long_options, NULL)) != -1)
+    {
+        switch (option)
+        {
+            case 'v': options.variant = parse_variant(optarg); break;
+            case 'c': options.cycles = strtoull(optarg, NULL, 0); break;
+            case 'l': options.load = parse_address(optarg); break;
+            case 'e': options.entry = parse_address(optarg); break;
+            case 'u': options.until = parse_address(optarg); break;
+            case 't': options.trap = 1; break;
+            case 'j': options.jobs = atoi(optarg); break;
+            case 'g': options.gdb = optarg; break;
+            case 'w': options.log = optarg; break;
+            case 'r': options.reference = optarg; break;
+            case 'p':
+            {
+                if (optarg == NULL)
+                    options.profile = PROFILE_TOTAL;
+                else if (strcmp(optarg, "classes") == 0)
+                    options.profile = PROFILE_CLASSES;
+                else
+                    fail("Invalid profile", optarg);
+            } break;
+            case 'f':
+            {
+                if (strcmp(optarg, "json") == 0)
+                    options.format = FORMAT_JSON;
+                else if (strcmp(optarg, "csv") == 0)
+                    options.format = FORMAT_CSV;
+                else
+                    fail("Invalid format", optarg);
+            } break;
+            case 'h':
+            {
+                usage(argv[0]);
+                return EXIT_SUCCESS;
+            }
+            default:
+            {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    if (optind >= argc)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (options.gdb != NULL && argc - optind != 1)
+        fail("Exactly one file can be debugged with", "--gdb");
+    if (options.log != NULL && argc - optind != 1)
+        fail("Exactly one file can be logged with", "--log");
+    if (options.reference != NULL && argc - optind != 1)
+        fail("Exactly one file can be validated with", "--reference");
+
+    Pool pool =
+    {
+        .count = argc - optind,
+        .options = &options,
+    };
+
+    pool.jobs = calloc(pool.count, sizeof(Job));
+    if (pool.jobs == NULL)
+        fail("Memory allocation failed for", "jobs");
+
+    for (size_t i = 0; i < pool.count; i++)
+        pool.jobs[i].path = argv[optind + i];
+
+    if (options.jobs < 1)
+        options.jobs = 1;
+    if ((size_t)options.jobs > pool.count)
+        options.jobs = pool.count;
+
+    pthread_t* threads = malloc(sizeof(pthread_t) * options.jobs);
+    if (threads == NULL)
+        fail("Memory allocation failed for", "jobs");
+
+    (void)pthread_mutex_init(&pool.lock, NULL);
+    for (int i = 0; i < options.jobs; i++)
+        if (pthread_create(&threads[i], NULL, worker, &pool) != 0)
+            fail("Could not start worker thread", "pthread_create");
+    for (int i = 0; i < options.jobs; i++)
+        (void)pthread_join(threads[i], NULL);
+    (void)pthread_mutex_destroy(&pool.lock);
+
+    report(pool.jobs, pool.count, &options);
+
+    int failed = 0;
+    for (size_t i = 0; i < pool.count; i++)
+        failed |= (pool.jobs[i].status == STATUS_ERROR
+                   || pool.jobs[i].status == STATUS_DIVERGED);
+
+    free(threads);
+    free(pool.jobs);
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -1,355 +1,1707 @@
-#include "util.h"
-#include "cpu.h"
-
-#define BYTE_SIZE 0x08
-#define WORD_HEAD 0xFF00
-#define WORD_TAIL 0x00FF
-
-static int endianness = BIG;
-static int err = 0;
-
-/**
- * @brief Set the endianness to correctly represent the 6502's memory
- * 
- * The MOS 6502 uses little endian numbers so if the system running this code
- * is big endian, the LSB and MSB need to be reversed.
- * Invalid arguments will result in termination.
- * 
- * @param arg one of BIG=0, LITTLE=1, AUTO=2; sets endianness to the system's00000000
-*/
-void MOS_6502_set_endianness(const int arg)
-{
-	if (arg == AUTO)
-	{
-		int i = 1;
-		if (*((char *)&i) == 1)
-			endianness = LITTLE;
-	}
-
-	else if (arg == BIG || arg == LITTLE)
-		endianness = arg;
-
-	else
-		die("Invalid endianness; must be one of BIG=0, LITTLE=1, AUTO=2");
-}
-
-const Byte is_sign_set(const Byte input)
-	{ return input >> 7; }
-
-void Mem_Initialise(Mem* mem)
-	{ (void)memset(mem, 0, sizeof(mem->Data)); }
-
-const Byte Mem_Read_Byte(const CPU* cpu,
-                         const Mem* mem,
-						 u32* cycles,
-						 const Byte address)
-{
-	Byte data = Get_Memory(mem, address);
-	*cycles -= 1;
-
-	return data;
-}
-
-const Byte Mem_Read_Word(const CPU* cpu,
-                         const Mem* mem,
-						 u32* cycles,
-						 const Byte address)
-{
-	Word data = Mem_Read_Byte(cpu, mem, cycles, address);
-	if (endianness == LITTLE)
-		data |= (Mem_Read_Byte(cpu, mem, cycles, address + 1) << BYTE_SIZE);
-	else
-	{
-		data <<= BYTE_SIZE;
-		data |= Mem_Read_Byte(cpu, mem, cycles, address + 1);
-	}
-
-	return data;
-}
-
-const Byte Mem_Fetch_Byte(CPU* cpu, const Mem* mem, u32* cycles)
-{
-	Byte data = Get_Memory(mem, cpu->PC);
-	cpu->PC++;
-	*cycles -= 1;
-
-	return data;
-}
-
-const Word Mem_Fetch_Word(CPU* cpu, const Mem* mem, u32* cycles)
-{
-	Word data = Mem_Fetch_Byte(cpu, mem, cycles);
-	if (endianness == LITTLE)
-	     data |= (Mem_Fetch_Byte(cpu, mem, cycles) << BYTE_SIZE);
-	else
-	{
-		data <<= BYTE_SIZE;
-		data |= (Mem_Fetch_Byte(cpu, mem, cycles));
-	}
-
-	return data;
-}
-
-void Mem_Write_word(Mem* mem,
-                    u32* cycles,
-                    const Word word,
-                    const Word address)
-{
-    // TODO: What does the 6502 do with out-of-range addresses?
-    mem->Data[address] = word & WORD_TAIL;
-    mem->Data[address + 1] = word >> BYTE_SIZE;
-
-    *cycles -= 2;
-}
-
-const Byte CPU_Fetch_Register(const CPU* cpu, const Byte reg, u32* cycles)
-{
-	*cycles -= 1;
-	return reg;
-}
-
-int validate_index(const Word index)
-	{ 
-		assert(MAX_MEM >= sizeof(Word));
-		return (index >= 0);
-	}
-
-const Byte Get_Memory(const Mem* mem, const Word index)
-{
-	if (!validate_index(index))
-		die("Invalid address '%d'", index);
-	return mem->Data[index];
-}
-
-const int Set_Memory(Mem* mem, const Word index, const Byte data)
-{
-	if (!validate_index(index))
-		return -1;
-	
-	mem->Data[index] = data;
-	
-	return 0;
-}
-
-void CPU_Reset(CPU* cpu, Mem* mem)
-{
-	cpu->PC = 0xFFFC;	// Set Programme Counter
-	cpu->SP = 0x00FF;	// Set Stack Pointer
-	cpu->I  = 1;		// Set Interrupt Disable
-	cpu->D  = 0;		// Clear Decimal Flag
-	Mem_Initialise(mem);
-}
-
-// Flags
-void adc_set_flags(CPU* cpu, const Byte input, const Word sum)
-{
-	cpu->C = (sum & WORD_HEAD) != 0;
-	cpu->Z = (cpu->A == 0);
-	cpu->V = (~((cpu->N << 7) ^ input) & (input ^ sum)) >> 7;
-	cpu->N = is_sign_set(cpu->A);
-}
-
-void lda_set_flags(CPU* cpu)
-{
-	cpu->Z = (cpu->A == 0);
-	cpu->N = is_sign_set(cpu->A);
-}
-
-// ...
-
-// Addressing Modes
-// ...
-
-/**
- * @brief This function will emulate a MOS 6502 on virtual/simulated memory.
- * 
- * The individual instructions are fetched from memory and then interpreted.
- * If there are't enough cycles left to execute an instruction, the cpu will
- * crash.
- * TODO: Think: Perhaps the CPU should just stop mid execution?
- * Invalid memory addresses will result in termination, overflows are wrapped.
- * 
- * @param cpu the cpu you want to emulate
- * @param mem the memory on which the cpu will run
- * @param cycles the number of cycles for which you allow the cpu to run
-*/
-void CPU_Execute(CPU* cpu, Mem* mem, u32 cycles)
-{
-	Byte instruction;
-	u32* cycles_remaining = malloc(sizeof(u32));
-
-	if (cycles_remaining == NULL)
-	{
-		(void)perror("Memory allocation failed");
-		exit(EXIT_FAILURE);
-	}
-
-	*cycles_remaining = cycles;
-
-	while (*cycles_remaining > 0)
-	{
-		//DEBUG
-		(void)printf("Reading %d. Cycles remaining: %d\n",
-			cpu->PC, *cycles_remaining);
-
-		instruction = Mem_Fetch_Byte(cpu, mem, cycles_remaining);
-
-		switch(instruction)
-		{
-			// ADC
-			case INSTRUCTION_ADC_IMMEDIATE:
-			{
-				assert(*cycles_remaining >= 2-1);
-
-				Byte input = Mem_Fetch_Byte(cpu, mem, cycles_remaining);
-				Word sum = (cpu->A + input + cpu->C);
-
-				cpu->A = sum & WORD_TAIL;
-
-				adc_set_flags(cpu, input, sum);
-			} break;
-
-
-			//JMP
-			case INSTRUCTION_JMP_ABSOLUTE:
-			{
-				assert(*cycles_remaining >= 3-1);
-
-				Word jmp_addr = Mem_Fetch_Word(cpu, mem, cycles_remaining);
-				if (validate_index(jmp_addr))
-					cpu->PC = jmp_addr;
-				else
-					die("Illegal Jump Address '%d'", jmp_addr);
-				
-				// DEBUG
-				(void)printf("Executed JMP Absolute to %d\n", jmp_addr);
-			} break;
-			case INSTRUCTION_JMP_INDIRECT:
-			{
-				assert(*cycles_remaining >= 5-1);
-				
-				// DEBUG
-				(void)printf("Executed JMP Indirect\n");
-			} break;
-
-
-			// JSR
-			case INSTRUCTION_JSR_ABSOLUTE:
-			{
-				assert(*cycles_remaining >= 6-1);
-
-                Word sr_address = Mem_Fetch_Word(cpu, mem, cycles_remaining);
-                Mem_Write_word(mem, cycles_remaining, cpu->PC - 1, cpu->SP);
-                cpu->SP++;
-                cpu->PC = sr_address;
-                *cycles_remaining -= 1;
-				
-				// DEBUG
-				(void)printf("Executed JSR Absolute. Going to %d...\n", sr_address);
-			} break;
-
-
-			// LDA
-			case INSTRUCTION_LDA_IMMEDIATE:
-			{
-				assert(*cycles_remaining >= 2-1);
-
-				cpu->A = 
-					Mem_Fetch_Byte(cpu, mem, cycles_remaining);
-				lda_set_flags(cpu);
-
-				// DEBUG
-				(void)printf("Executed LDA Immediate\n");
-			} break;
-			case INSTRUCTION_LDA_ZEROPAGE:
-			{
-				assert(*cycles_remaining >= 3-1);
-
-				Byte zero_page_address = 
-					Mem_Fetch_Byte(cpu, 
-						       mem, 
-						       cycles_remaining);
-				cpu->A = Mem_Read_Byte(cpu,
-                                       mem,
-                                       cycles_remaining,
-                                       zero_page_address);
-				lda_set_flags(cpu);
-
-				// DEBUG
-				(void)printf("Executed LDA Zero Page\n");
-			} break;
-			case INSTRUCTION_LDA_ZEROPAGEX:
-			{
-				assert(*cycles_remaining >= 4-1);
-
-				Byte offset = CPU_Fetch_Register(cpu,
-					                         cpu->X,
-								 cycles_remaining);
-				Byte zero_page_address =
-					(Mem_Fetch_Byte(cpu,
-							mem,
-							cycles_remaining)
-					+ offset) % sizeof(mem->Data);
-				cpu->A = Mem_Read_Byte(cpu,
-						       mem,
-						       cycles_remaining,
-						       zero_page_address);
-
-				lda_set_flags(cpu);
-
-				// DEBUG
-				(void)printf("Executed LDA Zero Page,X\n");
-			} break;
-			case INSTRUCTION_LDA_ABSOLUTE:
-			{
-				assert(*cycles_remaining >= 4-1);
-				//...
-				lda_set_flags(cpu);
-
-				// DEBUG
-				(void)printf("Executed LDA Absolute");
-			} break;
-			case INSTRUCTION_LDA_ABSOLUTEX:
-			{
-				lda_set_flags(cpu);
-
-				// DEBUG
-				(void)printf("Executed LDA Absolute,X");
-			} break;
-			case INSTRUCTION_LDA_ABSOLUTEY:
-			{
-				lda_set_flags(cpu);
-
-				// DEBUG
-				(void)printf("Executed LDA Absolute,Y");
-			} break;
-			case INSTRUCTION_LDA_INDIRECTX:
-			{
-				lda_set_flags(cpu);
-
-				// DEBUG
-				(void)printf("Executed LDA Indirect,X");
-			} break;
-			case INSTRUCTION_LDA_INDIRECTY:
-			{
-				lda_set_flags(cpu);
-
-				// DEBUG
-				(void)printf("Executed LDA Indirect,Y");
-			} break;
-			default:
-			{
-				(void)fprintf(stderr,
-					      "Illegal instruction '%d'@%d\n",
-					      instruction,
-					      cpu->PC);
-				err++;
-				if (err >= MAX_ERRORS)
-					die("Critical Failure Detected! Aborting...\n");
-			} break;
-		}
-
-	}
-
-	free(cycles_remaining);
-}
+#include "util.h"
+#include "cpu.h"
+
+#define BYTE_SIZE 0x08
+#define WORD_HEAD 0xFF00
+#define WORD_TAIL 0x00FF
+
+#define STACK_PAGE    0x0100
+#define VECTOR_IRQ    0xFFFE
+#define STATUS_BREAK  0x10
+#define STATUS_UNUSED 0x20
+
+// Fixed builds, see cpu.h
+#ifdef MOS_6502_NO_DECIMAL
+#define DECIMAL(cpu) 0
+#else
+#define DECIMAL(cpu) ((cpu)->D)
+#endif
+
+#ifdef MOS_6502_FLAT
+#define PAGE_TRAPS(mem, page) TRAP_NONE
+#else
+#define PAGE_TRAPS(mem, page) ((mem)->Traps[page])
+#endif
+
+/**
+ * @brief Kept for source compatibility; the byte order is fixed at compile time.
+ * 
+ * The MOS 6502 uses little endian numbers regardless of the system running
+ * this code. Word accesses convert from the host's byte order, which is
+ * detected by the compiler (see MOS_6502_HOST_BIG_ENDIAN), so there is
+ * nothing left to configure at runtime.
+ * 
+ * @param arg one of BIG=0, LITTLE=1, AUTO=2
+ * @return 0, or -1 if arg is none of them
+*/
+const int MOS_6502_set_endianness(const int arg)
+{
+	if (arg != BIG && arg != LITTLE && arg != AUTO)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Load a little endian word with a single (possibly unaligned) 16-bit access.
+ * memcpy is the portable way to express this and compiles to one load, plus
+ * a byte swap on big endian hosts. The last address wraps around to $0000,
+ * which the flat array cannot express, so it is assembled byte by byte.
+ */
+static inline Word load_word(const Mem* mem, const Word address)
+{
+	Word data;
+
+	if (address == 0xFFFF)
+		return mem->Data[address] | (mem->Data[0x0000] << BYTE_SIZE);
+
+	(void)memcpy(&data, &mem->Data[address], sizeof(data));
+#if MOS_6502_HOST_BIG_ENDIAN
+	data = (data << BYTE_SIZE) | (data >> BYTE_SIZE);
+#endif
+	return data;
+}
+
+static inline void store_word(Mem* mem, const Word address, const Word data)
+{
+	mem->Data[address] = data & WORD_TAIL;
+	mem->Data[(Word)(address + 1)] = data >> BYTE_SIZE;
+}
+
+const Byte is_sign_set(const Byte input)
+	{ return input >> 7; }
+
+void Mem_Initialise(Mem* mem)
+	{ (void)memset(mem, 0, sizeof(*mem)); }
+
+const Byte Mem_Read_Byte(const CPU* cpu,
+                         const Mem* mem,
+						 u32* cycles,
+						 const Word address)
+{
+	Byte data = Get_Memory(mem, address);
+	*cycles -= 1;
+
+	return data;
+}
+
+const Word Mem_Read_Word(const CPU* cpu,
+                         const Mem* mem,
+						 u32* cycles,
+						 const Word address)
+{
+	*cycles -= 2;
+	return load_word(mem, address);
+}
+
+const Byte Mem_Fetch_Byte(CPU* cpu, const Mem* mem, u32* cycles)
+{
+	Byte data = Get_Memory(mem, cpu->PC);
+	cpu->PC++;
+	*cycles -= 1;
+
+	return data;
+}
+
+const Word Mem_Fetch_Word(CPU* cpu, const Mem* mem, u32* cycles)
+{
+	Word data = load_word(mem, cpu->PC);
+	cpu->PC += 2;
+	*cycles -= 2;
+
+	return data;
+}
+
+void Mem_Write_word(Mem* mem,
+                    u32* cycles,
+                    const Word word,
+                    const Word address)
+{
+    store_word(mem, address, word);
+    *cycles -= 2;
+}
+
+const Byte CPU_Fetch_Register(const CPU* cpu, const Byte reg, u32* cycles)
+{
+	*cycles -= 1;
+	return reg;
+}
+
+int validate_index(const Word index)
+	{ 
+		assert(MAX_MEM >= sizeof(Word));
+		return (index >= 0);
+	}
+
+// Every Word is a valid address, reads cannot fail
+const Byte Get_Memory(const Mem* mem, const Word index)
+	{ return mem->Data[index]; }
+
+const int Set_Memory(Mem* mem, const Word index, const Byte data)
+{
+	if (!validate_index(index))
+		return -1;
+	
+	mem->Data[index] = data;
+	
+	return 0;
+}
+
+// Traps
+/*
+ * Each kind of trap has a bitmap with one bit per address. The page flags
+ * summarise the bitmaps so the interpreter only has to test a single byte
+ * per access and never touches the bitmaps of pages without traps.
+ */
+static void update_page_traps(Mem* mem, const Word address)
+{
+	const int first = (address & WORD_HEAD) >> 3;
+	Byte flags = TRAP_NONE;
+
+	for (Byte kind = TRAP_EXECUTE; kind & TRAP_ALL; kind <<= 1)
+		for (int i = first; i < first + PAGE_SIZE / 8; i++)
+			if (mem->Trap_Map[TRAP_INDEX(kind)][i])
+			{
+				flags |= kind;
+				break;
+			}
+
+	mem->Traps[address >> BYTE_SIZE] = flags;
+}
+
+const int Mem_Set_Trap(Mem* mem, const Word address, const Byte kinds)
+{
+#ifdef MOS_6502_FLAT
+	(void)mem;
+	(void)address;
+	(void)kinds;
+	return -1;
+#else
+	if (kinds == TRAP_NONE || (kinds & ~TRAP_ALL))
+		return -1;
+
+	for (Byte kind = TRAP_EXECUTE; kind & TRAP_ALL; kind <<= 1)
+		if (kinds & kind)
+			mem->Trap_Map[TRAP_INDEX(kind)][address >> 3] |= 1 << (address & 7);
+
+	mem->Traps[address >> BYTE_SIZE] |= kinds;
+
+	return 0;
+#endif
+}
+
+const int Mem_Clear_Trap(Mem* mem, const Word address, const Byte kinds)
+{
+	if (kinds == TRAP_NONE || (kinds & ~TRAP_ALL))
+		return -1;
+
+	for (Byte kind = TRAP_EXECUTE; kind & TRAP_ALL; kind <<= 1)
+		if (kinds & kind)
+			mem->Trap_Map[TRAP_INDEX(kind)][address >> 3] &= ~(1 << (address & 7));
+
+	update_page_traps(mem, address);
+
+	return 0;
+}
+
+void Mem_Clear_Traps(Mem* mem)
+{
+	(void)memset(mem->Traps, 0, sizeof(mem->Traps));
+	(void)memset(mem->Trap_Map, 0, sizeof(mem->Trap_Map));
+}
+
+void Coverage_Clear(Coverage* coverage)
+{
+	for (u32 i = 0; i < coverage->Count; i++)
+		coverage->Hits[coverage->Edges[i]] = 0;
+
+	coverage->Count = 0;
+	coverage->Previous = 0;
+}
+
+// Flags
+void adc_set_flags(CPU* cpu, const Byte a, const Byte input, const Word sum)
+{
+	cpu->C = (sum & WORD_HEAD) != 0;
+	cpu->Z = (cpu->A == 0);
+	cpu->V = (~(a ^ input) & (a ^ sum) & 0x80) >> 7;
+	cpu->N = is_sign_set(cpu->A);
+}
+
+// Decimal Mode
+/*
+ * NMOS decimal arithmetic works one nibble at a time. Instead of comparing and
+ * adjusting each digit with branches, the low digit (plus carry/borrow) is
+ * used as an index into a small table holding the already adjusted digit with
+ * the decimal carry/borrow folded into bit 4. Both tables cover invalid BCD
+ * digits ($A-$F) so the results match the hardware for any input.
+ */
+
+/* (A & $0F) + (B & $0F) + C  ->  AL < $0A ? AL : ((AL + $06) & $0F) + $10 */
+static const Byte bcd_add_low[32] =
+{
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+	0x08, 0x09, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15,
+	0x16, 0x17, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D,
+	0x1E, 0x1F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15,
+};
+
+/* (A & $0F) - (B & $0F) + C - 1 + 16  ->  AL >= 0 ? AL : ((AL - $06) & $0F) - $10 */
+static const signed char bcd_sub_low[32] =
+{
+	-0x06, -0x05, -0x04, -0x03, -0x02, -0x01, -0x10, -0x0F,
+	-0x0E, -0x0D, -0x0C, -0x0B, -0x0A, -0x09, -0x08, -0x07,
+	 0x00,  0x01,  0x02,  0x03,  0x04,  0x05,  0x06,  0x07,
+	 0x08,  0x09,  0x0A,  0x0B,  0x0C,  0x0D,  0x0E,  0x0F,
+};
+
+/**
+ * @brief Add with carry in decimal mode, following the NMOS 6502.
+ *
+ * Only the carry is decimal. Z reflects the binary sum, while N and V are
+ * taken from the intermediate result before the high digit is adjusted.
+ */
+void adc_decimal(CPU* cpu, const Byte input)
+{
+	const Byte a = cpu->A;
+	const Word binary = a + input + cpu->C;
+	Word sum = (a & 0xF0) + (input & 0xF0)
+		+ bcd_add_low[(a & 0x0F) + (input & 0x0F) + cpu->C];
+
+	cpu->Z = (binary & WORD_TAIL) == 0;
+	cpu->N = (sum >> 7) & 1;
+	cpu->V = (~(a ^ input) & (a ^ sum) & 0x80) >> 7;
+
+	sum += (sum >= 0xA0) * 0x60;
+
+	cpu->C = sum > WORD_TAIL;
+	cpu->A = sum & WORD_TAIL;
+}
+
+/**
+ * @brief Subtract with borrow in decimal mode, following the NMOS 6502.
+ *
+ * All flags are identical to binary mode; only the accumulator is adjusted.
+ */
+void sbc_decimal(CPU* cpu, const Byte input)
+{
+	const Byte a = cpu->A;
+	const Word binary = a - input - !cpu->C;
+	int difference = (a & 0xF0) - (input & 0xF0)
+		+ bcd_sub_low[(a & 0x0F) - (input & 0x0F) + cpu->C + 15];
+
+	difference -= (difference < 0) * 0x60;
+
+	cpu->C = binary < 0x100;
+	cpu->Z = (binary & WORD_TAIL) == 0;
+	cpu->V = ((a ^ input) & (a ^ binary) & 0x80) >> 7;
+	cpu->N = (binary >> 7) & 1;
+	cpu->A = difference & WORD_TAIL;
+}
+
+// Arithmetic
+void adc(CPU* cpu, const Byte input)
+{
+	if (DECIMAL(cpu))
+	{
+		adc_decimal(cpu, input);
+		return;
+	}
+
+	const Byte a = cpu->A;
+	const Word sum = a + input + cpu->C;
+
+	cpu->A = sum & WORD_TAIL;
+	adc_set_flags(cpu, a, input, sum);
+}
+
+void sbc(CPU* cpu, const Byte input)
+{
+	if (DECIMAL(cpu))
+		sbc_decimal(cpu, input);
+	else
+		adc(cpu, ~input);
+}
+
+// Internal memory access
+/*
+ * The opcode handlers go through these instead of the public Mem_* functions.
+ * Cycles are accounted for by the dispatch table, and every Word is a valid
+ * address, so neither needs to be checked per access.
+ *
+ * Data accesses test the trap flags of their page. Only a page holding a
+ * watchpoint takes the slow path, which looks the exact address up.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define UNLIKELY(condition) __builtin_expect(!!(condition), 0)
+#define COLD __attribute__((cold, noinline))
+#else
+#define UNLIKELY(condition) (condition)
+#define COLD
+#endif
+
+static inline int trap_is_set(const Mem* mem,
+                              const Word address,
+                              const Byte kind)
+{
+	return (mem->Trap_Map[TRAP_INDEX(kind)][address >> 3] >> (address & 7)) & 1;
+}
+
+// Only the first hit is kept, CPU_Execute stops after the current instruction
+static COLD void trap_access(CPU* cpu,
+                             const Mem* mem,
+                             const Word address,
+                             const Byte kind)
+{
+	if (cpu->Trap == TRAP_NONE && trap_is_set(mem, address, kind))
+	{
+		cpu->Trap = kind;
+		cpu->Trap_Address = address;
+	}
+}
+
+static inline Byte read_byte(CPU* cpu, const Mem* mem, const Word address)
+{
+	if (UNLIKELY(PAGE_TRAPS(mem, address >> BYTE_SIZE) & TRAP_READ))
+		trap_access(cpu, mem, address, TRAP_READ);
+
+	return mem->Data[address];
+}
+
+static inline void write_byte(CPU* cpu,
+                              Mem* mem,
+                              const Word address,
+                              const Byte data)
+{
+	if (UNLIKELY(PAGE_TRAPS(mem, address >> BYTE_SIZE) & TRAP_WRITE))
+		trap_access(cpu, mem, address, TRAP_WRITE);
+
+	mem->Data[address] = data;
+}
+
+// Opcode and operand fetches are not data accesses and never hit a watchpoint
+static inline Byte fetch_byte(CPU* cpu, const Mem* mem)
+	{ return mem->Data[cpu->PC++]; }
+
+static inline Word fetch_word(CPU* cpu, const Mem* mem)
+{
+	const Word data = load_word(mem, cpu->PC);
+	cpu->PC += 2;
+	return data;
+}
+
+static inline Word read_word(CPU* cpu, const Mem* mem, const Word address)
+{
+	const Word next = address + 1;
+
+	if (UNLIKELY((PAGE_TRAPS(mem, address >> BYTE_SIZE)
+		| PAGE_TRAPS(mem, next >> BYTE_SIZE)) & TRAP_READ))
+	{
+		trap_access(cpu, mem, address, TRAP_READ);
+		trap_access(cpu, mem, next, TRAP_READ);
+	}
+
+	return load_word(mem, address);
+}
+
+// Zero page
+/*
+ * A zero page address cannot leave page zero, so these test the trap flags
+ * of that page directly instead of deriving the page from the address.
+ */
+static inline Byte read_zero_page(CPU* cpu, const Mem* mem, const Byte address)
+{
+	if (UNLIKELY(PAGE_TRAPS(mem, 0) & TRAP_READ))
+		trap_access(cpu, mem, address, TRAP_READ);
+
+	return mem->Data[address];
+}
+
+// Pointers stored in the zero page wrap around within the zero page
+static inline Word read_word_zero_page(CPU* cpu,
+                                       const Mem* mem,
+                                       const Byte address)
+{
+	return read_zero_page(cpu, mem, address)
+		| (read_zero_page(cpu, mem, (Byte)(address + 1)) << BYTE_SIZE);
+}
+
+// Stack
+/*
+ * The stack always lives in page one and SP wraps around within it. Pushes
+ * and pulls are the hottest accesses after opcode fetches, so they go
+ * straight to memory and, like fetches, never hit a watchpoint.
+ */
+static inline void push(CPU* cpu, Mem* mem, const Byte data)
+	{ mem->Data[STACK_PAGE | cpu->SP--] = data; }
+
+static inline Byte pull(CPU* cpu, const Mem* mem)
+	{ return mem->Data[STACK_PAGE | ++cpu->SP]; }
+
+// High byte first, so the word ends up little endian on the stack
+static inline void push_word(CPU* cpu, Mem* mem, const Word data)
+{
+	const Byte sp = cpu->SP;
+
+	mem->Data[STACK_PAGE | sp] = data >> BYTE_SIZE;
+	mem->Data[STACK_PAGE | (Byte)(sp - 1)] = data & WORD_TAIL;
+	cpu->SP = sp - 2;
+}
+
+static inline Word pull_word(CPU* cpu, const Mem* mem)
+{
+	const Byte sp = cpu->SP;
+
+	cpu->SP = sp + 2;
+	return mem->Data[STACK_PAGE | (Byte)(sp + 1)]
+		| (mem->Data[STACK_PAGE | (Byte)(sp + 2)] << BYTE_SIZE);
+}
+
+// Addressing Modes
+/*
+ * Every opcode is composed from one of these kernels and an operation. A
+ * kernel consumes the operand, returns the effective address and the penalty
+ * cycle for indexing across a page. The penalty is the carry out of the low
+ * byte of the address, so it is computed arithmetically rather than by
+ * comparing pages. Only read instructions pay it, all others ignore it.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define KERNEL static inline __attribute__((always_inline))
+#else
+#define KERNEL static inline
+#endif
+
+typedef struct Address
+{
+	Word address;	// Effective address
+	Byte penalty;	// 1 if indexing crossed a page, else 0
+	Byte fetched;	// The operand itself, not data: never hits a watchpoint
+} Address;
+
+KERNEL Address indexed(const Word base, const Byte index)
+{
+	const Address result =
+	{
+		.address = base + index,
+		.penalty = ((base & WORD_TAIL) + index) >> BYTE_SIZE,
+	};
+	return result;
+}
+
+KERNEL Address direct(const Word address)
+{
+	const Address result = { .address = address };
+	return result;
+}
+
+KERNEL Address mode_imm(CPU* cpu, const Mem* mem)
+{
+	const Address result = { .address = cpu->PC++, .fetched = 1 };
+	return result;
+}
+
+// Immediate data is fetched like every other operand byte
+KERNEL Byte read_operand(CPU* cpu, const Mem* mem, const Address operand)
+{
+	return operand.fetched
+		? mem->Data[operand.address] : read_byte(cpu, mem, operand.address);
+}
+
+KERNEL Address mode_zp(CPU* cpu, const Mem* mem)
+	{ return direct(fetch_byte(cpu, mem)); }
+
+KERNEL Address mode_zpx(CPU* cpu, const Mem* mem)
+	{ return direct((Byte)(fetch_byte(cpu, mem) + cpu->X)); }
+
+KERNEL Address mode_zpy(CPU* cpu, const Mem* mem)
+	{ return direct((Byte)(fetch_byte(cpu, mem) + cpu->Y)); }
+
+KERNEL Address mode_abs(CPU* cpu, const Mem* mem)
+	{ return direct(fetch_word(cpu, mem)); }
+
+KERNEL Address mode_absx(CPU* cpu, const Mem* mem)
+	{ return indexed(fetch_word(cpu, mem), cpu->X); }
+
+KERNEL Address mode_absy(CPU* cpu, const Mem* mem)
+	{ return indexed(fetch_word(cpu, mem), cpu->Y); }
+
+KERNEL Address mode_izx(CPU* cpu, const Mem* mem)
+	{ return direct(read_word_zero_page(cpu, mem, fetch_byte(cpu, mem) + cpu->X)); }
+
+KERNEL Address mode_izy(CPU* cpu, const Mem* mem)
+	{ return indexed(read_word_zero_page(cpu, mem, fetch_byte(cpu, mem)), cpu->Y); }
+
+// (Zero Page), 65C02 only
+KERNEL Address mode_izp(CPU* cpu, const Mem* mem)
+	{ return direct(read_word_zero_page(cpu, mem, fetch_byte(cpu, mem))); }
+
+/*
+ * (Absolute) as implemented by the NMOS part: the pointer's high byte is
+ * fetched without carrying into the page, so ($xxFF) reads $xx00.
+ */
+KERNEL Address mode_ind(CPU* cpu, const Mem* mem)
+{
+	const Word pointer = fetch_word(cpu, mem);
+	const Word high = (pointer & WORD_HEAD) | ((pointer + 1) & WORD_TAIL);
+
+	return direct(read_byte(cpu, mem, pointer)
+		| (read_byte(cpu, mem, high) << BYTE_SIZE));
+}
+
+// (Absolute) with the page wrap fixed, 65C02 only
+KERNEL Address mode_ind_cmos(CPU* cpu, const Mem* mem)
+	{ return direct(read_word(cpu, mem, fetch_word(cpu, mem))); }
+
+// (Absolute,X), 65C02 only
+KERNEL Address mode_iax(CPU* cpu, const Mem* mem)
+	{ return direct(read_word(cpu, mem, fetch_word(cpu, mem) + cpu->X)); }
+
+/*
+ * Relative branch target. The penalty is set when the target is on a
+ * different page than the next instruction.
+ */
+KERNEL Address mode_rel(CPU* cpu, const Mem* mem)
+{
+	const signed char offset = fetch_byte(cpu, mem);
+	const Word target = cpu->PC + offset;
+	const Address result =
+	{
+		.address = target,
+		.penalty = ((cpu->PC ^ target) & WORD_HEAD) != 0,
+	};
+	return result;
+}
+
+// Flags
+static inline void set_nz(CPU* cpu, const Byte value)
+{
+	cpu->Z = (value == 0);
+	cpu->N = is_sign_set(value);
+}
+
+const Byte CPU_Get_Status(const CPU* cpu)
+{
+	return cpu->C
+		| (cpu->Z << 1)
+		| (cpu->I << 2)
+		| (cpu->D << 3)
+		| (cpu->B << 4)
+		| STATUS_UNUSED
+		| (cpu->V << 6)
+		| (cpu->N << 7);
+}
+
+void CPU_Set_Status(CPU* cpu, const Byte status)
+{
+	cpu->C = status;
+	cpu->Z = status >> 1;
+	cpu->I = status >> 2;
+	cpu->D = status >> 3;
+	cpu->B = status >> 4;
+	cpu->V = status >> 6;
+	cpu->N = status >> 7;
+}
+
+// Operations
+/*
+ * Read operations take the operand, write operations return the value to be
+ * stored and read-modify-write operations return the modified operand.
+ */
+static inline void lda(CPU* cpu, const Byte input)
+{
+	cpu->A = input;
+	set_nz(cpu, cpu->A);
+}
+
+static inline void ldx(CPU* cpu, const Byte input)
+{
+	cpu->X = input;
+	set_nz(cpu, cpu->X);
+}
+
+static inline void ldy(CPU* cpu, const Byte input)
+{
+	cpu->Y = input;
+	set_nz(cpu, cpu->Y);
+}
+
+static inline void and(CPU* cpu, const Byte input)
+{
+	cpu->A &= input;
+	set_nz(cpu, cpu->A);
+}
+
+static inline void eor(CPU* cpu, const Byte input)
+{
+	cpu->A ^= input;
+	set_nz(cpu, cpu->A);
+}
+
+static inline void ora(CPU* cpu, const Byte input)
+{
+	cpu->A |= input;
+	set_nz(cpu, cpu->A);
+}
+
+static inline void compare(CPU* cpu, const Byte reg, const Byte input)
+{
+	cpu->C = (reg >= input);
+	set_nz(cpu, reg - input);
+}
+
+static inline void cmp(CPU* cpu, const Byte input)
+	{ compare(cpu, cpu->A, input); }
+
+static inline void cpx(CPU* cpu, const Byte input)
+	{ compare(cpu, cpu->X, input); }
+
+static inline void cpy(CPU* cpu, const Byte input)
+	{ compare(cpu, cpu->Y, input); }
+
+static inline void bit(CPU* cpu, const Byte input)
+{
+	cpu->Z = ((cpu->A & input) == 0);
+	cpu->V = input >> 6;
+	cpu->N = input >> 7;
+}
+
+static inline void nop(CPU* cpu, const Byte input)
+	{ }
+
+static inline Byte sta(CPU* cpu)
+	{ return cpu->A; }
+
+static inline Byte stx(CPU* cpu)
+	{ return cpu->X; }
+
+static inline Byte sty(CPU* cpu)
+	{ return cpu->Y; }
+
+static inline Byte asl(CPU* cpu, const Byte input)
+{
+	const Byte result = input << 1;
+
+	cpu->C = input >> 7;
+	set_nz(cpu, result);
+	return result;
+}
+
+static inline Byte lsr(CPU* cpu, const Byte input)
+{
+	const Byte result = input >> 1;
+
+	cpu->C = input;
+	set_nz(cpu, result);
+	return result;
+}
+
+static inline Byte rol(CPU* cpu, const Byte input)
+{
+	const Byte result = (input << 1) | cpu->C;
+
+	cpu->C = input >> 7;
+	set_nz(cpu, result);
+	return result;
+}
+
+static inline Byte ror(CPU* cpu, const Byte input)
+{
+	const Byte result = (input >> 1) | (cpu->C << 7);
+
+	cpu->C = input;
+	set_nz(cpu, result);
+	return result;
+}
+
+static inline Byte inc(CPU* cpu, const Byte input)
+{
+	const Byte result = input + 1;
+
+	set_nz(cpu, result);
+	return result;
+}
+
+static inline Byte dec(CPU* cpu, const Byte input)
+{
+	const Byte result = input - 1;
+
+	set_nz(cpu, result);
+	return result;
+}
+
+// Undocumented NMOS operations
+static inline void lax(CPU* cpu, const Byte input)
+{
+	cpu->A = cpu->X = input;
+	set_nz(cpu, input);
+}
+
+static inline void las(CPU* cpu, const Byte input)
+{
+	cpu->A = cpu->X = cpu->SP = input & cpu->SP;
+	set_nz(cpu, cpu->A);
+}
+
+static inline void anc(CPU* cpu, const Byte input)
+{
+	and(cpu, input);
+	cpu->C = cpu->N;
+}
+
+static inline void alr(CPU* cpu, const Byte input)
+	{ cpu->A = lsr(cpu, cpu->A & input); }
+
+static inline void arr(CPU* cpu, const Byte input)
+{
+	const Byte masked = cpu->A & input;
+
+	cpu->A = (masked >> 1) | (cpu->C << 7);
+	set_nz(cpu, cpu->A);
+
+	if (!DECIMAL(cpu))
+	{
+		cpu->C = cpu->A >> 6;
+		cpu->V = (cpu->A >> 6) ^ (cpu->A >> 5);
+		return;
+	}
+
+	cpu->V = (masked ^ cpu->A) >> 6;
+	if ((masked & 0x0F) + (masked & 0x01) > 5)
+		cpu->A = (cpu->A & 0xF0) | ((cpu->A + 0x06) & 0x0F);
+	cpu->C = (masked >> 4) + ((masked >> 4) & 0x01) > 5;
+	cpu->A += cpu->C * 0x60;
+}
+
+static inline void sbx(CPU* cpu, const Byte input)
+{
+	const Byte masked = cpu->A & cpu->X;
+
+	cpu->C = (masked >= input);
+	cpu->X = masked - input;
+	set_nz(cpu, cpu->X);
+}
+
+/*
+ * XAA and LXA depend on analogue effects on real silicon. The constant below
+ * is what most NMOS parts produce and what test suites expect.
+ */
+#define UNSTABLE_MAGIC 0xEE
+
+static inline void xaa(CPU* cpu, const Byte input)
+{
+	cpu->A = (cpu->A | UNSTABLE_MAGIC) & cpu->X & input;
+	set_nz(cpu, cpu->A);
+}
+
+static inline void lxa(CPU* cpu, const Byte input)
+	{ lax(cpu, (cpu->A | UNSTABLE_MAGIC) & input); }
+
+static inline Byte sax(CPU* cpu)
+	{ return cpu->A & cpu->X; }
+
+static inline Byte slo(CPU* cpu, const Byte input)
+{
+	const Byte result = asl(cpu, input);
+
+	ora(cpu, result);
+	return result;
+}
+
+static inline Byte rla(CPU* cpu, const Byte input)
+{
+	const Byte result = rol(cpu, input);
+
+	and(cpu, result);
+	return result;
+}
+
+static inline Byte sre(CPU* cpu, const Byte input)
+{
+	const Byte result = lsr(cpu, input);
+
+	eor(cpu, result);
+	return result;
+}
+
+static inline Byte rra(CPU* cpu, const Byte input)
+{
+	const Byte result = ror(cpu, input);
+
+	adc(cpu, result);
+	return result;
+}
+
+static inline Byte dcp(CPU* cpu, const Byte input)
+{
+	const Byte result = input - 1;
+
+	cmp(cpu, result);
+	return result;
+}
+
+static inline Byte isc(CPU* cpu, const Byte input)
+{
+	const Byte result = input + 1;
+
+	sbc(cpu, result);
+	return result;
+}
+
+// 65C02 operations
+static inline Byte stz(CPU* cpu)
+	{ return 0; }
+
+static inline Byte tsb(CPU* cpu, const Byte input)
+{
+	cpu->Z = ((cpu->A & input) == 0);
+	return input | cpu->A;
+}
+
+static inline Byte trb(CPU* cpu, const Byte input)
+{
+	cpu->Z = ((cpu->A & input) == 0);
+	return input & ~cpu->A;
+}
+
+/**
+ * @brief Add with carry as done by the 65C02.
+ *
+ * Unlike the NMOS part, N and Z are valid in decimal mode.
+ */
+static inline void adc_cmos(CPU* cpu, const Byte input)
+{
+	adc(cpu, input);
+	set_nz(cpu, cpu->A);
+}
+
+/**
+ * @brief Subtract with borrow as done by the 65C02.
+ *
+ * The decimal adjustment is applied to the full binary difference, which
+ * differs from the NMOS part for invalid BCD digits. N and Z are valid.
+ */
+static inline void sbc_cmos(CPU* cpu, const Byte input)
+{
+	if (!DECIMAL(cpu))
+	{
+		sbc(cpu, input);
+		return;
+	}
+
+	const int low = (cpu->A & 0x0F) - (input & 0x0F) + cpu->C - 1;
+	int difference = cpu->A - input + cpu->C - 1;
+
+	cpu->C = (difference >= 0);
+	cpu->V = ((cpu->A ^ input) & (cpu->A ^ difference) & 0x80) >> 7;
+
+	difference -= (difference < 0) * 0x60;
+	difference -= (low < 0) * 0x06;
+
+	cpu->A = difference & WORD_TAIL;
+	set_nz(cpu, cpu->A);
+}
+
+// Opcode handlers
+/*
+ * A handler executes one instruction whose opcode has already been fetched
+ * and returns the number of cycles it took on top of the base cycle count in
+ * the dispatch table (page crossings, taken branches).
+ */
+typedef int (*Opcode_Handler)(CPU* cpu, Mem* mem);
+
+struct Opcode
+{
+	Opcode_Handler handler;
+	Byte cycles;
+	Byte idle;		// May be part of an idle loop, see skip_idle_loop
+};
+
+#define READ(op, mode) \
+	static int op##_##mode(CPU* cpu, Mem* mem) \
+	{ \
+		const Address operand = mode_##mode(cpu, mem); \
+		op(cpu, read_operand(cpu, mem, operand)); \
+		return operand.penalty; \
+	}
+
+// 65C02 decimal arithmetic takes an extra cycle
+#define READ_DECIMAL(op, mode) \
+	static int op##_##mode(CPU* cpu, Mem* mem) \
+	{ \
+		const Address operand = mode_##mode(cpu, mem); \
+		op(cpu, read_operand(cpu, mem, operand)); \
+		return operand.penalty + DECIMAL(cpu); \
+	}
+
+#define WRITE(op, mode) \
+	static int op##_##mode(CPU* cpu, Mem* mem) \
+	{ \
+		write_byte(cpu, mem, mode_##mode(cpu, mem).address, op(cpu)); \
+		return 0; \
+	}
+
+#define MODIFY(op, mode) \
+	static int op##_##mode(CPU* cpu, Mem* mem) \
+	{ \
+		const Word address = mode_##mode(cpu, mem).address; \
+		write_byte(cpu, mem, address, op(cpu, read_byte(cpu, mem, address))); \
+		return 0; \
+	}
+
+// 65C02 shifts and rotates only take the Absolute,X penalty on page crossings
+#define MODIFY_CMOS(op, mode) \
+	static int op##_##mode##_cmos(CPU* cpu, Mem* mem) \
+	{ \
+		const Address operand = mode_##mode(cpu, mem); \
+		const Byte input = read_byte(cpu, mem, operand.address); \
+		write_byte(cpu, mem, operand.address, op(cpu, input)); \
+		return operand.penalty; \
+	}
+
+// Jumps only use the effective address
+#define JUMP(name, mode) \
+	static int name(CPU* cpu, Mem* mem) \
+	{ \
+		cpu->PC = mode_##mode(cpu, mem).address; \
+		return 0; \
+	}
+
+#define ACCUMULATOR(op) \
+	static int op##_acc(CPU* cpu, Mem* mem) \
+	{ \
+		cpu->A = op(cpu, cpu->A); \
+		return 0; \
+	}
+
+#define READ_ALL(op) \
+	READ(op, imm) READ(op, zp) READ(op, zpx) READ(op, abs) \
+	READ(op, absx) READ(op, absy) READ(op, izx) READ(op, izy)
+
+#define MODIFY_ALL(op) \
+	MODIFY(op, zp) MODIFY(op, zpx) MODIFY(op, abs) MODIFY(op, absx) \
+	MODIFY(op, absy) MODIFY(op, izx) MODIFY(op, izy)
+
+#define SHIFT_ALL(op) \
+	ACCUMULATOR(op) MODIFY(op, zp) MODIFY(op, zpx) MODIFY(op, abs) \
+	MODIFY(op, absx) MODIFY_CMOS(op, absx)
+
+READ_ALL(adc) READ_ALL(and) READ_ALL(cmp) READ_ALL(eor)
+READ_ALL(lda) READ_ALL(ora) READ_ALL(sbc)
+READ_DECIMAL(adc_cmos, imm) READ_DECIMAL(sbc_cmos, imm)
+
+READ(cpx, imm) READ(cpx, zp) READ(cpx, abs)
+READ(cpy, imm) READ(cpy, zp) READ(cpy, abs)
+READ(ldx, imm) READ(ldx, zp) READ(ldx, zpy) READ(ldx, abs) READ(ldx, absy)
+READ(ldy, imm) READ(ldy, zp) READ(ldy, zpx) READ(ldy, abs) READ(ldy, absx)
+READ(bit, zp) READ(bit, abs)
+READ(nop, imm) READ(nop, zp) READ(nop, zpx) READ(nop, abs) READ(nop, absx)
+
+WRITE(sta, zp) WRITE(sta, zpx) WRITE(sta, abs) WRITE(sta, absx)
+WRITE(sta, absy) WRITE(sta, izx) WRITE(sta, izy)
+WRITE(stx, zp) WRITE(stx, zpy) WRITE(stx, abs)
+WRITE(sty, zp) WRITE(sty, zpx) WRITE(sty, abs)
+
+SHIFT_ALL(asl) SHIFT_ALL(lsr) SHIFT_ALL(rol) SHIFT_ALL(ror)
+MODIFY(inc, zp) MODIFY(inc, zpx) MODIFY(inc, abs) MODIFY(inc, absx)
+MODIFY(dec, zp) MODIFY(dec, zpx) MODIFY(dec, abs) MODIFY(dec, absx)
+
+// Undocumented NMOS instructions
+READ(lax, zp) READ(lax, zpy) READ(lax, abs) READ(lax, absy)
+READ(lax, izx) READ(lax, izy)
+READ(las, absy)
+READ(anc, imm) READ(alr, imm) READ(arr, imm) READ(sbx, imm)
+READ(xaa, imm) READ(lxa, imm)
+WRITE(sax, zp) WRITE(sax, zpy) WRITE(sax, abs) WRITE(sax, izx)
+MODIFY_ALL(slo) MODIFY_ALL(rla) MODIFY_ALL(sre)
+MODIFY_ALL(rra) MODIFY_ALL(dcp) MODIFY_ALL(isc)
+
+// 65C02 instructions
+READ_DECIMAL(adc_cmos, zp) READ_DECIMAL(adc_cmos, zpx)
+READ_DECIMAL(adc_cmos, abs) READ_DECIMAL(adc_cmos, absx)
+READ_DECIMAL(adc_cmos, absy) READ_DECIMAL(adc_cmos, izx)
+READ_DECIMAL(adc_cmos, izy) READ_DECIMAL(adc_cmos, izp)
+READ_DECIMAL(sbc_cmos, zp) READ_DECIMAL(sbc_cmos, zpx)
+READ_DECIMAL(sbc_cmos, abs) READ_DECIMAL(sbc_cmos, absx)
+READ_DECIMAL(sbc_cmos, absy) READ_DECIMAL(sbc_cmos, izx)
+READ_DECIMAL(sbc_cmos, izy) READ_DECIMAL(sbc_cmos, izp)
+READ(and, izp) READ(cmp, izp) READ(eor, izp) READ(lda, izp) READ(ora, izp)
+READ(bit, zpx) READ(bit, absx)
+WRITE(sta, izp)
+WRITE(stz, zp) WRITE(stz, zpx) WRITE(stz, abs) WRITE(stz, absx)
+MODIFY(tsb, zp) MODIFY(tsb, abs) MODIFY(trb, zp) MODIFY(trb, abs)
+ACCUMULATOR(inc) ACCUMULATOR(dec)
+
+// Flag instructions
+#define FLAG(name, flag, value) \
+	static int name(CPU* cpu, Mem* mem) \
+	{ \
+		cpu->flag = value; \
+		return 0; \
+	}
+
+FLAG(clc, C, 0) FLAG(sec, C, 1)
+FLAG(cli, I, 0) FLAG(sei, I, 1)
+FLAG(cld, D, 0) FLAG(sed, D, 1)
+FLAG(clv, V, 0)
+
+// Register instructions
+#define TRANSFER(name, from, to) \
+	static int name(CPU* cpu, Mem* mem) \
+	{ \
+		cpu->to = cpu->from; \
+		set_nz(cpu, cpu->to); \
+		return 0; \
+	}
+
+#define STEP(name, reg, delta) \
+	static int name(CPU* cpu, Mem* mem) \
+	{ \
+		cpu->reg += delta; \
+		set_nz(cpu, cpu->reg); \
+		return 0; \
+	}
+
+TRANSFER(tax, A, X) TRANSFER(tay, A, Y) TRANSFER(tsx, SP, X)
+TRANSFER(txa, X, A) TRANSFER(tya, Y, A)
+STEP(inx, X, 1) STEP(iny, Y, 1) STEP(dex, X, -1) STEP(dey, Y, -1)
+
+static int txs(CPU* cpu, Mem* mem)
+{
+	cpu->SP = cpu->X;
+	return 0;
+}
+
+static int nop_imp(CPU* cpu, Mem* mem)
+	{ return 0; }
+
+// BIT #Immediate only affects Z
+static int bit_imm(CPU* cpu, Mem* mem)
+{
+	cpu->Z = ((cpu->A & read_operand(cpu, mem, mode_imm(cpu, mem))) == 0);
+	return 0;
+}
+
+// Stack instructions
+#define PUSH(name, reg) \
+	static int name(CPU* cpu, Mem* mem) \
+	{ \
+		push(cpu, mem, cpu->reg); \
+		return 0; \
+	}
+
+#define PULL(name, reg) \
+	static int name(CPU* cpu, Mem* mem) \
+	{ \
+		cpu->reg = pull(cpu, mem); \
+		set_nz(cpu, cpu->reg); \
+		return 0; \
+	}
+
+PUSH(pha, A) PUSH(phx, X) PUSH(phy, Y)
+PULL(pla, A) PULL(plx, X) PULL(ply, Y)
+
+// B and the unused bit only exist on the stack
+static int php(CPU* cpu, Mem* mem)
+{
+	push(cpu, mem, CPU_Get_Status(cpu) | STATUS_BREAK);
+	return 0;
+}
+
+static int plp(CPU* cpu, Mem* mem)
+{
+	CPU_Set_Status(cpu, pull(cpu, mem));
+	cpu->B = 0;
+	return 0;
+}
+
+// Branches
+/*
+ * The target is always resolved; a branch that is not taken selects the
+ * current PC instead and costs no extra cycles.
+ */
+static inline int branch(CPU* cpu, const Mem* mem, const int condition)
+{
+	const Address target = mode_rel(cpu, mem);
+	const Word taken = -(Word)(condition != 0);
+
+	cpu->PC ^= (cpu->PC ^ target.address) & taken;
+	return taken & (1 + target.penalty);
+}
+
+#define BRANCH(name, condition) \
+	static int name(CPU* cpu, Mem* mem) \
+		{ return branch(cpu, mem, condition); }
+
+BRANCH(bpl, !cpu->N) BRANCH(bmi, cpu->N)
+BRANCH(bvc, !cpu->V) BRANCH(bvs, cpu->V)
+BRANCH(bcc, !cpu->C) BRANCH(bcs, cpu->C)
+BRANCH(bne, !cpu->Z) BRANCH(beq, cpu->Z)
+BRANCH(bra, 1)
+
+// 65C02 (Rockwell/WDC) bit manipulation
+#define BIT_OPS(n) \
+	static inline Byte rmb##n(CPU* cpu, const Byte input) \
+		{ return input & ~(1 << n); } \
+	static inline Byte smb##n(CPU* cpu, const Byte input) \
+		{ return input | (1 << n); } \
+	MODIFY(rmb##n, zp) MODIFY(smb##n, zp) \
+	static int bbr##n(CPU* cpu, Mem* mem) \
+	{ \
+		const Byte input = read_byte(cpu, mem, mode_zp(cpu, mem).address); \
+		return branch(cpu, mem, !(input & (1 << n))); \
+	} \
+	static int bbs##n(CPU* cpu, Mem* mem) \
+	{ \
+		const Byte input = read_byte(cpu, mem, mode_zp(cpu, mem).address); \
+		return branch(cpu, mem, input & (1 << n)); \
+	}
+
+BIT_OPS(0) BIT_OPS(1) BIT_OPS(2) BIT_OPS(3)
+BIT_OPS(4) BIT_OPS(5) BIT_OPS(6) BIT_OPS(7)
+
+// Jumps and subroutines
+JUMP(jmp_abs, abs)
+JUMP(jmp_ind, ind)
+JUMP(jmp_ind_cmos, ind_cmos)
+JUMP(jmp_absx_ind, iax)
+
+static int jsr(CPU* cpu, Mem* mem)
+{
+	const Word address = mode_abs(cpu, mem).address;
+
+	push_word(cpu, mem, cpu->PC - 1);
+	cpu->PC = address;
+	return 0;
+}
+
+static int rts(CPU* cpu, Mem* mem)
+{
+	cpu->PC = pull_word(cpu, mem) + 1;
+	return 0;
+}
+
+static int rti(CPU* cpu, Mem* mem)
+{
+	(void)plp(cpu, mem);
+	cpu->PC = pull_word(cpu, mem);
+	return 0;
+}
+
+static int brk(CPU* cpu, Mem* mem)
+{
+	push_word(cpu, mem, cpu->PC + 1);
+	push(cpu, mem, CPU_Get_Status(cpu) | STATUS_BREAK);
+	cpu->I = 1;
+	cpu->PC = read_word(cpu, mem, VECTOR_IRQ);
+	return 0;
+}
+
+// The 65C02 also leaves decimal mode when taking an interrupt
+static int brk_cmos(CPU* cpu, Mem* mem)
+{
+	cpu->D = 0;
+	return brk(cpu, mem);
+}
+
+// Unstable NMOS stores
+/*
+ * These store a register ANDed with the high byte of the base address plus
+ * one. When indexing crosses a page the stored value also replaces the high
+ * byte of the effective address.
+ */
+static inline void store_unstable(CPU* cpu,
+                                  Mem* mem,
+                                  const Address operand,
+                                  const Byte index,
+                                  const Byte input)
+{
+	const Word base = operand.address - index;
+	const Byte data = input & ((base >> BYTE_SIZE) + 1);
+	const Word glitched = (operand.address & WORD_TAIL) | (data << BYTE_SIZE);
+
+	write_byte(cpu, mem, operand.penalty ? glitched : operand.address, data);
+}
+
+static int sha_absy(CPU* cpu, Mem* mem)
+{
+	store_unstable(cpu, mem, mode_absy(cpu, mem), cpu->Y, cpu->A & cpu->X);
+	return 0;
+}
+
+static int sha_izy(CPU* cpu, Mem* mem)
+{
+	store_unstable(cpu, mem, mode_izy(cpu, mem), cpu->Y, cpu->A & cpu->X);
+	return 0;
+}
+
+static int shx_absy(CPU* cpu, Mem* mem)
+{
+	store_unstable(cpu, mem, mode_absy(cpu, mem), cpu->Y, cpu->X);
+	return 0;
+}
+
+static int shy_absx(CPU* cpu, Mem* mem)
+{
+	store_unstable(cpu, mem, mode_absx(cpu, mem), cpu->X, cpu->Y);
+	return 0;
+}
+
+static int tas_absy(CPU* cpu, Mem* mem)
+{
+	cpu->SP = cpu->A & cpu->X;
+	store_unstable(cpu, mem, mode_absy(cpu, mem), cpu->Y, cpu->SP);
+	return 0;
+}
+
+// Halting instructions
+/*
+ * JAM locks up the NMOS part until the next reset, STP does the same on the
+ * 65C02. WAI waits for an interrupt, which never arrives in this emulator.
+ */
+static int jam(CPU* cpu, Mem* mem)
+{
+	cpu->PC--;
+	cpu->Halted = HALT_JAM;
+	return 0;
+}
+
+static int stp(CPU* cpu, Mem* mem)
+{
+	cpu->Halted = HALT_STP;
+	return 0;
+}
+
+static int wai(CPU* cpu, Mem* mem)
+{
+	cpu->Halted = HALT_WAI;
+	return 0;
+}
+
+// Illegal opcodes are skipped until the cpu has executed MAX_ERRORS of them
+static int illegal(CPU* cpu, Mem* mem)
+{
+#ifdef MOS_6502_TRACE
+	(void)printf("Illegal instruction '%d'@%d\n",
+		mem->Data[(Word)(cpu->PC - 1)], cpu->PC - 1);
+#endif
+
+	if (++cpu->Errors >= MAX_ERRORS)
+		cpu->Halted = HALT_ILLEGAL;
+
+	return 0;
+}
+
+// Dispatch tables
+/*
+ * One table per variant, indexed by opcode and generated from opcodes.def.
+ * Selecting a variant only swaps the table pointer, so executing an
+ * instruction never has to check the variant.
+ */
+#define COLUMN_NMOS(code, mnemonic, mode, handler, cycles, flags, \
+                    cmos_mnemonic, cmos_mode, cmos_handler, cmos_cycles, \
+                    cmos_flags) \
+	handler, cycles, IDLE_##flags
+#define COLUMN_CMOS(code, nmos_mnemonic, nmos_mode, nmos_handler, nmos_cycles, \
+                    nmos_flags, mnemonic, mode, handler, cycles, flags) \
+	handler, cycles, IDLE_##flags
+#define IDLE_DR 1
+#define IDLE_DM 0
+#define IDLE_UR 1
+#define IDLE_UM 0
+
+// Undocumented opcodes are reported as illegal
+#define COLUMN_NMOS_STRICT(code, mnemonic, mode, handler, cycles, flags, \
+                           cmos_mnemonic, cmos_mode, cmos_handler, cmos_cycles, \
+                           cmos_flags) \
+	STRICT_##flags(handler, cycles)
+#define STRICT_DR(handler, cycles) handler, cycles, 1
+#define STRICT_DM(handler, cycles) handler, cycles, 0
+#define STRICT_UR(handler, cycles) illegal, 2, 0
+#define STRICT_UM(handler, cycles) illegal, 2, 0
+
+// The column is expanded to "handler, cycles, idle" before it is split up
+#define ENTRY(...) ENTRY_(__VA_ARGS__)
+#define ENTRY_(handler, cycles, idle) { handler, cycles, idle },
+
+static const struct Opcode nmos_opcodes[256] =
+{
+#define OPCODE(code, ...) [code] = ENTRY(COLUMN_NMOS(code, __VA_ARGS__))
+#include "opcodes.def"
+#undef OPCODE
+};
+
+static const struct Opcode nmos_strict_opcodes[256] =
+{
+#define OPCODE(code, ...) [code] = ENTRY(COLUMN_NMOS_STRICT(code, __VA_ARGS__))
+#include "opcodes.def"
+#undef OPCODE
+};
+
+// Undefined opcodes are NOPs of varying length on the 65C02
+static const struct Opcode cmos_opcodes[256] =
+{
+#define OPCODE(code, ...) [code] = ENTRY(COLUMN_CMOS(code, __VA_ARGS__))
+#include "opcodes.def"
+#undef OPCODE
+};
+
+// Opcode metadata
+/*
+ * What every opcode looks like in assembly, for the assembler and the
+ * disassembler. The undocumented opcodes of the strict variant are one byte
+ * long, as the illegal handler does not skip their operands.
+ */
+#define INFO_NMOS(code, mnemonic, mode, handler, cycles, flags, ...) \
+	{ #mnemonic, MODE_##mode, SIZE_##mode, cycles, DOCUMENTED_##flags },
+#define INFO_NMOS_STRICT(code, mnemonic, mode, handler, cycles, flags, ...) \
+	INFO_STRICT_##flags(#mnemonic, MODE_##mode, SIZE_##mode, cycles)
+#define INFO_CMOS(code, nmos_mnemonic, nmos_mode, nmos_handler, nmos_cycles, \
+                  nmos_flags, mnemonic, mode, handler, cycles, flags) \
+	{ #mnemonic, MODE_##mode, SIZE_##mode, cycles, DOCUMENTED_##flags },
+#define INFO_STRICT_DR(...) { __VA_ARGS__, 1 },
+#define INFO_STRICT_DM(...) { __VA_ARGS__, 1 },
+#define INFO_STRICT_UR(...) { "???", MODE_IMPLIED, 1, 2, 0 },
+#define INFO_STRICT_UM(...) { "???", MODE_IMPLIED, 1, 2, 0 },
+#define DOCUMENTED_DR 1
+#define DOCUMENTED_DM 1
+#define DOCUMENTED_UR 0
+#define DOCUMENTED_UM 0
+
+#define MODE_imp  MODE_IMPLIED
+#define MODE_acc  MODE_ACCUMULATOR
+#define MODE_imm  MODE_IMMEDIATE
+#define MODE_zp   MODE_ZEROPAGE
+#define MODE_zpx  MODE_ZEROPAGEX
+#define MODE_zpy  MODE_ZEROPAGEY
+#define MODE_abs  MODE_ABSOLUTE
+#define MODE_absx MODE_ABSOLUTEX
+#define MODE_absy MODE_ABSOLUTEY
+#define MODE_ind  MODE_INDIRECT
+#define MODE_izx  MODE_INDIRECTX
+#define MODE_izy  MODE_INDIRECTY
+#define MODE_rel  MODE_RELATIVE
+#define MODE_izp  MODE_INDIRECT_ZEROPAGE
+#define MODE_iax  MODE_INDIRECT_ABSOLUTEX
+#define MODE_zpr  MODE_ZEROPAGE_RELATIVE
+
+#define SIZE_imp  1
+#define SIZE_acc  1
+#define SIZE_imm  2
+#define SIZE_zp   2
+#define SIZE_zpx  2
+#define SIZE_zpy  2
+#define SIZE_abs  3
+#define SIZE_absx 3
+#define SIZE_absy 3
+#define SIZE_ind  3
+#define SIZE_izx  2
+#define SIZE_izy  2
+#define SIZE_rel  2
+#define SIZE_izp  2
+#define SIZE_iax  3
+#define SIZE_zpr  3
+
+static const Opcode_Info nmos_info[256] =
+{
+#define OPCODE(code, ...) [code] = INFO_NMOS(code, __VA_ARGS__)
+#include "opcodes.def"
+#undef OPCODE
+};
+
+static const Opcode_Info nmos_strict_info[256] =
+{
+#define OPCODE(code, ...) [code] = INFO_NMOS_STRICT(code, __VA_ARGS__)
+#include "opcodes.def"
+#undef OPCODE
+};
+
+static const Opcode_Info cmos_info[256] =
+{
+#define OPCODE(code, ...) [code] = INFO_CMOS(code, __VA_ARGS__)
+#include "opcodes.def"
+#undef OPCODE
+};
+
+/**
+ * @brief Describe an opcode as the given variant decodes it.
+ *
+ * @return the description, or NULL if the variant is invalid
+*/
+const Opcode_Info* CPU_Opcode_Info(const CPU_Variant variant, const Byte opcode)
+{
+	switch (variant)
+	{
+		case VARIANT_NMOS: return &nmos_info[opcode];
+		case VARIANT_NMOS_STRICT: return &nmos_strict_info[opcode];
+		case VARIANT_CMOS: return &cmos_info[opcode];
+		default: return NULL;
+	}
+}
+
+// Edge coverage
+/*
+ * Branches hit an edge whether they are taken or not, everything else only
+ * when it leaves PC anywhere but the next instruction: jumps, calls,
+ * returns and interrupts. Targets are hashed, as PCs cluster in a few pages
+ * and their low bits would collide.
+ */
+#define COVERAGE_HASH 40503u	// 2^16 divided by the golden ratio, odd
+
+static const Opcode_Info* info_table(const CPU* cpu)
+{
+	if (cpu->Opcodes == cmos_opcodes)
+		return cmos_info;
+	if (cpu->Opcodes == nmos_strict_opcodes)
+		return nmos_strict_info;
+	return nmos_info;
+}
+
+static void cover(CPU* cpu, const Word pc, const Byte code)
+{
+	const Opcode_Info* info = &info_table(cpu)[code];
+	Coverage* coverage = cpu->Coverage;
+
+	if ((cpu->PC == (Word)(pc + info->Size)
+	     && info->Mode != MODE_RELATIVE
+	     && info->Mode != MODE_ZEROPAGE_RELATIVE)
+		|| cpu->Halted)
+		return;
+
+	const Word location = (Word)(cpu->PC * COVERAGE_HASH);
+	const Word edge = location ^ coverage->Previous;
+
+	if (coverage->Hits[edge] == 0)
+		coverage->Edges[coverage->Count++] = edge;
+	if (coverage->Hits[edge] != 0xFF)
+		coverage->Hits[edge]++;
+	coverage->Previous = location >> 1;
+}
+
+#ifdef MOS_6502_VARIANT
+// Fixed builds
+/*
+ * With the variant known at compile time the table is expanded into a
+ * switch instead, so every handler is called directly and can be inlined
+ * into the interpreter loop. Returns all the cycles the instruction took.
+ */
+#define FIXED_COLUMN(...) \
+	MOS_6502_CONCAT(COLUMN_, MOS_6502_VARIANT)(__VA_ARGS__)
+#define FIXED_CASE(...) FIXED_CASE_(__VA_ARGS__)
+#define FIXED_CASE_(code, handler, cycles, idle) \
+	case code: return cycles + handler(cpu, mem);
+
+static inline int execute_fixed(CPU* cpu, Mem* mem, const Byte opcode)
+{
+	switch (opcode)
+	{
+#define OPCODE(code, ...) FIXED_CASE(code, FIXED_COLUMN(code, __VA_ARGS__))
+#include "opcodes.def"
+#undef OPCODE
+	}
+
+	return 0;
+}
+#endif
+
+/**
+ * @brief Power on a cpu of the given variant, leaving memory untouched.
+ *
+ * The variant decides which dispatch table the cpu uses for its whole
+ * lifetime. Fixed builds only accept MOS_6502_VARIANT.
+ *
+ * @param cpu the cpu to power on
+ * @param variant one of VARIANT_NMOS, VARIANT_NMOS_STRICT, VARIANT_CMOS
+ * @return 0, or -1 leaving the cpu untouched if the variant is invalid
+*/
+const int CPU_Power_On(CPU* cpu, const CPU_Variant variant)
+{
+#ifdef MOS_6502_VARIANT
+	if (variant != MOS_6502_DEFAULT_VARIANT)
+		return -1;
+#endif
+
+	switch (variant)
+	{
+		case VARIANT_NMOS: cpu->Opcodes = nmos_opcodes; break;
+		case VARIANT_NMOS_STRICT: cpu->Opcodes = nmos_strict_opcodes; break;
+		case VARIANT_CMOS: cpu->Opcodes = cmos_opcodes; break;
+		default: return -1;
+	}
+
+	cpu->A = cpu->X = cpu->Y = 0;
+	CPU_Set_Status(cpu, 0);
+	cpu->Halted = HALT_NONE;
+	cpu->Errors = 0;
+	cpu->Trap = TRAP_NONE;
+	cpu->Trap_Address = 0;
+	cpu->Cycles = 0;
+	cpu->Instructions = 0;
+	cpu->Coverage = NULL;
+
+	cpu->PC = 0xFFFC;	// Set Programme Counter
+	cpu->SP = 0x00FF;	// Set Stack Pointer
+	cpu->I  = 1;		// Set Interrupt Disable
+	cpu->D  = 0;		// Clear Decimal Flag
+
+	return 0;
+}
+
+/**
+ * @brief Power on a cpu of the given variant and clear its memory.
+ *
+ * @param cpu the cpu to initialise
+ * @param mem the memory the cpu will run on
+ * @param variant one of VARIANT_NMOS, VARIANT_NMOS_STRICT, VARIANT_CMOS
+ * @return 0, or -1 leaving both untouched if the variant is invalid
+*/
+const int CPU_Initialise(CPU* cpu, Mem* mem, const CPU_Variant variant)
+{
+	if (CPU_Power_On(cpu, variant) != 0)
+		return -1;
+
+	Mem_Initialise(mem);
+	return 0;
+}
+
+void CPU_Reset(CPU* cpu, Mem* mem)
+	{ (void)CPU_Initialise(cpu, mem, MOS_6502_DEFAULT_VARIANT); }
+
+// Idle loops
+/*
+ * Programmes waiting for a timer or a device poll memory in a short loop,
+ * e.g. "wait: LDA $10 / BEQ wait". Only the cpu changes memory while
+ * CPU_Execute runs; devices get their turn between the caller's slices. So
+ * once an iteration made of instructions that only read memory leaves every
+ * register as it found it, all further iterations until the end of the
+ * slice are identical. They are skipped, crediting their cycles and
+ * instructions as if they had run, which leaves the cpu exactly where it
+ * would have been.
+ *
+ * The iteration is run on a copy of the cpu, which is thrown away; it
+ * cannot write memory. Returns the cycles skipped, 0 if the loop starting at
+ * PC is not idle.
+ */
+#define IDLE_MAX_INSTRUCTIONS 8
+#define IDLE_MIN_CYCLES 64		// Not worth checking with fewer left
+#define IDLE_CACHE 8			// Loops recently found not to be idle
+
+static COLD long skip_idle_loop(CPU* cpu,
+                                Mem* mem,
+                                const long cycles_remaining,
+                                u64* instructions)
+{
+	CPU probe = *cpu;
+	long cycles = 0;
+
+	// A watchpoint was hit, or a halt left PC on the halting instruction
+	if (cpu->Trap != TRAP_NONE || cpu->Halted)
+		return 0;
+
+	for (int count = 1; count <= IDLE_MAX_INSTRUCTIONS; count++)
+	{
+		const struct Opcode* opcode = &cpu->Opcodes[mem->Data[probe.PC]];
+
+		if (!opcode->idle
+			|| (PAGE_TRAPS(mem, probe.PC >> BYTE_SIZE) & TRAP_EXECUTE))
+			return 0;
+
+		probe.PC++;
+		cycles += opcode->cycles + opcode->handler(&probe, mem);
+
+		if (probe.Trap != TRAP_NONE)
+			return 0;
+		if (probe.PC != cpu->PC)
+			continue;
+
+		if (probe.A != cpu->A || probe.X != cpu->X || probe.Y != cpu->Y
+			|| probe.SP != cpu->SP
+			|| CPU_Get_Status(&probe) != CPU_Get_Status(cpu))
+			return 0;
+
+		const long iterations = cycles_remaining / cycles;
+
+		*instructions += iterations * count;
+		return iterations * cycles;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief This function will emulate a MOS 6502 on virtual/simulated memory.
+ * 
+ * The individual instructions are fetched from memory and dispatched through
+ * the opcode table of the cpu's variant. An instruction that is started is
+ * always completed, so the cpu may run for a few cycles more than requested.
+ * Execution also stops once the cpu has halted or hit a trap. Nothing in here
+ * terminates the process: faults such as illegal opcodes on the strict
+ * variant halt the cpu and are reported through the return value.
+ * cpu->Trap and cpu->Trap_Address tell which trap was hit: a breakpoint stops
+ * before its instruction and a watchpoint after the accessing instruction.
+ * The instruction at the starting PC is always executed, so calling this
+ * again resumes past the breakpoint that stopped it. The cycles actually used
+ * are added to cpu->Cycles and the instructions to cpu->Instructions.
+ * Idle loops are fast-forwarded to the end of the cycles given, see
+ * skip_idle_loop.
+ * With cpu->Coverage set, the edges of branches and jumps are recorded in
+ * it; the iterations of a skipped idle loop are not.
+ * Overflows are wrapped.
+ * 
+ * @param cpu the cpu you want to emulate
+ * @param mem the memory on which the cpu will run
+ * @param cycles the number of cycles for which you allow the cpu to run
+ * @return why the cpu halted, HALT_NONE if it can continue
+*/
+const Halt_Reason CPU_Execute(CPU* cpu, Mem* mem, const u32 cycles)
+{
+	long cycles_remaining = cycles;
+	u64 instructions = 0;
+	Word rejected[IDLE_CACHE];	// Indexed by the low bits of the loop's PC
+
+	cpu->Trap = TRAP_NONE;
+	(void)memset(rejected, 0xFF, sizeof(rejected));
+
+	while (cycles_remaining > 0 && !(cpu->Halted | cpu->Trap))
+	{
+#ifdef MOS_6502_TRACE
+		(void)printf("Reading %d. Cycles remaining: %ld\n",
+			cpu->PC, cycles_remaining);
+#endif
+
+		const Word pc = cpu->PC;
+		const Byte code = fetch_byte(cpu, mem);
+
+#ifdef MOS_6502_VARIANT
+		cycles_remaining -= execute_fixed(cpu, mem, code);
+#else
+		const struct Opcode* opcode = &cpu->Opcodes[code];
+		cycles_remaining -= opcode->cycles + opcode->handler(cpu, mem);
+#endif
+		instructions++;
+
+		if (UNLIKELY(cpu->Coverage != NULL))
+			cover(cpu, pc, code);
+
+		if (UNLIKELY(PAGE_TRAPS(mem, cpu->PC >> BYTE_SIZE) & TRAP_EXECUTE)
+			&& !cpu->Halted)
+			trap_access(cpu, mem, cpu->PC, TRAP_EXECUTE);
+
+		// Loops close with a jump or branch backwards
+		if (UNLIKELY(cpu->PC <= pc)
+			&& rejected[cpu->PC % IDLE_CACHE] != cpu->PC
+			&& cycles_remaining >= IDLE_MIN_CYCLES)
+		{
+			const long skipped =
+				skip_idle_loop(cpu, mem, cycles_remaining, &instructions);
+
+			if (skipped == 0)
+				rejected[cpu->PC % IDLE_CACHE] = cpu->PC;
+			cycles_remaining -= skipped;
+		}
+	}
+
+	cpu->Cycles += (long)cycles - cycles_remaining;
+	cpu->Instructions += instructions;
+
+	return cpu->Halted;
+}
@@ -1,331 +1,545 @@
-#ifndef CPU_h
-#define CPU_h
-
-#include <stdlib.h>
-#include <stdio.h>
-#include <string.h>
-
-typedef enum Endianness
-{
-	BIG,
-	LITTLE,
-	AUTO
-} Endianness;
-
-
-typedef unsigned char  Byte;	// 8 Bits
-typedef unsigned short Word;	// 16 Bits
-typedef unsigned int   u32;		// 32 Bits
-
-
-// Memory
-#define MAX_MEM 1024 * 64
-
-typedef struct Memory
-{
-	Byte Data[MAX_MEM];
-} Mem;
-
-
-// CPU
-#define MAX_ERRORS 10
-
-typedef struct CPU
-{
-
-	Word PC;	// Programme Counter
-	Byte SP;	// Stack Pointer
-	
-	// Registers
-	Byte A;		// Accumulator
-	Byte X;		// Index Register X
-	Byte Y;		// Index Register Y
-	
-	// Processor status
-	Byte C : 1;	// Carry Flag
-	Byte Z : 1;	// Zero Flag
-	Byte I : 1;	// Interrupt Disable
-	Byte D : 1;	// Decimal Mode
-	Byte B : 1;	// Break Command
-	Byte V : 1;	// Overflow Flag
-	Byte N : 1;	// Negative Flag
-} CPU;
-
-
-/**
- * @brief If arg is "AUTO" this will automatically determine the endianness of
- * the current system. Else arg is used to specify "BIG" or "LITTLE".
- */ 
-void MOS_6502_set_endianness(int arg);
-
-
-// Memory functions
-void Mem_Initialise(Mem* mem);
-const Byte Mem_Read_Byte(const CPU* cpu, 
-                   const Mem* mem,
-				   u32* cycles,
-				   const Byte address);
-const Byte Mem_Read_Word(const CPU* cpu,
-                   const Mem* mem,
-				   u32* cycles,
-				   const Byte address);
-const Byte Mem_Fetch_Byte(CPU* cpu, const Mem* mem, u32* cycles);
-const Word Mem_Fetch_Word(CPU* cpu, const Mem* mem, u32* cycles);
-
-void Mem_Write_word(Mem* mem,
-                    u32* cycles,
-                    const Word word,
-                    const Word address);
-
-const Byte Get_Memory(const Mem* mem, const Word index);
-const int Set_Memory(Mem* mem, const Word index, const Byte data);
-
-
-// CPU functions
-void CPU_Reset(CPU* cpu, Mem* mem);
-void CPU_Execute(CPU* cpu, Mem* mem, const u32 cycles);
-const Byte CPU_Fetch_Register(const CPU* cpu,
-                              const Byte register,
-							  u32* cycles);
-
-// Opcodes
-// Add Memory to Accumulator with Carry
-#define INSTRUCTION_ADC_IMMEDIATE   0x69	// Immediate
-#define INSTRUCTION_ADC_ABSOLUTE    0x6D	// Absolute
-#define INSTRUCTION_ADC_ABSOLUTEX   0x7D	// Absolute,X
-#define INSTRUCTION_ADC_ABSOLUTEY   0x79	// Absolute,Y
-#define INSTRUCTION_ADC_ZEROPAGE    0x65	// Zero Page
-#define INSTRUCTION_ADC_ZEROPAGEX   0x75	// Zero Page,X
-#define INSTRUCTION_ADC_INDIRECTX   0x61	// (Zero Page,X)
-#define INSTRUCTION_ADC_INDIRECTY   0x71	// (Zero Page),Y
-
-// "AND" Memory with Accumulator
-#define INSTRUCTION_AND_IMMEDIATE   0x29	// Immediate
-#define INSTRUCTION_AND_ABSOLUTE    0x2D	// Absolute
-#define INSTRUCTION_AND_ABSOLUTEX   0x3D	// Absolute,X
-#define INSTRUCTION_AND_ABSOLUTEY   0x39	// Absolute,Y
-#define INSTRUCTION_AND_ZEROPAGE    0x25	// Zero Page
-#define INSTRUCTION_AND_ZEROPAGEX   0x35	// Zero Page,X
-#define INSTRUCTION_AND_INDIRECTX   0x21	// (Zero Page,X)
-#define INSTRUCTION_AND_INDIRECTY   0x31	// (Zero Page),Y
-
-// Arithmetic Shift Left
-#define INSTRUCTION_ASL_ACCUMULATOR 0x0A	// A
-#define INSTRUCTION_ASL_ABSOLUTE    0x0E	// Absolute
-#define INSTRUCTION_ASL_ABSOLUTEX   0x1E	// Absolute,X
-#define INSTRUCTION_ASL_ZEROPAGE    0x06	// Zero Page
-#define INSTRUCTION_ASL_ZEROPAGEX   0x16	// Zero Page,X
-
-// Branch on Carry Clear
-#define INSTRUCTION_BCC_RELATIVE    0x90	// Relative
-
-// Branch on Carry Set
-#define INSTRUCTION_BCS_RELATIVE    0xB0	// Relative
-
-// Branch on Result Zero
-#define INSTRUCTION_BEQ_RELATIVE    0xF0	// Relative
-
-// Test Bits in Memory with Accumulator
-#define INSTRUCTION_BIT_ABSOLUTE    0x2C	// Absolute
-#define INSTRUCTION_BIT_ZEROPAGE    0x24	// Zero Page
-
-// Branch on Result Minus
-#define INSTRUCTION_BMI_RELATIVE    0x30	// Relative
-
-// Branch on Result Not Zero
-#define INSTRUCTION_BNE_RELATIVE    0xD0	// Relative
-
-// Branch on Result Plus
-#define INSTRUCTION_BPL_RELATIVE    0x10	// Relative
-
-// Break Command
-#define INSTRUCTION_BRK_IMPLIED     0x00	// Implied
-
-// Branch on Overflow Clear
-#define INSTRUCTION_BVC_RELATIVE    0x50	// Relative
-
-// Branch on Overflow Set
-#define INSTRUCTION_BVS_RELATIVE    0x70	// Relative
-
-// Clear Carry Flag
-#define INSTRUCTION_CLC_IMPLIED     0x18	// Implied
-
-// Clear Decimal Mode
-#define INSTRUCTION_CLD_IMPLIED     0xD8	// Implied
-
-// Clear Interrupt Disable
-#define INSTRUCTION_CLI_IMPLIED     0x58	// Implied
-
-// Clear Overflow Flag
-#define INSTRUCTION_CLV_IMPLIED     0xB8	// Implied
-
-// Compare Memory and Accumulator
-#define INSTRUCTION_CMP_IMMEDIATE   0xC9	// Immediate
-#define INSTRUCTION_CMP_ABSOLUTE    0xCD	// Absolute
-#define INSTRUCTION_CMP_ABSOLUTEX   0xDD	// Absolute,X
-#define INSTRUCTION_CMP_ABSOLUTEY   0xD9	// Absolute,Y
-#define INSTRUCTION_CMP_ZEROPAGE    0xC5	// Zero Page
-#define INSTRUCTION_CMP_ZEROPAGEX   0xD5	// Zero Page,X
-#define INSTRUCTION_CMP_INDIRECTX   0xC1	// (Zero Page,X)
-#define INSTRUCTION_CMP_INDIRECTY   0xD1	// (Zero Page),Y
-
-// Compare X Register
-#define INSTRUCTION_CPX_IMMEDIATE   0xE0    // Immediate
-#define INSTRUCTION_CPX_ZEROPAGE    0xE4    // Zero Page
-#define INSTRUCTION_CPX_ABSOLUTE    0xEC    // Absolute
-
-// Compare Y Register
-#define INSTRUCTION_CPY_IMMEDIATE   0xC0    // Immediate
-#define INSTRUCTION_CPY_ZEROPAGE    0xC4    // Zero Page
-#define INSTRUCTION_CPY_ABSOLUTE    0xCC    // Absolute
-
-// Decrement Memory
-#define INSTRUCTION_DEC_ZEROPAGE    0xC6    // Zero Page
-#define INSTRUCTION_DEC_ZEROPAGEX   0xD6    // Zero Page,X
-#define INSTRUCTION_DEC_ABSOLUTE    0xCE    // Absolute
-#define INSTRUCTION_DEC_ABSOLUTEX   0xDE    // Absolute,X
-
-// Bitwise Exclusive Or
-#define INSTRUCTION_EOR_IMMEDIATE   0x49    // Immediate
-#define INSTRUCTION_EOR_ZEROPAGE    0x45    // Zero Page
-#define INSTRUCTION_EOR_ZEROPAGEX   0x55    // Zero Page X
-#define INSTRUCTION_EOR_ABSOLUTE    0x4D    // Absolute
-#define INSTRUCTION_EOR_ABSOLUTEX   0x5D    // Absolute X
-#define INSTRUCTION_EOR_ABSOLUTEY   0x59    // Absolute Y
-#define INSTRUCTION_EOR_INDIRECTX   0x41    // Indirect X
-#define INSTRUCTION_EOR_INDIRECTY   0x51    // Indirect Y
-
-// Flag Instructions
-#define INSTRUCTION_CLC             0x18    // Clear Carry
-#define INSTRUCTION_SEC             0x38    // Set Carry
-#define INSTRUCTION_CLI             0x58    // Clear Input
-#define INSTRUCTION_SEI             0x78    // Set Interrupt
-#define INSTRUCTION_CLV             0xB8    // Cleaer Overflow
-#define INSTRUCTION_CLD             0xD8    // Clear Decimal
-#define INSTRUCTION_SED             0xF8    // Set Decimal
-
-// Increment Memory
-#define INSTRUCTION_INC_ZEROPAGE    0xE6    // Zero Page
-#define INSTRUCTION_INC_ZEROPAGEX   0xF6    // Zero Page,X
-#define INSTRUCTION_INC_ABSOLUTE    0xEE    // Absolute
-#define INSTRUCTION_INCABSOLUTEX    0xFE    // Absolute,X
-
-// Jump
-#define INSTRUCTION_JMP_ABSOLUTE    0x4C	// Absolute
-#define INSTRUCTION_JMP_INDIRECT    0x6C	// Indirect
-
-// Jump To Subroutine
-#define INSTRUCTION_JSR_ABSOLUTE    0x20	// Absolute
-
-// Load Accumulator
-#define INSTRUCTION_LDA_IMMEDIATE   0xA9	// Immediate
-#define INSTRUCTION_LDA_ZEROPAGE    0xA5	// Zero Page
-#define INSTRUCTION_LDA_ZEROPAGEX   0xB5	// Zero Page,X
-#define INSTRUCTION_LDA_ABSOLUTE    0xAD	// Absolute
-#define INSTRUCTION_LDA_ABSOLUTEX   0xBD	// Absolute,X
-#define INSTRUCTION_LDA_ABSOLUTEY   0xB9	// Absolute,Y
-#define INSTRUCTION_LDA_INDIRECTX   0xA1	// Indirect,X
-#define INSTRUCTION_LDA_INDIRECTY   0xB1	// Indirect,Y
-
-// Load X Register
-#define INSTRUCTION_LDX_IMMEDIATE   0xA2    // Immediate
-#define INSTRUCTION_LDX_ZEROPAGE    0xA6    // Zero Page
-#define INSTRUCTION_LDX_ZEROPAGEY   0xB6    // Zero Page,Y
-#define INSTRUCTION_LDX_ABSOLUTE    0xAE    // Absolute
-#define INSTRUCTION_LDX_ABSOLUTEY   0xBE    // Absolute,Y
-
-// Load Y Register
-#define INSTRUCTION_LDY_IMMEDIATE   0xA0    // Immediate
-#define INSTRUCTION_LDY_ZEROPAGE    0xA4    // Zero Page
-#define INSTRUCTION_LDY_ZEROPAGEX   0xB4    // Zero Page,Y
-#define INSTRUCTION_LDY_ABSOLUTE    0xAC    // Absolute
-#define INSTRUCTION_LDY_ABSOLUTEX   0xBC    // Absolute,Y
-
-// Logical Shift Right
-#define INSTRUCTION_LSR_ACCUMULATOR 0x4A    // Accumulator
-#define INSTRUCTION_LSR_ZEROPAGE    0x46    // Zero Page
-#define INSTRUCTION_LSR_ZEROPAGEX   0x56    // Zero Page,X
-#define INSTRUCTION_LSR_ABSOLUTE    0x4E    // Absolute
-#define INSTRUCTION_LSR_ABSOLUTEX   0x5E    // Absolute,X
-
-// No Operation
-#define INSTRUCTION_NOP_IMPLIED     0xEA    // Implied
-
-// Bitwise Or with Accumulator
-#define INSTRUCTION_ORA_IMMEDIATE   0x09    // Immedeate
-#define INSTRUCTION_ORA_ZEROPAGE    0x05    // Zero Page
-#define INSTRUCTION_ORA_ZEROPAGEX   0x15    // Zero Page,X
-#define INSTRUCTION_ORA_ABSOLUTE    0x0D    // Absolute
-#define INSTRUCTION_ORA_ABSOLUTEX   0x1D    // Absolute,X
-#define INSTRUCTION_ORA_ABSOLUTEY   0x19    // Absolute,Y
-#define INSTRUCTION_ORA_INDIRECTX   0x01    // Indirect,X
-#define INSTRUCTION_ORA_INDIRECTY   0x11    // Indirect,Y
-
-// Register Instructions
-#define INSTRUCTION_TAX             0xAA    // Transfer A to X
-#define INSTRUCTION_TXA             0x8A    // Transfer X to A
-#define INSTRUCTION_DEX             0xCA    // Decrement X
-#define INSTRUCTION_INX             0xE8    // Increment X
-#define INSTRUCTION_TAY             0xA8    // Transfer A to Y
-#define INSTRUCTION_TYA             0x98    // Transfer Y to A
-#define INSTRUCTION_DEY             0x88    // Decrement Y
-#define INSTRUCTION_INY             0xC8    // Increment Y
-
-// Rotate Left
-#define INSTRUCTION_ROL_ACCUMULATOR 0x2A    // Accumulator
-#define INSTRUCTION_ROL_ZEROPAGE    0x36    // Zero Page
-#define INSTRUCTION_ROL_ZEROPAGEX   0x36    // Zero Page,X
-#define INSTRUCTION_ROL_ABSOLUTE    0x2E    // Absolute
-#define INSTRUCTION_ROL_ABSOLUTEX   0x3E    // Absolute,X
-
-// Rotate Right
-#define INSTRUCTION_ROR_ACCUMULATOR 0x6A    // Accumulator
-#define INSTRUCTION_ROR_ZEROPAGE    0x66    // Zero Page
-#define INSTRUCTION_ROR_ZEROPAGEX   0x76    // Zero Page,X
-#define INSTRUCTION_ROR_ABSOLUTE    0x6E    // Absolute
-#define INSTRUCTION_ROR_ABSOLUTEX   0x7E    // Absolute,X
-
-// Return from Interrupt
-#define INSTRUCTION_RTI_IMPLIED     0x40    // Implied
-
-// Return from Subroutine
-#define INSTRUCTION_RTS_IMPLIED     0x60    // Implied
-
-// Subtract with Carry
-#define INSTRUCTION_SBC_IMMEDIATE   0xE9    // Immediate
-#define INSTRUCTION_SBC_ZEROPAGE    0xE5    // Zero Page
-#define INSTRUCTION_SBC_ZEROPAGEX   0xF5    // Zero Page,X
-#define INSTRUCTION_SBC_ABSOLUTE    0xED    // Absolute
-#define INSTRUCTION_SBC_ABSOLUTEX   0xFD    // Absolute,X
-#define INSTRUCTION_SBC_ABSOLUTEY   0xF9    // Absolute,Y
-#define INSTRUCTION_SBC_INDIRECTX   0xE1    // Indirect,X
-#define INSTRUCTION_SBC_INDIRECTY   0xF1    // Indirect,Y
-
-// Store Accumulator
-#define INSTRUCTION_STA_ZEROPAGE    0x85    // Zero Page
-#define INSTRUCTION_STA_ZEROPAGEX   0x95    // Zero Page,X
-#define INSTRUCTION_STA_ABOSLUTE    0x8D    // Absolute
-#define INSTRUCTION_STA_ABSOLUTEX   0x9D    // Absolute,X
-#define INSTRUCTION_STA_ABSOLUTEY   0x99    // Absolute,Y
-#define INSTRUCTION_STA_INDIRECTX   0x81    // Indirect,X
-#define INSTRUCTION_STA_INDIRECTY   0x91    // Indirect,Y
-
-// Stack Instructions
-#define INSTRUCTION_TXS             0x9A    // Transfer X to Stack ptr
-#define INSTRUCTION_TSX             0xBA    // Transfer Stack ptr to X
-#define INSTRUCTION_PHA             0x48    // Push Accumulator
-#define INSTRUCTION_PLA             0x68    // Pull Accumulator
-#define INSTRUCTION_PHP             0x08    // Push Processor Status
-#define INSTRUCTION_PLP             0x28    // Pull Processor Status
-
-// Store X Register
-#define INSTRUCTION_STX_ZEROPAGE    0x86    // Zero Page
-#define INSTRUCTION_STX_ZEROPAGEY   0x96    // Zero Page,Y
-#define INSTRUCTION_STX_ABSOLUTE    0x8E    // Absolute
-
-// Store Y Register
-#define INSTRUCTION_STY_ZEROPAGE    0x84    // Zero Page
-#define INSTRUCTION_STY_ZEROPAGEX   0x94    // Zero Page,X
-#define INSTRUCTION_STY_ABSOLUTE    0x8C    // Absolute
-
-#endif // !CPU_h
+#ifndef CPU_h
+#define CPU_h
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef enum Endianness
+{
+	BIG,
+	LITTLE,
+	AUTO
+} Endianness;
+
+// Host byte order, the 6502 itself is always little endian
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__)
+#define MOS_6502_HOST_BIG_ENDIAN (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#elif defined(__BIG_ENDIAN__) || defined(_BIG_ENDIAN)
+#define MOS_6502_HOST_BIG_ENDIAN 1
+#else
+#define MOS_6502_HOST_BIG_ENDIAN 0
+#endif
+
+typedef enum CPU_Variant
+{
+	VARIANT_NMOS,			// NMOS 6502 including undocumented opcodes
+	VARIANT_NMOS_STRICT,	// NMOS 6502, undocumented opcodes are illegal
+	VARIANT_CMOS			// WDC 65C02
+} CPU_Variant;
+
+/*
+ * Fixed builds (see the Makefile) compile the interpreter for a single
+ * configuration, folding the checks for everything else out:
+ * MOS_6502_VARIANT=NMOS|NMOS_STRICT|CMOS  the only variant that can be used
+ * MOS_6502_NO_DECIMAL  the D flag is kept but ignored, as on the Ricoh 2A03
+ * MOS_6502_FLAT        flat memory without traps, Mem_Set_Trap fails
+ */
+#ifdef MOS_6502_VARIANT
+#define MOS_6502_CONCAT_(a, b) a##b
+#define MOS_6502_CONCAT(a, b) MOS_6502_CONCAT_(a, b)
+#define MOS_6502_DEFAULT_VARIANT MOS_6502_CONCAT(VARIANT_, MOS_6502_VARIANT)
+#else
+#define MOS_6502_DEFAULT_VARIANT VARIANT_NMOS
+#endif
+
+
+// Why a cpu stopped for good; CPU_Execute returns it and cpu->Halted holds it
+typedef enum Halt_Reason
+{
+	HALT_NONE,		// Running; the cycles were used up or a trap was hit
+	HALT_JAM,		// NMOS JAM
+	HALT_STP,		// 65C02 STP
+	HALT_WAI,		// 65C02 WAI, no interrupt will ever arrive
+	HALT_ILLEGAL	// MAX_ERRORS illegal opcodes on the strict variant
+} Halt_Reason;
+
+
+typedef unsigned char  Byte;	// 8 Bits
+typedef unsigned short Word;	// 16 Bits
+typedef unsigned int   u32;		// 32 Bits
+typedef unsigned long long u64;	// 64 Bits
+
+
+// Memory
+#define MAX_MEM 1024 * 64
+#define PAGE_SIZE 0x100
+#define PAGE_COUNT (MAX_MEM / PAGE_SIZE)
+
+// Breakpoints and watchpoints, may be combined
+#define TRAP_NONE    0x00
+#define TRAP_EXECUTE 0x01	// Stop before executing the instruction at the address
+#define TRAP_READ    0x02	// Stop after an instruction has read the address
+#define TRAP_WRITE   0x04	// Stop after an instruction has written the address
+#define TRAP_ALL     (TRAP_EXECUTE | TRAP_READ | TRAP_WRITE)
+#define TRAP_INDEX(kind) ((kind) >> 1)
+
+typedef struct Memory
+{
+	Byte Data[MAX_MEM];
+	Byte Traps[PAGE_COUNT];				// Kinds of trap set anywhere in a page
+	Byte Trap_Map[3][MAX_MEM / 8];		// One bit per address and kind
+} Mem;
+
+
+// Edge coverage
+#define COVERAGE_SIZE 0x10000
+
+/*
+ * AFL style edge coverage of the branches and jumps CPU_Execute runs. Each
+ * one hits the edge from the target of the previous one to its own, hashed
+ * into Hits. The edges hit are listed in Edges, so they can be read and
+ * cleared without scanning the whole map.
+ */
+typedef struct Coverage
+{
+	Byte Hits[COVERAGE_SIZE];	// Per edge, saturating at 255
+	Word Edges[COVERAGE_SIZE];	// Edges hit, in the order of their first hit
+	u32 Count;					// Entries in Edges
+	Word Previous;				// Hashed target of the last edge, shifted
+} Coverage;
+
+
+// CPU
+#define MAX_ERRORS 10
+
+typedef struct CPU
+{
+
+	Word PC;	// Programme Counter
+	Byte SP;	// Stack Pointer
+	
+	// Registers
+	Byte A;		// Accumulator
+	Byte X;		// Index Register X
+	Byte Y;		// Index Register Y
+	
+	// Processor status
+	Byte C : 1;	// Carry Flag
+	Byte Z : 1;	// Zero Flag
+	Byte I : 1;	// Interrupt Disable
+	Byte D : 1;	// Decimal Mode
+	Byte B : 1;	// Break Command
+	Byte V : 1;	// Overflow Flag
+	Byte N : 1;	// Negative Flag
+
+	// Emulator state
+	const struct Opcode* Opcodes;	// Dispatch table of the selected variant
+	Byte Halted;					// Halt_Reason, HALT_NONE while running
+	Byte Errors;					// Illegal opcodes executed
+	Byte Trap;						// Kind of trap that stopped execution
+	Word Trap_Address;				// Address of that trap
+	u64 Cycles;						// Cycles executed since initialisation
+	u64 Instructions;				// Instructions executed since initialisation
+	Coverage* Coverage;				// Edges hit by CPU_Execute, NULL for none
+} CPU;
+
+
+// Opcode metadata
+typedef enum
+{
+	MODE_IMPLIED,			// CLC
+	MODE_ACCUMULATOR,		// ASL A
+	MODE_IMMEDIATE,			// LDA #$10
+	MODE_ZEROPAGE,			// LDA $10
+	MODE_ZEROPAGEX,			// LDA $10,X
+	MODE_ZEROPAGEY,			// LDX $10,Y
+	MODE_ABSOLUTE,			// LDA $1000
+	MODE_ABSOLUTEX,			// LDA $1000,X
+	MODE_ABSOLUTEY,			// LDA $1000,Y
+	MODE_INDIRECT,			// JMP ($1000)
+	MODE_INDIRECTX,			// LDA ($10,X)
+	MODE_INDIRECTY,			// LDA ($10),Y
+	MODE_RELATIVE,			// BNE label
+	MODE_INDIRECT_ZEROPAGE,	// LDA ($10), 65C02
+	MODE_INDIRECT_ABSOLUTEX,	// JMP ($1000,X), 65C02
+	MODE_ZEROPAGE_RELATIVE,	// BBR0 $10,label, 65C02
+	MODE_COUNT,
+} AddressingMode;
+
+// How an opcode is written in assembly, generated from opcodes.def
+typedef struct Opcode_Info
+{
+	const char* Mnemonic;	// "???" for illegal opcodes
+	AddressingMode Mode;
+	Byte Size;				// Bytes including the opcode
+	Byte Cycles;			// Base cycle count
+	Byte Documented;
+} Opcode_Info;
+
+
+/**
+ * @brief Deprecated, the host's endianness is determined at compile time.
+ * Kept so existing callers still build; arg must be "BIG", "LITTLE" or "AUTO".
+ * Returns -1 for any other value.
+ */ 
+const int MOS_6502_set_endianness(int arg);
+
+
+// Memory functions
+void Mem_Initialise(Mem* mem);
+const Byte Mem_Read_Byte(const CPU* cpu, 
+                   const Mem* mem,
+				   u32* cycles,
+				   const Word address);
+const Word Mem_Read_Word(const CPU* cpu,
+                   const Mem* mem,
+				   u32* cycles,
+				   const Word address);
+const Byte Mem_Fetch_Byte(CPU* cpu, const Mem* mem, u32* cycles);
+const Word Mem_Fetch_Word(CPU* cpu, const Mem* mem, u32* cycles);
+
+void Mem_Write_word(Mem* mem,
+                    u32* cycles,
+                    const Word word,
+                    const Word address);
+
+const Byte Get_Memory(const Mem* mem, const Word index);
+const int Set_Memory(Mem* mem, const Word index, const Byte data);
+
+/**
+ * @brief Install or remove breakpoints and watchpoints.
+ *
+ * Only call these between CPU_Execute slices. Get_Memory, Set_Memory, opcode
+ * and operand fetches, immediate data included, and stack pushes and pulls
+ * never trigger a watchpoint. Both return -1 if kinds is not made of TRAP_*
+ * bits. Mem_Set_Trap always fails in MOS_6502_FLAT builds.
+ *
+ * @param mem the memory holding the traps
+ * @param address the address to trap on
+ * @param kinds any combination of TRAP_EXECUTE, TRAP_READ and TRAP_WRITE
+*/
+const int Mem_Set_Trap(Mem* mem, const Word address, const Byte kinds);
+const int Mem_Clear_Trap(Mem* mem, const Word address, const Byte kinds);
+void Mem_Clear_Traps(Mem* mem);
+
+/**
+ * @brief Forget the edges hit, in time proportional to their number.
+*/
+void Coverage_Clear(Coverage* coverage);
+
+
+// CPU functions
+const int CPU_Power_On(CPU* cpu, const CPU_Variant variant);
+const int CPU_Initialise(CPU* cpu, Mem* mem, const CPU_Variant variant);
+void CPU_Reset(CPU* cpu, Mem* mem);
+const Halt_Reason CPU_Execute(CPU* cpu, Mem* mem, const u32 cycles);
+const Byte CPU_Fetch_Register(const CPU* cpu,
+                              const Byte register,
+							  u32* cycles);
+const Byte CPU_Get_Status(const CPU* cpu);
+void CPU_Set_Status(CPU* cpu, const Byte status);
+const Opcode_Info* CPU_Opcode_Info(const CPU_Variant variant,
+                                    const Byte opcode);
+
+// Opcodes
+// Add Memory to Accumulator with Carry
+#define INSTRUCTION_ADC_IMMEDIATE   0x69	// Immediate
+#define INSTRUCTION_ADC_ABSOLUTE    0x6D	// Absolute
+#define INSTRUCTION_ADC_ABSOLUTEX   0x7D	// Absolute,X
+#define INSTRUCTION_ADC_ABSOLUTEY   0x79	// Absolute,Y
+#define INSTRUCTION_ADC_ZEROPAGE    0x65	// Zero Page
+#define INSTRUCTION_ADC_ZEROPAGEX   0x75	// Zero Page,X
+#define INSTRUCTION_ADC_INDIRECTX   0x61	// (Zero Page,X)
+#define INSTRUCTION_ADC_INDIRECTY   0x71	// (Zero Page),Y
+
+// "AND" Memory with Accumulator
+#define INSTRUCTION_AND_IMMEDIATE   0x29	// Immediate
+#define INSTRUCTION_AND_ABSOLUTE    0x2D	// Absolute
+#define INSTRUCTION_AND_ABSOLUTEX   0x3D	// Absolute,X
+#define INSTRUCTION_AND_ABSOLUTEY   0x39	// Absolute,Y
+#define INSTRUCTION_AND_ZEROPAGE    0x25	// Zero Page
+#define INSTRUCTION_AND_ZEROPAGEX   0x35	// Zero Page,X
+#define INSTRUCTION_AND_INDIRECTX   0x21	// (Zero Page,X)
+#define INSTRUCTION_AND_INDIRECTY   0x31	// (Zero Page),Y
+
+// Arithmetic Shift Left
+#define INSTRUCTION_ASL_ACCUMULATOR 0x0A	// A
+#define INSTRUCTION_ASL_ABSOLUTE    0x0E	// Absolute
+#define INSTRUCTION_ASL_ABSOLUTEX   0x1E	// Absolute,X
+#define INSTRUCTION_ASL_ZEROPAGE    0x06	// Zero Page
+#define INSTRUCTION_ASL_ZEROPAGEX   0x16	// Zero Page,X
+
+// Branch on Carry Clear
+#define INSTRUCTION_BCC_RELATIVE    0x90	// Relative
+
+// Branch on Carry Set
+#define INSTRUCTION_BCS_RELATIVE    0xB0	// Relative
+
+// Branch on Result Zero
+#define INSTRUCTION_BEQ_RELATIVE    0xF0	// Relative
+
+// Test Bits in Memory with Accumulator
+#define INSTRUCTION_BIT_ABSOLUTE    0x2C	// Absolute
+#define INSTRUCTION_BIT_ZEROPAGE    0x24	// Zero Page
+
+// Branch on Result Minus
+#define INSTRUCTION_BMI_RELATIVE    0x30	// Relative
+
+// Branch on Result Not Zero
+#define INSTRUCTION_BNE_RELATIVE    0xD0	// Relative
+
+// Branch on Result Plus
+#define INSTRUCTION_BPL_RELATIVE    0x10	// Relative
+
+// Break Command
+#define INSTRUCTION_BRK_IMPLIED     0x00	// Implied
+
+// Branch on Overflow Clear
+#define INSTRUCTION_BVC_RELATIVE    0x50	// Relative
+
+// Branch on Overflow Set
+#define INSTRUCTION_BVS_RELATIVE    0x70	// Relative
+
+// Clear Carry Flag
+#define INSTRUCTION_CLC_IMPLIED     0x18	// Implied
+
+// Clear Decimal Mode
+#define INSTRUCTION_CLD_IMPLIED     0xD8	// Implied
+
+// Clear Interrupt Disable
+#define INSTRUCTION_CLI_IMPLIED     0x58	// Implied
+
+// Clear Overflow Flag
+#define INSTRUCTION_CLV_IMPLIED     0xB8	// Implied
+
+// Compare Memory and Accumulator
+#define INSTRUCTION_CMP_IMMEDIATE   0xC9	// Immediate
+#define INSTRUCTION_CMP_ABSOLUTE    0xCD	// Absolute
+#define INSTRUCTION_CMP_ABSOLUTEX   0xDD	// Absolute,X
+#define INSTRUCTION_CMP_ABSOLUTEY   0xD9	// Absolute,Y
+#define INSTRUCTION_CMP_ZEROPAGE    0xC5	// Zero Page
+#define INSTRUCTION_CMP_ZEROPAGEX   0xD5	// Zero Page,X
+#define INSTRUCTION_CMP_INDIRECTX   0xC1	// (Zero Page,X)
+#define INSTRUCTION_CMP_INDIRECTY   0xD1	// (Zero Page),Y
+
+// Compare X Register
+#define INSTRUCTION_CPX_IMMEDIATE   0xE0    // Immediate
+#define INSTRUCTION_CPX_ZEROPAGE    0xE4    // Zero Page
+#define INSTRUCTION_CPX_ABSOLUTE    0xEC    // Absolute
+
+// Compare Y Register
+#define INSTRUCTION_CPY_IMMEDIATE   0xC0    // Immediate
+#define INSTRUCTION_CPY_ZEROPAGE    0xC4    // Zero Page
+#define INSTRUCTION_CPY_ABSOLUTE    0xCC    // Absolute
+
+// Decrement Memory
+#define INSTRUCTION_DEC_ZEROPAGE    0xC6    // Zero Page
+#define INSTRUCTION_DEC_ZEROPAGEX   0xD6    // Zero Page,X
+#define INSTRUCTION_DEC_ABSOLUTE    0xCE    // Absolute
+#define INSTRUCTION_DEC_ABSOLUTEX   0xDE    // Absolute,X
+
+// Bitwise Exclusive Or
+#define INSTRUCTION_EOR_IMMEDIATE   0x49    // Immediate
+#define INSTRUCTION_EOR_ZEROPAGE    0x45    // Zero Page
+#define INSTRUCTION_EOR_ZEROPAGEX   0x55    // Zero Page X
+#define INSTRUCTION_EOR_ABSOLUTE    0x4D    // Absolute
+#define INSTRUCTION_EOR_ABSOLUTEX   0x5D    // Absolute X
+#define INSTRUCTION_EOR_ABSOLUTEY   0x59    // Absolute Y
+#define INSTRUCTION_EOR_INDIRECTX   0x41    // Indirect X
+#define INSTRUCTION_EOR_INDIRECTY   0x51    // Indirect Y
+
+// Flag Instructions
+#define INSTRUCTION_CLC             0x18    // Clear Carry
+#define INSTRUCTION_SEC             0x38    // Set Carry
+#define INSTRUCTION_CLI             0x58    // Clear Input
+#define INSTRUCTION_SEI             0x78    // Set Interrupt
+#define INSTRUCTION_CLV             0xB8    // Cleaer Overflow
+#define INSTRUCTION_CLD             0xD8    // Clear Decimal
+#define INSTRUCTION_SED             0xF8    // Set Decimal
+
+// Increment Memory
+#define INSTRUCTION_INC_ZEROPAGE    0xE6    // Zero Page
+#define INSTRUCTION_INC_ZEROPAGEX   0xF6    // Zero Page,X
+#define INSTRUCTION_INC_ABSOLUTE    0xEE    // Absolute
+#define INSTRUCTION_INCABSOLUTEX    0xFE    // Absolute,X
+
+// Jump
+#define INSTRUCTION_JMP_ABSOLUTE    0x4C	// Absolute
+#define INSTRUCTION_JMP_INDIRECT    0x6C	// Indirect
+
+// Jump To Subroutine
+#define INSTRUCTION_JSR_ABSOLUTE    0x20	// Absolute
+
+// Load Accumulator
+#define INSTRUCTION_LDA_IMMEDIATE   0xA9	// Immediate
+#define INSTRUCTION_LDA_ZEROPAGE    0xA5	// Zero Page
+#define INSTRUCTION_LDA_ZEROPAGEX   0xB5	// Zero Page,X
+#define INSTRUCTION_LDA_ABSOLUTE    0xAD	// Absolute
+#define INSTRUCTION_LDA_ABSOLUTEX   0xBD	// Absolute,X
+#define INSTRUCTION_LDA_ABSOLUTEY   0xB9	// Absolute,Y
+#define INSTRUCTION_LDA_INDIRECTX   0xA1	// Indirect,X
+#define INSTRUCTION_LDA_INDIRECTY   0xB1	// Indirect,Y
+
+// Load X Register
+#define INSTRUCTION_LDX_IMMEDIATE   0xA2    // Immediate
+#define INSTRUCTION_LDX_ZEROPAGE    0xA6    // Zero Page
+#define INSTRUCTION_LDX_ZEROPAGEY   0xB6    // Zero Page,Y
+#define INSTRUCTION_LDX_ABSOLUTE    0xAE    // Absolute
+#define INSTRUCTION_LDX_ABSOLUTEY   0xBE    // Absolute,Y
+
+// Load Y Register
+#define INSTRUCTION_LDY_IMMEDIATE   0xA0    // Immediate
+#define INSTRUCTION_LDY_ZEROPAGE    0xA4    // Zero Page
+#define INSTRUCTION_LDY_ZEROPAGEX   0xB4    // Zero Page,Y
+#define INSTRUCTION_LDY_ABSOLUTE    0xAC    // Absolute
+#define INSTRUCTION_LDY_ABSOLUTEX   0xBC    // Absolute,Y
+
+// Logical Shift Right
+#define INSTRUCTION_LSR_ACCUMULATOR 0x4A    // Accumulator
+#define INSTRUCTION_LSR_ZEROPAGE    0x46    // Zero Page
+#define INSTRUCTION_LSR_ZEROPAGEX   0x56    // Zero Page,X
+#define INSTRUCTION_LSR_ABSOLUTE    0x4E    // Absolute
+#define INSTRUCTION_LSR_ABSOLUTEX   0x5E    // Absolute,X
+
+// No Operation
+#define INSTRUCTION_NOP_IMPLIED     0xEA    // Implied
+
+// Bitwise Or with Accumulator
+#define INSTRUCTION_ORA_IMMEDIATE   0x09    // Immedeate
+#define INSTRUCTION_ORA_ZEROPAGE    0x05    // Zero Page
+#define INSTRUCTION_ORA_ZEROPAGEX   0x15    // Zero Page,X
+#define INSTRUCTION_ORA_ABSOLUTE    0x0D    // Absolute
+#define INSTRUCTION_ORA_ABSOLUTEX   0x1D    // Absolute,X
+#define INSTRUCTION_ORA_ABSOLUTEY   0x19    // Absolute,Y
+#define INSTRUCTION_ORA_INDIRECTX   0x01    // Indirect,X
+#define INSTRUCTION_ORA_INDIRECTY   0x11    // Indirect,Y
+
+// Register Instructions
+#define INSTRUCTION_TAX             0xAA    // Transfer A to X
+#define INSTRUCTION_TXA             0x8A    // Transfer X to A
+#define INSTRUCTION_DEX             0xCA    // Decrement X
+#define INSTRUCTION_INX             0xE8    // Increment X
+#define INSTRUCTION_TAY             0xA8    // Transfer A to Y
+#define INSTRUCTION_TYA             0x98    // Transfer Y to A
+#define INSTRUCTION_DEY             0x88    // Decrement Y
+#define INSTRUCTION_INY             0xC8    // Increment Y
+
+// Rotate Left
+#define INSTRUCTION_ROL_ACCUMULATOR 0x2A    // Accumulator
+#define INSTRUCTION_ROL_ZEROPAGE    0x26    // Zero Page
+#define INSTRUCTION_ROL_ZEROPAGEX   0x36    // Zero Page,X
+#define INSTRUCTION_ROL_ABSOLUTE    0x2E    // Absolute
+#define INSTRUCTION_ROL_ABSOLUTEX   0x3E    // Absolute,X
+
+// Rotate Right
+#define INSTRUCTION_ROR_ACCUMULATOR 0x6A    // Accumulator
+#define INSTRUCTION_ROR_ZEROPAGE    0x66    // Zero Page
+#define INSTRUCTION_ROR_ZEROPAGEX   0x76    // Zero Page,X
+#define INSTRUCTION_ROR_ABSOLUTE    0x6E    // Absolute
+#define INSTRUCTION_ROR_ABSOLUTEX   0x7E    // Absolute,X
+
+// Return from Interrupt
+#define INSTRUCTION_RTI_IMPLIED     0x40    // Implied
+
+// Return from Subroutine
+#define INSTRUCTION_RTS_IMPLIED     0x60    // Implied
+
+// Subtract with Carry
+#define INSTRUCTION_SBC_IMMEDIATE   0xE9    // Immediate
+#define INSTRUCTION_SBC_ZEROPAGE    0xE5    // Zero Page
+#define INSTRUCTION_SBC_ZEROPAGEX   0xF5    // Zero Page,X
+#define INSTRUCTION_SBC_ABSOLUTE    0xED    // Absolute
+#define INSTRUCTION_SBC_ABSOLUTEX   0xFD    // Absolute,X
+#define INSTRUCTION_SBC_ABSOLUTEY   0xF9    // Absolute,Y
+#define INSTRUCTION_SBC_INDIRECTX   0xE1    // Indirect,X
+#define INSTRUCTION_SBC_INDIRECTY   0xF1    // Indirect,Y
+
+// Store Accumulator
+#define INSTRUCTION_STA_ZEROPAGE    0x85    // Zero Page
+#define INSTRUCTION_STA_ZEROPAGEX   0x95    // Zero Page,X
+#define INSTRUCTION_STA_ABOSLUTE    0x8D    // Absolute
+#define INSTRUCTION_STA_ABSOLUTEX   0x9D    // Absolute,X
+#define INSTRUCTION_STA_ABSOLUTEY   0x99    // Absolute,Y
+#define INSTRUCTION_STA_INDIRECTX   0x81    // Indirect,X
+#define INSTRUCTION_STA_INDIRECTY   0x91    // Indirect,Y
+
+// Stack Instructions
+#define INSTRUCTION_TXS             0x9A    // Transfer X to Stack ptr
+#define INSTRUCTION_TSX             0xBA    // Transfer Stack ptr to X
+#define INSTRUCTION_PHA             0x48    // Push Accumulator
+#define INSTRUCTION_PLA             0x68    // Pull Accumulator
+#define INSTRUCTION_PHP             0x08    // Push Processor Status
+#define INSTRUCTION_PLP             0x28    // Pull Processor Status
+
+// Store X Register
+#define INSTRUCTION_STX_ZEROPAGE    0x86    // Zero Page
+#define INSTRUCTION_STX_ZEROPAGEY   0x96    // Zero Page,Y
+#define INSTRUCTION_STX_ABSOLUTE    0x8E    // Absolute
+
+// Store Y Register
+#define INSTRUCTION_STY_ZEROPAGE    0x84    // Zero Page
+#define INSTRUCTION_STY_ZEROPAGEX   0x94    // Zero Page,X
+#define INSTRUCTION_STY_ABSOLUTE    0x8C    // Absolute
+
+// Undocumented NMOS Opcodes (VARIANT_NMOS only)
+// Load Accumulator and X Register
+#define INSTRUCTION_LAX_ZEROPAGE    0xA7    // Zero Page
+#define INSTRUCTION_LAX_ZEROPAGEY   0xB7    // Zero Page,Y
+#define INSTRUCTION_LAX_ABSOLUTE    0xAF    // Absolute
+#define INSTRUCTION_LAX_ABSOLUTEY   0xBF    // Absolute,Y
+#define INSTRUCTION_LAX_INDIRECTX   0xA3    // Indirect,X
+#define INSTRUCTION_LAX_INDIRECTY   0xB3    // Indirect,Y
+
+// Store Accumulator "AND" X Register
+#define INSTRUCTION_SAX_ZEROPAGE    0x87    // Zero Page
+#define INSTRUCTION_SAX_ZEROPAGEY   0x97    // Zero Page,Y
+#define INSTRUCTION_SAX_ABSOLUTE    0x8F    // Absolute
+#define INSTRUCTION_SAX_INDIRECTX   0x83    // Indirect,X
+
+// Decrement Memory and Compare
+#define INSTRUCTION_DCP_ZEROPAGE    0xC7    // Zero Page
+#define INSTRUCTION_DCP_ZEROPAGEX   0xD7    // Zero Page,X
+#define INSTRUCTION_DCP_ABSOLUTE    0xCF    // Absolute
+#define INSTRUCTION_DCP_ABSOLUTEX   0xDF    // Absolute,X
+#define INSTRUCTION_DCP_ABSOLUTEY   0xDB    // Absolute,Y
+#define INSTRUCTION_DCP_INDIRECTX   0xC3    // Indirect,X
+#define INSTRUCTION_DCP_INDIRECTY   0xD3    // Indirect,Y
+
+// Increment Memory and Subtract with Carry
+#define INSTRUCTION_ISC_ZEROPAGE    0xE7    // Zero Page
+#define INSTRUCTION_ISC_ZEROPAGEX   0xF7    // Zero Page,X
+#define INSTRUCTION_ISC_ABSOLUTE    0xEF    // Absolute
+#define INSTRUCTION_ISC_ABSOLUTEX   0xFF    // Absolute,X
+#define INSTRUCTION_ISC_ABSOLUTEY   0xFB    // Absolute,Y
+#define INSTRUCTION_ISC_INDIRECTX   0xE3    // Indirect,X
+#define INSTRUCTION_ISC_INDIRECTY   0xF3    // Indirect,Y
+
+// Shift Left and "OR" / Rotate Left and "AND"
+#define INSTRUCTION_SLO_ZEROPAGE    0x07    // Zero Page
+#define INSTRUCTION_RLA_ZEROPAGE    0x27    // Zero Page
+
+// Shift Right and Exclusive Or / Rotate Right and Add
+#define INSTRUCTION_SRE_ZEROPAGE    0x47    // Zero Page
+#define INSTRUCTION_RRA_ZEROPAGE    0x67    // Zero Page
+
+// Immediate Operations
+#define INSTRUCTION_ANC_IMMEDIATE   0x0B    // "AND", Carry = Negative
+#define INSTRUCTION_ALR_IMMEDIATE   0x4B    // "AND", Shift Right
+#define INSTRUCTION_ARR_IMMEDIATE   0x6B    // "AND", Rotate Right
+#define INSTRUCTION_SBX_IMMEDIATE   0xCB    // X = (A "AND" X) - Immediate
+
+// Halt the Processor
+#define INSTRUCTION_JAM             0x02    // Also 0x12, 0x22, ..., 0xF2
+
+// 65C02 Opcodes (VARIANT_CMOS only)
+#define INSTRUCTION_BRA_RELATIVE    0x80    // Branch Always
+#define INSTRUCTION_STZ_ZEROPAGE    0x64    // Store Zero, Zero Page
+#define INSTRUCTION_STZ_ZEROPAGEX   0x74    // Store Zero, Zero Page,X
+#define INSTRUCTION_STZ_ABSOLUTE    0x9C    // Store Zero, Absolute
+#define INSTRUCTION_STZ_ABSOLUTEX   0x9E    // Store Zero, Absolute,X
+#define INSTRUCTION_PHX             0xDA    // Push X Register
+#define INSTRUCTION_PLX             0xFA    // Pull X Register
+#define INSTRUCTION_PHY             0x5A    // Push Y Register
+#define INSTRUCTION_PLY             0x7A    // Pull Y Register
+#define INSTRUCTION_INC_ACCUMULATOR 0x1A    // Increment Accumulator
+#define INSTRUCTION_DEC_ACCUMULATOR 0x3A    // Decrement Accumulator
+#define INSTRUCTION_TSB_ZEROPAGE    0x04    // Test and Set Bits
+#define INSTRUCTION_TRB_ZEROPAGE    0x14    // Test and Reset Bits
+#define INSTRUCTION_LDA_INDIRECT    0xB2    // (Zero Page)
+#define INSTRUCTION_STA_INDIRECT    0x92    // (Zero Page)
+#define INSTRUCTION_JMP_INDIRECTX   0x7C    // (Absolute,X)
+#define INSTRUCTION_WAI             0xCB    // Wait for Interrupt
+#define INSTRUCTION_STP             0xDB    // Stop
+
+#endif // !CPU_h
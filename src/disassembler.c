@@ -0,0 +1,173 @@
+/*
+ * A disassembler driven by the opcode metadata of cpu.c, so it decodes
+ * exactly what the interpreter executes and writes what the assembler reads.
+ */
+
+#include "disassembler.h"
+
+const int Symbols_Load(Symbols* symbols, const Assembler* assembler)
+{
+	symbols->Entries = malloc(sizeof(Symbol) * (assembler->label_count + 1));
+	symbols->Count = 0;
+	if (symbols->Entries == NULL)
+		return -1;
+
+	for (size_t i = 0; i < assembler->label_count; i++)
+	{
+		const Label* label = &assembler->labels[i];
+		Symbol symbol = { label->address, malloc(label->name_size + 1) };
+
+		if (symbol.Name == NULL)
+		{
+			Symbols_Free(symbols);
+			return -1;
+		}
+		(void)memcpy(symbol.Name, label->name, label->name_size);
+		symbol.Name[label->name_size] = '\0';
+
+		// Labels mostly come in address order, so this is rarely quadratic
+		size_t j = symbols->Count;
+		while (j > 0 && symbols->Entries[j - 1].Address > symbol.Address)
+			j--;
+
+		if (j > 0 && symbols->Entries[j - 1].Address == symbol.Address)
+		{
+			free(symbol.Name);
+			continue;
+		}
+
+		(void)memmove(&symbols->Entries[j + 1], &symbols->Entries[j],
+		              sizeof(Symbol) * (symbols->Count - j));
+		symbols->Entries[j] = symbol;
+		symbols->Count++;
+	}
+
+	return 0;
+}
+
+void Symbols_Free(Symbols* symbols)
+{
+	for (size_t i = 0; i < symbols->Count; i++)
+		free(symbols->Entries[i].Name);
+
+	free(symbols->Entries);
+	symbols->Entries = NULL;
+	symbols->Count = 0;
+}
+
+const char* Symbols_Find(const Symbols* symbols, const Word address)
+{
+	size_t low = 0, high = (symbols == NULL) ? 0 : symbols->Count;
+
+	while (low < high)
+	{
+		const size_t middle = low + (high - low) / 2;
+
+		if (symbols->Entries[middle].Address < address)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	return (symbols != NULL && low < symbols->Count
+	        && symbols->Entries[low].Address == address)
+		? symbols->Entries[low].Name : NULL;
+}
+
+// Writes the symbol of an address or the address in hexadecimal
+static void write_address(const Symbols* symbols,
+                          const Word address,
+                          const int digits,
+                          char* text,
+                          const size_t size)
+{
+	const char* name = Symbols_Find(symbols, address);
+
+	if (name != NULL)
+		(void)snprintf(text, size, "%s", name);
+	else
+		(void)snprintf(text, size, "$%0*X", digits, address);
+}
+
+const int Disassemble(const CPU_Variant variant,
+                      const Word address,
+                      const Byte* bytes,
+                      const Symbols* symbols,
+                      char* buffer,
+                      const size_t size)
+{
+	const Opcode_Info* info = CPU_Opcode_Info(variant, bytes[0]);
+	char target[DISASSEMBLY_SIZE / 2];
+	char operand[DISASSEMBLY_SIZE];
+
+	if (info == NULL)
+		return -1;
+
+	const Byte low = (info->Size >= 2) ? bytes[1] : 0;
+	const Byte high = (info->Size == 3) ? bytes[2] : 0;
+	const Word next = address + info->Size;
+
+	switch (info->Mode)
+	{
+		case MODE_ZEROPAGE:
+		case MODE_ZEROPAGEX:
+		case MODE_ZEROPAGEY:
+		case MODE_INDIRECTX:
+		case MODE_INDIRECTY:
+		case MODE_INDIRECT_ZEROPAGE:
+		case MODE_ZEROPAGE_RELATIVE:
+			write_address(symbols, low, 2, target, sizeof(target));
+			break;
+		case MODE_RELATIVE:
+			write_address(symbols, next + (signed char)low, 4,
+			              target, sizeof(target));
+			break;
+		default:
+			write_address(symbols, low | (high << 8), 4,
+			              target, sizeof(target));
+			break;
+	}
+
+	switch (info->Mode)
+	{
+		case MODE_IMPLIED: operand[0] = '\0'; break;
+		case MODE_ACCUMULATOR: (void)strcpy(operand, "A"); break;
+		case MODE_IMMEDIATE:
+			(void)snprintf(operand, sizeof(operand), "#$%02X", low);
+			break;
+		case MODE_ZEROPAGEX:
+		case MODE_ABSOLUTEX:
+			(void)snprintf(operand, sizeof(operand), "%s,X", target);
+			break;
+		case MODE_ZEROPAGEY:
+		case MODE_ABSOLUTEY:
+			(void)snprintf(operand, sizeof(operand), "%s,Y", target);
+			break;
+		case MODE_INDIRECT:
+		case MODE_INDIRECT_ZEROPAGE:
+			(void)snprintf(operand, sizeof(operand), "(%s)", target);
+			break;
+		case MODE_INDIRECTX:
+		case MODE_INDIRECT_ABSOLUTEX:
+			(void)snprintf(operand, sizeof(operand), "(%s,X)", target);
+			break;
+		case MODE_INDIRECTY:
+			(void)snprintf(operand, sizeof(operand), "(%s),Y", target);
+			break;
+		case MODE_ZEROPAGE_RELATIVE:
+		{
+			char branch[DISASSEMBLY_SIZE / 2];
+
+			write_address(symbols, next + (signed char)high, 4,
+			              branch, sizeof(branch));
+			(void)snprintf(operand, sizeof(operand), "%s,%s", target, branch);
+		} break;
+		default:
+			(void)snprintf(operand, sizeof(operand), "%s", target);
+			break;
+	}
+
+	(void)snprintf(buffer, size, "%s%s%s", info->Mnemonic,
+	               (operand[0] != '\0') ? " " : "", operand);
+	return info->Size;
+}
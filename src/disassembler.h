@@ -0,0 +1,64 @@
+#ifndef DISASSEMBLER_h
+#define DISASSEMBLER_h
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cpu.h"
+#include "runner.h"
+
+// Longest line Disassemble writes, e.g. "BBR0 $10,$C010" with long labels
+#define DISASSEMBLY_SIZE 96
+
+typedef struct Symbol
+{
+	Word Address;
+	char* Name;
+} Symbol;
+
+// Names of addresses, sorted by address for Symbols_Find
+typedef struct Symbols
+{
+	Symbol* Entries;
+	size_t Count;
+} Symbols;
+
+
+/**
+ * @brief Copy the labels of an assembled programme, so they outlive its
+ * source and the assembler.
+ *
+ * Where several labels name the same address, the first one is used.
+ *
+ * @return 0 on success, -1 if out of memory, leaving symbols empty
+*/
+const int Symbols_Load(Symbols* symbols, const Assembler* assembler);
+void Symbols_Free(Symbols* symbols);
+
+/**
+ * @brief The name of an address, NULL if it has none or symbols is NULL.
+*/
+const char* Symbols_Find(const Symbols* symbols, const Word address);
+
+/**
+ * @brief Disassemble one instruction as the given variant decodes it.
+ *
+ * Operands that are addresses with a symbol are written as its name, branch
+ * targets are resolved to absolute addresses. Only the bytes the opcode
+ * needs are read, up to three.
+ *
+ * @param variant the instruction set to decode
+ * @param address where the instruction is, for branch targets
+ * @param bytes the opcode followed by its operand
+ * @param symbols names of addresses, may be NULL
+ * @return the length of the instruction in bytes, -1 if the variant is
+ * invalid
+*/
+const int Disassemble(const CPU_Variant variant,
+                      const Word address,
+                      const Byte* bytes,
+                      const Symbols* symbols,
+                      char* buffer,
+                      const size_t size);
+
+#endif // !DISASSEMBLER_h
@@ -0,0 +1,250 @@
+#include "fuzz.h"
+
+#define FUZZ_MAX_STACK 8		// Mutations applied to one input at most
+#define FUZZ_DEFAULT_SEED 0x9E3779B97F4A7C15ull
+
+// AFL's interesting 8 bit values: boundaries of signed and unsigned bytes
+static const Byte interesting[] =
+	{ 0x80, 0xFF, 0x00, 0x01, 0x10, 0x20, 0x40, 0x64, 0x7F };
+
+const int Fuzz_Initialise(Fuzz* fuzz,
+                          CPU* cpu,
+                          Mem* mem,
+                          const u32 cycles,
+                          const u64 seed)
+{
+	(void)memset(fuzz, 0, sizeof(*fuzz));
+	fuzz->Snapshot = malloc(MAX_MEM);
+	fuzz->Coverage = malloc(sizeof(Coverage));
+	fuzz->Seen = calloc(COVERAGE_SIZE, 1);
+
+	if (fuzz->Snapshot == NULL || fuzz->Coverage == NULL || fuzz->Seen == NULL)
+	{
+		Fuzz_Free(fuzz);
+		return -1;
+	}
+
+	fuzz->CPU = cpu;
+	fuzz->Mem = mem;
+	fuzz->Start = *cpu;
+	fuzz->Start.Coverage = fuzz->Coverage;
+	fuzz->Cycles = cycles;
+	fuzz->Random = (seed != 0) ? seed : FUZZ_DEFAULT_SEED;
+
+	(void)memcpy(fuzz->Snapshot, mem->Data, MAX_MEM);
+	(void)memset(fuzz->Restore, 1, sizeof(fuzz->Restore));
+	(void)memset(fuzz->Coverage->Hits, 0, sizeof(fuzz->Coverage->Hits));
+	Coverage_Clear(fuzz->Coverage);
+
+	return 0;
+}
+
+void Fuzz_Free(Fuzz* fuzz)
+{
+	free(fuzz->Snapshot);
+	free(fuzz->Coverage);
+	free(fuzz->Seen);
+	free(fuzz->Corpus);
+	free(fuzz->Input);
+	fuzz->Snapshot = fuzz->Seen = fuzz->Corpus = fuzz->Input = NULL;
+	fuzz->Coverage = NULL;
+	fuzz->Corpus_Count = fuzz->Corpus_Capacity = 0;
+}
+
+const int Fuzz_Add_Input(Fuzz* fuzz, const Word address, const Word size)
+{
+	if (fuzz->Input_Count == FUZZ_MAX_INPUTS || size == 0
+		|| (u32)address + size > MAX_MEM)
+		return -1;
+
+	Byte* input = realloc(fuzz->Input, fuzz->Size + size);
+	if (input == NULL)
+		return -1;
+
+	fuzz->Input = input;
+	fuzz->Inputs[fuzz->Input_Count++] = (Fuzz_Input){ address, size };
+	fuzz->Size += size;
+	return 0;
+}
+
+// Restores the pages marked in Restore, copying runs of them at once
+static void restore(Fuzz* fuzz)
+{
+	u32 page = 0;
+
+	while (page < PAGE_COUNT)
+	{
+		if (!fuzz->Restore[page])
+		{
+			page++;
+			continue;
+		}
+
+		const u32 first = page;
+
+		while (page < PAGE_COUNT && fuzz->Restore[page])
+			page++;
+		(void)memcpy(&fuzz->Mem->Data[first * PAGE_SIZE],
+		             &fuzz->Snapshot[first * PAGE_SIZE],
+		             (page - first) * PAGE_SIZE);
+	}
+}
+
+// The AFL bucket of a hit count, one bit each
+static Byte bucket(const Byte hits)
+{
+	if (hits <= 3) return 1 << (hits - 1);
+	if (hits <= 7) return 0x08;
+	if (hits <= 15) return 0x10;
+	if (hits <= 31) return 0x20;
+	if (hits <= 127) return 0x40;
+	return 0x80;
+}
+
+static int keep(Fuzz* fuzz, const Byte* input)
+{
+	if (fuzz->Corpus_Count == fuzz->Corpus_Capacity)
+	{
+		const u32 capacity = (fuzz->Corpus_Capacity == 0)
+			? 16 : fuzz->Corpus_Capacity * 2;
+		Byte* corpus = realloc(fuzz->Corpus, (size_t)capacity * fuzz->Size);
+
+		if (corpus == NULL)
+			return -1;
+
+		fuzz->Corpus = corpus;
+		fuzz->Corpus_Capacity = capacity;
+	}
+
+	(void)memcpy(&fuzz->Corpus[(size_t)fuzz->Corpus_Count * fuzz->Size],
+	             input, fuzz->Size);
+	fuzz->Corpus_Count++;
+	return 0;
+}
+
+const int Fuzz_Execute(Fuzz* fuzz, const Byte* input)
+{
+	const Coverage* coverage = fuzz->Coverage;
+	int found = 0;
+
+	restore(fuzz);
+	for (u32 i = 0, offset = 0; i < fuzz->Input_Count; i++)
+	{
+		const Fuzz_Input* region = &fuzz->Inputs[i];
+
+		(void)memcpy(&fuzz->Mem->Data[region->Address], &input[offset],
+		             region->Size);
+		offset += region->Size;
+	}
+
+	*fuzz->CPU = fuzz->Start;
+	Coverage_Clear(fuzz->Coverage);
+	(void)CPU_Execute(fuzz->CPU, fuzz->Mem, fuzz->Cycles);
+	fuzz->Executions++;
+
+	for (u32 i = 0; i < coverage->Count; i++)
+	{
+		const Word edge = coverage->Edges[i];
+		const Byte hits = bucket(coverage->Hits[edge]);
+
+		if ((hits & ~fuzz->Seen[edge]) == 0)
+			continue;
+
+		fuzz->Edges += (fuzz->Seen[edge] == 0);
+		fuzz->Seen[edge] |= hits;
+		found++;
+	}
+
+	if (found > 0 && keep(fuzz, input) != 0)
+		return -1;
+
+	return found;
+}
+
+// xorshift64
+static u64 next_random(Fuzz* fuzz)
+{
+	fuzz->Random ^= fuzz->Random << 13;
+	fuzz->Random ^= fuzz->Random >> 7;
+	fuzz->Random ^= fuzz->Random << 17;
+
+	return fuzz->Random;
+}
+
+static void mutate(Fuzz* fuzz)
+{
+	const u32 size = fuzz->Size;
+	const u32 count = fuzz->Corpus_Count;
+	const u32 stack = 1 + next_random(fuzz) % FUZZ_MAX_STACK;
+
+	(void)memcpy(fuzz->Input,
+	             &fuzz->Corpus[(next_random(fuzz) % count) * size], size);
+
+	for (u32 i = 0; i < stack; i++)
+	{
+		const u64 random = next_random(fuzz);
+		const u32 position = (random >> 8) % size;
+		const u32 argument = random >> 40;
+		Byte* byte = &fuzz->Input[position];
+
+		switch (random % 5)
+		{
+			case 0: *byte ^= 1 << (argument % 8); break;
+			case 1: *byte = (Byte)argument; break;
+			case 2:
+				*byte = interesting[argument % sizeof(interesting)];
+				break;
+			case 3: *byte += (Byte)(argument % 35) - 17; break;
+			case 4:
+			{
+				const Byte* other =
+					&fuzz->Corpus[(size_t)(argument % count) * size];
+				const u32 length = 1 + (argument >> 8) % (size - position);
+
+				(void)memcpy(byte, &other[position], length);
+			} break;
+		}
+	}
+}
+
+const long long Fuzz_Run(Fuzz* fuzz, const u64 executions)
+{
+	u64 count = 0;
+
+	if (fuzz->Size == 0)
+		return -1;
+
+	if (fuzz->Corpus_Count == 0 && executions > 0)
+	{
+		for (u32 i = 0, offset = 0; i < fuzz->Input_Count; i++)
+		{
+			const Fuzz_Input* region = &fuzz->Inputs[i];
+
+			(void)memcpy(&fuzz->Input[offset],
+			             &fuzz->Snapshot[region->Address], region->Size);
+			offset += region->Size;
+		}
+
+		// Kept even without coverage, every mutation needs a parent
+		const int found = Fuzz_Execute(fuzz, fuzz->Input);
+		if (found < 0 || (found == 0 && keep(fuzz, fuzz->Input) != 0))
+			return -1;
+
+		count++;
+		if (fuzz->CPU->Trap != TRAP_NONE)
+			return count;
+	}
+
+	while (count < executions)
+	{
+		mutate(fuzz);
+		if (Fuzz_Execute(fuzz, fuzz->Input) < 0)
+			return -1;
+
+		count++;
+		if (fuzz->CPU->Trap != TRAP_NONE)
+			break;
+	}
+
+	return count;
+}
@@ -0,0 +1,109 @@
+#ifndef FUZZ_h
+#define FUZZ_h
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cpu.h"
+
+#define FUZZ_MAX_INPUTS 8
+
+// Memory the fuzzer fills with each input
+typedef struct Fuzz_Input
+{
+	Word Address;
+	Word Size;
+} Fuzz_Input;
+
+/*
+ * A coverage guided fuzzer running a programme in process. Every execution
+ * starts from the state the cpu and memory had at Fuzz_Initialise, with the
+ * input regions overwritten by an input: the concatenation of the regions'
+ * bytes. Inputs that hit an edge not seen before, or an edge a number of
+ * times not seen before (counted in AFL's buckets 1, 2, 3, 4-7, 8-15,
+ * 16-31, 32-127 and 128+), are kept in the corpus and mutated further.
+ *
+ * Restoring memory is the largest cost of a short execution; clear the
+ * entries of Restore for pages the programme cannot write, such as ROM.
+ */
+typedef struct Fuzz
+{
+	CPU* CPU;						// Left as the last execution left it
+	Mem* Mem;
+	CPU Start;
+	Byte* Snapshot;					// Memory at Fuzz_Initialise
+	Byte Restore[PAGE_COUNT];		// Non-zero for pages to restore, all by default
+	Fuzz_Input Inputs[FUZZ_MAX_INPUTS];
+	u32 Input_Count;
+	u32 Size;						// Bytes in an input
+	u32 Cycles;						// Budget of an execution
+
+	Coverage* Coverage;				// Of the last execution
+	Byte* Seen;						// Buckets hit so far, per edge
+	u32 Edges;						// Edges hit so far
+
+	Byte* Corpus;					// Size bytes per entry
+	u32 Corpus_Count;
+	u32 Corpus_Capacity;
+	Byte* Input;					// The input being executed
+
+	u64 Executions;
+	u64 Random;						// State of the generator, never 0
+} Fuzz;
+
+
+/**
+ * @brief Take the current state of cpu and memory as the start of every
+ * execution.
+ *
+ * Traps are left in place and stop an execution; put breakpoints on the
+ * programme's failure paths to find the inputs that reach them.
+ *
+ * @param cycles budget of each execution
+ * @param seed for the mutations, runs with the same seed are identical
+ * @return 0, or -1 if out of memory
+*/
+const int Fuzz_Initialise(Fuzz* fuzz,
+                          CPU* cpu,
+                          Mem* mem,
+                          const u32 cycles,
+                          const u64 seed);
+void Fuzz_Free(Fuzz* fuzz);
+
+/**
+ * @brief Add a region of memory to the input.
+ *
+ * Its contents at Fuzz_Initialise are part of the first input Fuzz_Run
+ * executes. Only call this before executing anything.
+ *
+ * @return 0, or -1 if there are FUZZ_MAX_INPUTS regions already, the region
+ * is empty or does not fit in memory
+*/
+const int Fuzz_Add_Input(Fuzz* fuzz, const Word address, const Word size);
+
+/**
+ * @brief Execute the programme once with the given input, keeping it if it
+ * finds new coverage.
+ *
+ * @param input Size bytes, filling the regions in the order they were added
+ * @return the number of edges or buckets hit for the first time, -1 if out
+ * of memory
+*/
+const int Fuzz_Execute(Fuzz* fuzz, const Byte* input);
+
+/**
+ * @brief Execute mutations of the corpus until an execution hits a trap or
+ * the given number of executions is reached.
+ *
+ * An empty corpus is seeded with the contents of the regions first. Every
+ * mutation copies a random entry and applies a stack of one to eight random
+ * changes: bit flips, random, interesting or nudged bytes and bytes spliced
+ * in from another entry.
+ *
+ * @return the number of executions, or -1 if there are no input regions or
+ * it ran out of memory. After a trap fuzz->Input holds the input that hit
+ * it and fuzz->CPU the state it left.
+*/
+const long long Fuzz_Run(Fuzz* fuzz, const u64 executions);
+
+#endif // !FUZZ_h
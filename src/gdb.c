@@ -0,0 +1,600 @@
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "gdb.h"
+
+#define INTERRUPT 0x03		// ^C sent by the debugger while the cpu runs
+#define SIGINT_STOP  "S02"
+#define SIGILL_STOP  "S04"
+#define SIGTRAP_STOP "S05"
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static const char target_xml[] =
+	"<?xml version=\"1.0\"?>"
+	"<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+	"<target version=\"1.0\">"
+	"<feature name=\"org.mos6502.core\">"
+	"<reg name=\"a\" bitsize=\"8\" type=\"uint8\" regnum=\"0\"/>"
+	"<reg name=\"x\" bitsize=\"8\" type=\"uint8\"/>"
+	"<reg name=\"y\" bitsize=\"8\" type=\"uint8\"/>"
+	"<reg name=\"p\" bitsize=\"8\" type=\"uint8\"/>"
+	"<reg name=\"sp\" bitsize=\"8\" type=\"uint8\"/>"
+	"<reg name=\"pc\" bitsize=\"16\" type=\"code_ptr\"/>"
+	"</feature>"
+	"</target>";
+
+// Sockets
+const int GDB_Listen(const char* address)
+{
+	int fd;
+
+	if (strchr(address, '/') != NULL)
+	{
+		struct sockaddr_un local = { .sun_family = AF_UNIX };
+
+		if (strlen(address) >= sizeof(local.sun_path))
+			return -1;
+		(void)strcpy(local.sun_path, address);
+
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0)
+			return -1;
+		if (bind(fd, (struct sockaddr*)&local, sizeof(local)) != 0)
+		{
+			(void)close(fd);
+			return -1;
+		}
+	}
+	else
+	{
+		char* end;
+		const long port = strtol(address, &end, 10);
+		const int reuse = 1;
+		struct sockaddr_in local =
+		{
+			.sin_family = AF_INET,
+			.sin_port = htons(port),
+			.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+		};
+
+		if (*address == '\0' || *end != '\0' || port < 0 || port > 0xFFFF)
+			return -1;
+
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0)
+			return -1;
+		(void)setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+		if (bind(fd, (struct sockaddr*)&local, sizeof(local)) != 0)
+		{
+			(void)close(fd);
+			return -1;
+		}
+	}
+
+	if (listen(fd, 1) != 0)
+	{
+		(void)close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+const int GDB_Accept(const int listener)
+{
+	const int no_delay = 1;
+	const int fd = accept(listener, NULL, NULL);
+
+	// Packets are small and answered one at a time; fails on Unix sockets
+	if (fd >= 0)
+		(void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY,
+		                 &no_delay, sizeof(no_delay));
+
+	return fd;
+}
+
+// Transport
+static int next_char(GDB_Stub* stub)
+{
+	if (stub->input_position == stub->input_size)
+	{
+		ssize_t size;
+
+		do
+			size = recv(stub->fd, stub->input, sizeof(stub->input), 0);
+		while (size < 0 && errno == EINTR);
+
+		if (size <= 0)
+			return -1;
+
+		stub->input_position = 0;
+		stub->input_size = size;
+	}
+
+	return (unsigned char)stub->input[stub->input_position++];
+}
+
+static int send_all(GDB_Stub* stub, const char* data, size_t size)
+{
+	while (size > 0)
+	{
+		const ssize_t sent = send(stub->fd, data, size, MSG_NOSIGNAL);
+
+		if (sent < 0 && errno == EINTR)
+			continue;
+		if (sent <= 0)
+			return -1;
+
+		data += sent;
+		size -= sent;
+	}
+
+	return 0;
+}
+
+static int hex_value(const int digit)
+{
+	if (digit >= '0' && digit <= '9')
+		return digit - '0';
+	if (digit >= 'a' && digit <= 'f')
+		return digit - 'a' + 10;
+	if (digit >= 'A' && digit <= 'F')
+		return digit - 'A' + 10;
+	return -1;
+}
+
+/*
+ * Packets are framed as $<data>#<checksum>. Acknowledgements and ^C outside
+ * of a packet are skipped. Until no-ack mode is negotiated every packet is
+ * acknowledged with '+', or '-' to request it again if it was damaged.
+ */
+static int receive_packet(GDB_Stub* stub)
+{
+	for (;;)
+	{
+		int c;
+
+		do
+			if ((c = next_char(stub)) < 0)
+				return -1;
+		while (c != '$');
+
+		size_t size = 0;
+		Byte sum = 0;
+
+		while ((c = next_char(stub)) != '#')
+		{
+			if (c < 0)
+				return -1;
+			if (size < sizeof(stub->packet) - 1)
+				stub->packet[size++] = c;
+			sum += c;
+		}
+
+		const int high = hex_value(next_char(stub));
+		const int low = hex_value(next_char(stub));
+		const int valid = (high >= 0 && low >= 0)
+			&& ((high << 4) | low) == sum;
+
+		stub->packet[size] = '\0';
+
+		if (stub->no_ack)
+			return size;
+		if (send_all(stub, valid ? "+" : "-", 1) != 0)
+			return -1;
+		if (valid)
+			return size;
+	}
+}
+
+static int send_packet(GDB_Stub* stub, const char* data)
+{
+	const size_t size = strlen(data);
+	Byte sum = 0;
+
+	for (size_t i = 0; i < size; i++)
+		sum += data[i];
+
+	const char trailer[3] = { '#', hex_digits[sum >> 4], hex_digits[sum & 0xF] };
+
+	for (;;)
+	{
+		if (send_all(stub, "$", 1) != 0
+			|| send_all(stub, data, size) != 0
+			|| send_all(stub, trailer, sizeof(trailer)) != 0)
+			return -1;
+
+		if (stub->no_ack)
+			return 0;
+
+		int c;
+		do
+			c = next_char(stub);
+		while (c >= 0 && c != '+' && c != '-');
+
+		if (c < 0)
+			return -1;
+		if (c == '+')
+			return 0;
+	}
+}
+
+// Encoding
+static char* put_byte(char* out, const Byte data)
+{
+	*out++ = hex_digits[data >> 4];
+	*out++ = hex_digits[data & 0xF];
+	return out;
+}
+
+static int get_byte(const char* in)
+{
+	const int high = hex_value(in[0]);
+	const int low = (high < 0) ? -1 : hex_value(in[1]);
+
+	return (low < 0) ? -1 : (high << 4) | low;
+}
+
+// Parses hexadecimal up to the next non-digit, -1 if there is none
+static long get_number(const char** in)
+{
+	long value = 0;
+	const char* start = *in;
+
+	while (hex_value(**in) >= 0 && value <= 0xFFFFFF)
+		value = (value << 4) | hex_value(*(*in)++);
+
+	return (*in == start) ? -1 : value;
+}
+
+// Register n, see GDB_REGISTER_COUNT for the order
+static Byte* register_byte(CPU* cpu, const long n)
+{
+	switch (n)
+	{
+		case 0: return &cpu->A;
+		case 1: return &cpu->X;
+		case 2: return &cpu->Y;
+		case 4: return &cpu->SP;
+		default: return NULL;
+	}
+}
+
+static char* put_register(char* out, const CPU* cpu, const long n)
+{
+	switch (n)
+	{
+		case 3: return put_byte(out, CPU_Get_Status(cpu));
+		case 5:
+		{
+			out = put_byte(out, cpu->PC & 0xFF);
+			return put_byte(out, cpu->PC >> 8);
+		}
+		default: return put_byte(out, *register_byte((CPU*)cpu, n));
+	}
+}
+
+// Returns the number of characters consumed, -1 on malformed input
+static int set_register(CPU* cpu, const long n, const char* in)
+{
+	const int low = get_byte(in);
+
+	if (low < 0)
+		return -1;
+
+	switch (n)
+	{
+		case 3: CPU_Set_Status(cpu, low); return 2;
+		case 5:
+		{
+			const int high = get_byte(in + 2);
+			if (high < 0)
+				return -1;
+			cpu->PC = low | (high << 8);
+			return 4;
+		}
+		default: *register_byte(cpu, n) = low; return 2;
+	}
+}
+
+// Execution
+static void set_stop(GDB_Stub* stub)
+{
+	const CPU* cpu = stub->cpu;
+
+	if (stub->interrupted)
+		(void)strcpy(stub->stop, SIGINT_STOP);
+	else if (cpu->Halted == HALT_ILLEGAL)
+		(void)strcpy(stub->stop, SIGILL_STOP);
+	else if (cpu->Trap == TRAP_WRITE)
+		(void)snprintf(stub->stop, sizeof(stub->stop),
+		               "T05watch:%04x;", cpu->Trap_Address);
+	else if (cpu->Trap == TRAP_READ)
+		(void)snprintf(stub->stop, sizeof(stub->stop),
+		               "T05rwatch:%04x;", cpu->Trap_Address);
+	else
+		(void)strcpy(stub->stop, SIGTRAP_STOP);
+}
+
+// Polls without blocking, so the cpu only pauses for a system call per slice
+static int check_interrupt(GDB_Stub* stub)
+{
+	struct pollfd request = { .fd = stub->fd, .events = POLLIN };
+
+	while (stub->input_position < stub->input_size)
+		if (stub->input[stub->input_position++] == INTERRUPT)
+			return 1;
+
+	if (poll(&request, 1, 0) <= 0)
+		return 0;
+
+	return next_char(stub) == INTERRUPT;
+}
+
+static void run(GDB_Stub* stub, const int step)
+{
+	CPU* cpu = stub->cpu;
+
+	stub->interrupted = 0;
+
+	if (step)
+		CPU_Execute(cpu, stub->mem, 1);
+	else
+		do
+			CPU_Execute(cpu, stub->mem, GDB_SLICE_CYCLES);
+		while (!(cpu->Halted | cpu->Trap)
+			&& !(stub->interrupted = check_interrupt(stub)));
+
+	set_stop(stub);
+}
+
+// Breakpoints and watchpoints
+static const char* trap(GDB_Stub* stub, const int set)
+{
+	static const Byte kinds[] =
+	{
+		TRAP_EXECUTE,				// Z0 software breakpoint
+		TRAP_EXECUTE,				// Z1 hardware breakpoint
+		TRAP_WRITE,					// Z2 write watchpoint
+		TRAP_READ,					// Z3 read watchpoint
+		TRAP_READ | TRAP_WRITE,		// Z4 access watchpoint
+	};
+	const char* in = stub->packet + 1;
+	const long type = get_number(&in);
+
+	if (type < 0 || type >= (long)sizeof(kinds) || *in++ != ',')
+		return "";
+
+	const long address = get_number(&in);
+	long length = (*in++ == ',') ? get_number(&in) : -1;
+
+	if (address < 0 || address > 0xFFFF || length < 0)
+		return "E01";
+
+	// A breakpoint's length is the kind of instruction, not a range
+	if (kinds[type] == TRAP_EXECUTE || length == 0)
+		length = 1;
+
+	// Flat builds have no traps; an empty reply tells gdb they are unsupported
+	for (long i = 0; i < length && i <= 0xFFFF; i++)
+		if ((set ? Mem_Set_Trap : Mem_Clear_Trap)
+			(stub->mem, (Word)(address + i), kinds[type]) != 0)
+			return "";
+
+	return "OK";
+}
+
+// Requests
+static const char* read_memory(GDB_Stub* stub, char* reply)
+{
+	const char* in = stub->packet + 1;
+	const long address = get_number(&in);
+	const long length = (*in++ == ',') ? get_number(&in) : -1;
+
+	if (address < 0 || length < 0 || length > (GDB_PACKET_SIZE - 1) / 2)
+		return "E01";
+
+	char* out = reply;
+	for (long i = 0; i < length; i++)
+		out = put_byte(out, Get_Memory(stub->mem, (Word)(address + i)));
+	*out = '\0';
+
+	return reply;
+}
+
+static const char* write_memory(GDB_Stub* stub)
+{
+	const char* in = stub->packet + 1;
+	const long address = get_number(&in);
+	const long length = (*in++ == ',') ? get_number(&in) : -1;
+
+	if (address < 0 || length < 0 || *in++ != ':')
+		return "E01";
+
+	for (long i = 0; i < length; i++, in += 2)
+	{
+		const int data = get_byte(in);
+		if (data < 0)
+			return "E01";
+		(void)Set_Memory(stub->mem, (Word)(address + i), data);
+	}
+
+	return "OK";
+}
+
+static const char* read_registers(GDB_Stub* stub, char* reply)
+{
+	char* out = reply;
+
+	for (long n = 0; n < GDB_REGISTER_COUNT; n++)
+		out = put_register(out, stub->cpu, n);
+	*out = '\0';
+
+	return reply;
+}
+
+static const char* write_registers(GDB_Stub* stub)
+{
+	const char* in = stub->packet + 1;
+	CPU cpu = *stub->cpu;
+
+	for (long n = 0; n < GDB_REGISTER_COUNT; n++)
+	{
+		const int consumed = set_register(&cpu, n, in);
+		if (consumed < 0)
+			return "E01";
+		in += consumed;
+	}
+
+	*stub->cpu = cpu;
+	return "OK";
+}
+
+static const char* read_register(GDB_Stub* stub, char* reply)
+{
+	const char* in = stub->packet + 1;
+	const long n = get_number(&in);
+
+	if (n < 0 || n >= GDB_REGISTER_COUNT)
+		return "E01";
+
+	*put_register(reply, stub->cpu, n) = '\0';
+	return reply;
+}
+
+static const char* write_register(GDB_Stub* stub)
+{
+	const char* in = stub->packet + 1;
+	const long n = get_number(&in);
+
+	if (n < 0 || n >= GDB_REGISTER_COUNT || *in++ != '='
+		|| set_register(stub->cpu, n, in) < 0)
+		return "E01";
+
+	return "OK";
+}
+
+// Resuming at an address given with 'c' or 's'
+static void resume_at(GDB_Stub* stub)
+{
+	const char* in = stub->packet + 1;
+	const long address = get_number(&in);
+
+	if (address >= 0 && address <= 0xFFFF)
+		stub->cpu->PC = address;
+}
+
+static const char* read_target_xml(GDB_Stub* stub, char* reply)
+{
+	const char* in = stub->packet + strlen("qXfer:features:read:target.xml:");
+	const long offset = get_number(&in);
+	long length = (*in++ == ',') ? get_number(&in) : -1;
+
+	if (offset < 0 || length < 0)
+		return "E01";
+	if (offset >= (long)sizeof(target_xml) - 1)
+		return "l";
+	if (length > GDB_PACKET_SIZE - 2)
+		length = GDB_PACKET_SIZE - 2;
+
+	const long remaining = sizeof(target_xml) - 1 - offset;
+
+	reply[0] = (length < remaining) ? 'm' : 'l';
+	(void)snprintf(reply + 1, GDB_PACKET_SIZE - 1, "%.*s",
+	               (int)(length < remaining ? length : remaining),
+	               target_xml + offset);
+
+	return reply;
+}
+
+static const char* query(GDB_Stub* stub, char* reply)
+{
+	const char* packet = stub->packet;
+
+	if (strncmp(packet, "qSupported", strlen("qSupported")) == 0)
+	{
+		(void)snprintf(reply, GDB_PACKET_SIZE,
+		               "PacketSize=%x;qXfer:features:read+;"
+		               "QStartNoAckMode+;hwbreak+", GDB_PACKET_SIZE);
+		return reply;
+	}
+	if (strncmp(packet, "qXfer:features:read:target.xml:",
+	            strlen("qXfer:features:read:target.xml:")) == 0)
+		return read_target_xml(stub, reply);
+	if (strcmp(packet, "qAttached") == 0)
+		return "1";
+	if (strcmp(packet, "QStartNoAckMode") == 0)
+		return "OK";
+
+	return "";
+}
+
+const int GDB_Serve(CPU* cpu, Mem* mem, const int fd)
+{
+	GDB_Stub* stub = calloc(1, sizeof(GDB_Stub));
+	char* reply = malloc(GDB_PACKET_SIZE);
+	int result = -1;
+
+	if (stub == NULL || reply == NULL)
+	{
+		free(stub);
+		free(reply);
+		return -1;
+	}
+
+	stub->cpu = cpu;
+	stub->mem = mem;
+	stub->fd = fd;
+	set_stop(stub);
+
+	while (receive_packet(stub) >= 0)
+	{
+		const char* response;
+
+		switch (stub->packet[0])
+		{
+			case '?': response = stub->stop; break;
+			case 'g': response = read_registers(stub, reply); break;
+			case 'G': response = write_registers(stub); break;
+			case 'p': response = read_register(stub, reply); break;
+			case 'P': response = write_register(stub); break;
+			case 'm': response = read_memory(stub, reply); break;
+			case 'M': response = write_memory(stub); break;
+			case 'Z': response = trap(stub, 1); break;
+			case 'z': response = trap(stub, 0); break;
+			case 'H': response = "OK"; break;
+			case 'q': case 'Q': response = query(stub, reply); break;
+			case 'c': case 's':
+			{
+				resume_at(stub);
+				run(stub, stub->packet[0] == 's');
+				response = stub->stop;
+			} break;
+			case 'D':
+			{
+				(void)send_packet(stub, "OK");
+				result = 0;
+			} goto done;
+			case 'k': result = 1; goto done;
+			default: response = ""; break;
+		}
+
+		if (send_packet(stub, response) != 0)
+			break;
+
+		// The reply to QStartNoAckMode is the last one to be acknowledged
+		if (strcmp(stub->packet, "QStartNoAckMode") == 0)
+			stub->no_ack = 1;
+	}
+
+done:
+	free(reply);
+	free(stub);
+	return result;
+}
@@ -0,0 +1,63 @@
+#ifndef GDB_h
+#define GDB_h
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cpu.h"
+
+#define GDB_PACKET_SIZE  0x1000
+#define GDB_SLICE_CYCLES 0x100000	// Cycles run between checks for ^C
+
+/*
+ * Registers as sent by 'g' and described by target.xml:
+ * a, x, y, p (8 bits each), sp (8 bits, offset into page one), pc (16 bits).
+ */
+#define GDB_REGISTER_COUNT 6
+
+typedef struct GDB_Stub
+{
+	CPU* cpu;
+	Mem* mem;
+	int fd;						// Connection to the debugger
+	int no_ack;					// QStartNoAckMode was negotiated
+	int interrupted;			// ^C received while running
+	char stop[32];				// Reply to '?'
+
+	char input[GDB_PACKET_SIZE];
+	size_t input_position, input_size;
+	char packet[GDB_PACKET_SIZE];
+} GDB_Stub;
+
+
+/**
+ * @brief Open a listening socket on the local machine.
+ *
+ * An address containing a '/' is the path of a Unix socket, anything else is
+ * a TCP port bound to the loopback interface.
+ *
+ * @return the listening socket, -1 on failure
+*/
+const int GDB_Listen(const char* address);
+
+/**
+ * @brief Wait for a debugger to connect to a listening socket.
+ *
+ * @return the connection, -1 on failure
+*/
+const int GDB_Accept(const int listener);
+
+/**
+ * @brief Serve a debugger over an established connection.
+ *
+ * The cpu is stopped while the debugger inspects it. Continuing runs
+ * CPU_Execute at full speed in slices of GDB_SLICE_CYCLES until a breakpoint,
+ * a watchpoint, a halt or ^C stops it. Breakpoints and watchpoints are the
+ * traps of mem, so they should not be shared with other users.
+ *
+ * @return 0 once the debugger detaches, 1 if it kills the target, -1 if the
+ * connection is lost
+*/
+const int GDB_Serve(CPU* cpu, Mem* mem, const int fd);
+
+#endif // !GDB_h
@@ -0,0 +1,528 @@
+#include "lanes.h"
+
+#define LANES MOS_6502_LANES
+#define FOR_LANES(lane) for (int lane = 0; lane < LANES; lane++)
+
+#define STATUS_C 0x01
+#define STATUS_Z 0x02
+#define STATUS_I 0x04
+#define STATUS_D 0x08
+#define STATUS_V 0x40
+#define STATUS_N 0x80
+
+typedef enum
+{
+	LANE_SCALAR,		// Run on each lane through CPU_Execute
+	LANE_LDA, LANE_LDX, LANE_LDY,
+	LANE_STA, LANE_STX, LANE_STY,
+	LANE_ADC, LANE_SBC, LANE_AND, LANE_ORA, LANE_EOR,
+	LANE_CMP, LANE_CPX, LANE_CPY,
+	LANE_INC, LANE_DEC, LANE_ASL, LANE_LSR, LANE_ROL, LANE_ROR,
+	LANE_INX, LANE_INY, LANE_DEX, LANE_DEY,
+	LANE_TAX, LANE_TAY, LANE_TXA, LANE_TYA, LANE_TSX, LANE_TXS,
+	LANE_SET, LANE_CLEAR,			// Flags in argument
+	LANE_BRANCH_SET, LANE_BRANCH_CLEAR,
+	LANE_JMP, LANE_NOP,
+} Lane_Operation;
+
+typedef enum
+{
+	LANE_IMPLIED,		// Also the accumulator
+	LANE_IMMEDIATE,
+	LANE_ZEROPAGE,
+	LANE_ZEROPAGEX,
+	LANE_ZEROPAGEY,
+	LANE_ABSOLUTE,
+	LANE_ABSOLUTEX,
+	LANE_ABSOLUTEY,
+	LANE_RELATIVE,
+} Lane_Mode;
+
+typedef struct Lane_Opcode
+{
+	Byte operation;
+	Byte mode;
+	Byte cycles;
+	Byte argument;
+} Lane_Opcode;
+
+#define OP(operation, mode, cycles) { LANE_##operation, LANE_##mode, cycles, 0 }
+#define FLAG_OP(operation, flag) { LANE_##operation, LANE_IMPLIED, 2, flag }
+#define BRANCH_OP(operation, flag) { LANE_##operation, LANE_RELATIVE, 2, flag }
+
+/*
+ * The instructions executed on all lanes at once. Their timing is the same
+ * on every variant; everything else is left to the dispatch tables.
+ */
+static const Lane_Opcode lane_opcodes[256] =
+{
+	[0xA9] = OP(LDA, IMMEDIATE, 2), [0xA5] = OP(LDA, ZEROPAGE, 3),
+	[0xB5] = OP(LDA, ZEROPAGEX, 4), [0xAD] = OP(LDA, ABSOLUTE, 4),
+	[0xBD] = OP(LDA, ABSOLUTEX, 4), [0xB9] = OP(LDA, ABSOLUTEY, 4),
+	[0xA2] = OP(LDX, IMMEDIATE, 2), [0xA6] = OP(LDX, ZEROPAGE, 3),
+	[0xB6] = OP(LDX, ZEROPAGEY, 4), [0xAE] = OP(LDX, ABSOLUTE, 4),
+	[0xBE] = OP(LDX, ABSOLUTEY, 4),
+	[0xA0] = OP(LDY, IMMEDIATE, 2), [0xA4] = OP(LDY, ZEROPAGE, 3),
+	[0xB4] = OP(LDY, ZEROPAGEX, 4), [0xAC] = OP(LDY, ABSOLUTE, 4),
+	[0xBC] = OP(LDY, ABSOLUTEX, 4),
+
+	[0x85] = OP(STA, ZEROPAGE, 3), [0x95] = OP(STA, ZEROPAGEX, 4),
+	[0x8D] = OP(STA, ABSOLUTE, 4), [0x9D] = OP(STA, ABSOLUTEX, 5),
+	[0x99] = OP(STA, ABSOLUTEY, 5),
+	[0x86] = OP(STX, ZEROPAGE, 3), [0x96] = OP(STX, ZEROPAGEY, 4),
+	[0x8E] = OP(STX, ABSOLUTE, 4),
+	[0x84] = OP(STY, ZEROPAGE, 3), [0x94] = OP(STY, ZEROPAGEX, 4),
+	[0x8C] = OP(STY, ABSOLUTE, 4),
+
+#define ALU_OPS(operation, base) \
+	[base + 0x09] = OP(operation, IMMEDIATE, 2), \
+	[base + 0x05] = OP(operation, ZEROPAGE, 3), \
+	[base + 0x15] = OP(operation, ZEROPAGEX, 4), \
+	[base + 0x0D] = OP(operation, ABSOLUTE, 4), \
+	[base + 0x1D] = OP(operation, ABSOLUTEX, 4), \
+	[base + 0x19] = OP(operation, ABSOLUTEY, 4)
+
+	ALU_OPS(ORA, 0x00), ALU_OPS(AND, 0x20), ALU_OPS(EOR, 0x40),
+	ALU_OPS(ADC, 0x60), ALU_OPS(CMP, 0xC0), ALU_OPS(SBC, 0xE0),
+
+	[0xE0] = OP(CPX, IMMEDIATE, 2), [0xE4] = OP(CPX, ZEROPAGE, 3),
+	[0xEC] = OP(CPX, ABSOLUTE, 4),
+	[0xC0] = OP(CPY, IMMEDIATE, 2), [0xC4] = OP(CPY, ZEROPAGE, 3),
+	[0xCC] = OP(CPY, ABSOLUTE, 4),
+
+#define SHIFT_OPS(operation, base) \
+	[base + 0x0A] = OP(operation, IMPLIED, 2), \
+	[base + 0x06] = OP(operation, ZEROPAGE, 5), \
+	[base + 0x16] = OP(operation, ZEROPAGEX, 6), \
+	[base + 0x0E] = OP(operation, ABSOLUTE, 6)
+
+	SHIFT_OPS(ASL, 0x00), SHIFT_OPS(ROL, 0x20),
+	SHIFT_OPS(LSR, 0x40), SHIFT_OPS(ROR, 0x60),
+
+	[0xE6] = OP(INC, ZEROPAGE, 5), [0xF6] = OP(INC, ZEROPAGEX, 6),
+	[0xEE] = OP(INC, ABSOLUTE, 6),
+	[0xC6] = OP(DEC, ZEROPAGE, 5), [0xD6] = OP(DEC, ZEROPAGEX, 6),
+	[0xCE] = OP(DEC, ABSOLUTE, 6),
+
+	[0xE8] = OP(INX, IMPLIED, 2), [0xC8] = OP(INY, IMPLIED, 2),
+	[0xCA] = OP(DEX, IMPLIED, 2), [0x88] = OP(DEY, IMPLIED, 2),
+	[0xAA] = OP(TAX, IMPLIED, 2), [0xA8] = OP(TAY, IMPLIED, 2),
+	[0x8A] = OP(TXA, IMPLIED, 2), [0x98] = OP(TYA, IMPLIED, 2),
+	[0xBA] = OP(TSX, IMPLIED, 2), [0x9A] = OP(TXS, IMPLIED, 2),
+	[0xEA] = OP(NOP, IMPLIED, 2),
+
+	[0x18] = FLAG_OP(CLEAR, STATUS_C), [0x38] = FLAG_OP(SET, STATUS_C),
+	[0x58] = FLAG_OP(CLEAR, STATUS_I), [0x78] = FLAG_OP(SET, STATUS_I),
+	[0xB8] = FLAG_OP(CLEAR, STATUS_V),
+	[0xD8] = FLAG_OP(CLEAR, STATUS_D), [0xF8] = FLAG_OP(SET, STATUS_D),
+
+	[0x10] = BRANCH_OP(BRANCH_CLEAR, STATUS_N),
+	[0x30] = BRANCH_OP(BRANCH_SET, STATUS_N),
+	[0x50] = BRANCH_OP(BRANCH_CLEAR, STATUS_V),
+	[0x70] = BRANCH_OP(BRANCH_SET, STATUS_V),
+	[0x90] = BRANCH_OP(BRANCH_CLEAR, STATUS_C),
+	[0xB0] = BRANCH_OP(BRANCH_SET, STATUS_C),
+	[0xD0] = BRANCH_OP(BRANCH_CLEAR, STATUS_Z),
+	[0xF0] = BRANCH_OP(BRANCH_SET, STATUS_Z),
+
+	[0x4C] = OP(JMP, ABSOLUTE, 3),
+};
+
+const int Lanes_Initialise(Lanes* lanes,
+                           Mem** mems,
+                           const u32 count,
+                           const CPU_Variant variant)
+{
+	CPU cpu;
+
+	if (CPU_Power_On(&cpu, variant) != 0)
+		return -1;
+
+	(void)memset(lanes, 0, sizeof(*lanes));
+
+	lanes->Count = (count < LANES) ? count : LANES;
+	lanes->Opcodes = cpu.Opcodes;
+
+	for (u32 lane = 0; lane < lanes->Count; lane++)
+	{
+		lanes->Mem[lane] = mems[lane];
+		Lanes_Set_CPU(lanes, lane, &cpu);
+	}
+
+	return 0;
+}
+
+void Lanes_Get_CPU(const Lanes* lanes, const u32 lane, CPU* cpu)
+{
+	cpu->PC = lanes->PC[lane];
+	cpu->A = lanes->A[lane];
+	cpu->X = lanes->X[lane];
+	cpu->Y = lanes->Y[lane];
+	cpu->SP = lanes->SP[lane];
+	CPU_Set_Status(cpu, lanes->P[lane]);
+	cpu->Opcodes = lanes->Opcodes;
+	cpu->Halted = lanes->Halted[lane];
+	cpu->Errors = lanes->Errors[lane];
+	cpu->Trap = TRAP_NONE;
+	cpu->Trap_Address = 0;
+	cpu->Cycles = lanes->Cycles[lane];
+	cpu->Instructions = 0;		// Lanes do not count instructions
+	cpu->Coverage = NULL;		// Nor record coverage
+}
+
+void Lanes_Set_CPU(Lanes* lanes, const u32 lane, const CPU* cpu)
+{
+	lanes->PC[lane] = cpu->PC;
+	lanes->A[lane] = cpu->A;
+	lanes->X[lane] = cpu->X;
+	lanes->Y[lane] = cpu->Y;
+	lanes->SP[lane] = cpu->SP;
+	lanes->P[lane] = CPU_Get_Status(cpu);
+	lanes->Halted[lane] = cpu->Halted;
+	lanes->Errors[lane] = cpu->Errors;
+	lanes->Cycles[lane] = cpu->Cycles;
+}
+
+static void execute_scalar(Lanes* lanes, const int lane, long* remaining)
+{
+	CPU cpu;
+
+	Lanes_Get_CPU(lanes, lane, &cpu);
+	CPU_Execute(&cpu, lanes->Mem[lane], 1);
+	remaining[lane] -= cpu.Cycles - lanes->Cycles[lane];
+	Lanes_Set_CPU(lanes, lane, &cpu);
+}
+
+/*
+ * The masked loops below are written without branches on lane data so they
+ * vectorise: every lane computes the result and the mask selects whether it
+ * is kept. Only memory accesses, which go to a different image per lane, are
+ * done one lane at a time.
+ */
+#define SELECT(mask, value, old) ((mask) ? (value) : (old))
+
+static inline Byte set_nz(const Byte status, const Byte value)
+{
+	return (status & ~(STATUS_N | STATUS_Z))
+		| (value & STATUS_N)
+		| ((value == 0) * STATUS_Z);
+}
+
+static inline Byte set_flag(const Byte status,
+                            const Byte flag,
+                            const int condition)
+	{ return (status & ~flag) | (condition ? flag : 0); }
+
+// Executes the instruction at leader on every lane in mask
+static void execute_group(Lanes* lanes,
+                          const Word leader,
+                          const Byte opcode,
+                          Byte* mask,
+                          long* remaining)
+{
+	const Lane_Opcode* op = &lane_opcodes[opcode];
+	Word address[LANES] = { 0 };
+	Byte operand[LANES] = { 0 }, value[LANES] = { 0 }, penalty[LANES] = { 0 };
+
+	// Decimal arithmetic is rare, those lanes take the scalar path
+	if (op->operation == LANE_ADC || op->operation == LANE_SBC)
+		FOR_LANES(lane)
+			if (mask[lane] && (lanes->P[lane] & STATUS_D))
+			{
+				mask[lane] = 0;
+				execute_scalar(lanes, lane, remaining);
+			}
+
+	// Operands and effective addresses, from each lane's own image
+	FOR_LANES(lane)
+	{
+		if (!mask[lane])
+			continue;
+
+		const Byte* data = lanes->Mem[lane]->Data;
+		const Byte low = data[(Word)(leader + 1)];
+		const Word absolute = low | (data[(Word)(leader + 2)] << 8);
+
+		operand[lane] = low;
+		switch (op->mode)
+		{
+			case LANE_ZEROPAGE: address[lane] = low; break;
+			case LANE_ZEROPAGEX: address[lane] = (Byte)(low + lanes->X[lane]); break;
+			case LANE_ZEROPAGEY: address[lane] = (Byte)(low + lanes->Y[lane]); break;
+			case LANE_ABSOLUTE: address[lane] = absolute; break;
+			case LANE_ABSOLUTEX:
+			case LANE_ABSOLUTEY:
+			{
+				const Byte index = (op->mode == LANE_ABSOLUTEX)
+					? lanes->X[lane] : lanes->Y[lane];
+				address[lane] = absolute + index;
+				penalty[lane] = (low + index) > 0xFF;
+			} break;
+			default: break;
+		}
+
+		value[lane] = (op->mode == LANE_IMMEDIATE)
+			? low
+			: (op->mode == LANE_IMPLIED || op->mode == LANE_RELATIVE)
+				? lanes->A[lane]
+				: data[address[lane]];
+	}
+
+	Byte length = 3;
+	switch (op->mode)
+	{
+		case LANE_IMPLIED: length = 1; break;
+		case LANE_IMMEDIATE:
+		case LANE_ZEROPAGE:
+		case LANE_ZEROPAGEX:
+		case LANE_ZEROPAGEY:
+		case LANE_RELATIVE: length = 2; break;
+	}
+
+	Byte* A = lanes->A;
+	Byte* X = lanes->X;
+	Byte* Y = lanes->Y;
+	Byte* P = lanes->P;
+	Byte result[LANES];
+	Byte write = 0;		// result goes back to memory, or A when implied
+	Byte extra[LANES] = { 0 };
+	Word target[LANES];
+
+	FOR_LANES(lane)
+		target[lane] = leader + length;
+
+	switch (op->operation)
+	{
+		case LANE_LDA:
+		case LANE_LDX:
+		case LANE_LDY:
+		{
+			Byte* reg = (op->operation == LANE_LDA) ? A
+				: (op->operation == LANE_LDX) ? X : Y;
+			FOR_LANES(lane)
+			{
+				reg[lane] = SELECT(mask[lane], value[lane], reg[lane]);
+				P[lane] = SELECT(mask[lane], set_nz(P[lane], value[lane]), P[lane]);
+				extra[lane] = penalty[lane];
+			}
+		} break;
+		case LANE_STA:
+		case LANE_STX:
+		case LANE_STY:
+		{
+			const Byte* reg = (op->operation == LANE_STA) ? A
+				: (op->operation == LANE_STX) ? X : Y;
+			FOR_LANES(lane)
+				result[lane] = reg[lane];
+			write = 1;
+		} break;
+		case LANE_SBC:
+			FOR_LANES(lane)
+				value[lane] = ~value[lane];
+			/* fall through */
+		case LANE_ADC:
+			FOR_LANES(lane)
+			{
+				const Word sum = A[lane] + value[lane] + (P[lane] & STATUS_C);
+				const Byte status = set_flag(
+					set_flag(set_nz(P[lane], sum), STATUS_C, sum > 0xFF),
+					STATUS_V,
+					~(A[lane] ^ value[lane]) & (A[lane] ^ sum) & 0x80);
+				A[lane] = SELECT(mask[lane], sum, A[lane]);
+				P[lane] = SELECT(mask[lane], status, P[lane]);
+				extra[lane] = penalty[lane];
+			}
+			break;
+		case LANE_AND:
+		case LANE_ORA:
+		case LANE_EOR:
+			FOR_LANES(lane)
+			{
+				const Byte r = (op->operation == LANE_AND)
+					? A[lane] & value[lane]
+					: (op->operation == LANE_ORA)
+						? A[lane] | value[lane]
+						: A[lane] ^ value[lane];
+				A[lane] = SELECT(mask[lane], r, A[lane]);
+				P[lane] = SELECT(mask[lane], set_nz(P[lane], r), P[lane]);
+				extra[lane] = penalty[lane];
+			}
+			break;
+		case LANE_CMP:
+		case LANE_CPX:
+		case LANE_CPY:
+		{
+			const Byte* reg = (op->operation == LANE_CMP) ? A
+				: (op->operation == LANE_CPX) ? X : Y;
+			FOR_LANES(lane)
+			{
+				const Byte status = set_flag(
+					set_nz(P[lane], reg[lane] - value[lane]),
+					STATUS_C, reg[lane] >= value[lane]);
+				P[lane] = SELECT(mask[lane], status, P[lane]);
+				extra[lane] = penalty[lane];
+			}
+		} break;
+		case LANE_INC:
+		case LANE_DEC:
+			FOR_LANES(lane)
+			{
+				result[lane] = value[lane]
+					+ ((op->operation == LANE_INC) ? 1 : -1);
+				P[lane] = SELECT(mask[lane], set_nz(P[lane], result[lane]), P[lane]);
+			}
+			write = 1;
+			break;
+		case LANE_ASL:
+		case LANE_LSR:
+		case LANE_ROL:
+		case LANE_ROR:
+			FOR_LANES(lane)
+			{
+				const Byte v = value[lane];
+				const Byte carry = P[lane] & STATUS_C;
+				const int left = (op->operation == LANE_ASL
+					|| op->operation == LANE_ROL);
+				const int rotate = (op->operation == LANE_ROL
+					|| op->operation == LANE_ROR);
+				const Byte r = left
+					? (v << 1) | (rotate ? carry : 0)
+					: (v >> 1) | (rotate ? carry << 7 : 0);
+				const Byte status = set_flag(set_nz(P[lane], r), STATUS_C,
+					left ? v >> 7 : v & 1);
+				result[lane] = r;
+				P[lane] = SELECT(mask[lane], status, P[lane]);
+			}
+			write = 1;
+			break;
+		case LANE_INX:
+		case LANE_DEX:
+		case LANE_INY:
+		case LANE_DEY:
+		{
+			Byte* reg = (op->operation == LANE_INX
+				|| op->operation == LANE_DEX) ? X : Y;
+			const Byte step = (op->operation == LANE_INX
+				|| op->operation == LANE_INY) ? 1 : 0xFF;
+			FOR_LANES(lane)
+			{
+				const Byte r = reg[lane] + step;
+				reg[lane] = SELECT(mask[lane], r, reg[lane]);
+				P[lane] = SELECT(mask[lane], set_nz(P[lane], r), P[lane]);
+			}
+		} break;
+		case LANE_TAX:
+		case LANE_TAY:
+		case LANE_TXA:
+		case LANE_TYA:
+		case LANE_TSX:
+		case LANE_TXS:
+		{
+			const Byte* from = (op->operation == LANE_TAX
+				|| op->operation == LANE_TAY) ? A
+				: (op->operation == LANE_TXA || op->operation == LANE_TXS) ? X
+				: (op->operation == LANE_TYA) ? Y : lanes->SP;
+			Byte* to = (op->operation == LANE_TAX || op->operation == LANE_TSX) ? X
+				: (op->operation == LANE_TAY) ? Y
+				: (op->operation == LANE_TXS) ? lanes->SP : A;
+			FOR_LANES(lane)
+			{
+				const Byte r = from[lane];
+				to[lane] = SELECT(mask[lane], r, to[lane]);
+				if (op->operation != LANE_TXS)
+					P[lane] = SELECT(mask[lane], set_nz(P[lane], r), P[lane]);
+			}
+		} break;
+		case LANE_SET:
+			FOR_LANES(lane)
+				P[lane] = SELECT(mask[lane], P[lane] | op->argument, P[lane]);
+			break;
+		case LANE_CLEAR:
+			FOR_LANES(lane)
+				P[lane] = SELECT(mask[lane], P[lane] & ~op->argument, P[lane]);
+			break;
+		case LANE_BRANCH_SET:
+		case LANE_BRANCH_CLEAR:
+			FOR_LANES(lane)
+			{
+				const Word next = leader + 2;
+				const Word taken_to = next + (signed char)operand[lane];
+				const int taken = ((P[lane] & op->argument) != 0)
+					== (op->operation == LANE_BRANCH_SET);
+				target[lane] = taken ? taken_to : next;
+				extra[lane] = taken
+					? 1 + (((next ^ taken_to) & 0xFF00) != 0) : 0;
+			}
+			break;
+		case LANE_JMP:
+			FOR_LANES(lane)
+				target[lane] = address[lane];
+			break;
+		default:
+			break;
+	}
+
+	// Results of stores and read-modify-write instructions
+	if (write)
+		FOR_LANES(lane)
+		{
+			if (!mask[lane])
+				continue;
+			if (op->mode == LANE_IMPLIED)
+				A[lane] = result[lane];
+			else
+				lanes->Mem[lane]->Data[address[lane]] = result[lane];
+		}
+
+	FOR_LANES(lane)
+	{
+		const long used = op->cycles + extra[lane];
+		lanes->PC[lane] = SELECT(mask[lane], target[lane], lanes->PC[lane]);
+		lanes->Cycles[lane] += mask[lane] ? used : 0;
+		remaining[lane] -= mask[lane] ? used : 0;
+	}
+}
+
+void Lanes_Execute(Lanes* lanes, const u32 cycles)
+{
+	long remaining[LANES];
+	Byte mask[LANES];
+
+	FOR_LANES(lane)
+		remaining[lane] = ((u32)lane < lanes->Count) ? (long)cycles : 0;
+
+	for (;;)
+	{
+		// The lowest PC runs next, so lanes that diverged meet again
+		long leader = -1;
+		FOR_LANES(lane)
+			if (remaining[lane] > 0 && !lanes->Halted[lane]
+				&& (leader < 0 || lanes->PC[lane] < leader))
+				leader = lanes->PC[lane];
+
+		if (leader < 0)
+			return;
+
+		int first = -1;
+		FOR_LANES(lane)
+			if (remaining[lane] > 0 && !lanes->Halted[lane]
+				&& lanes->PC[lane] == leader && first < 0)
+				first = lane;
+
+		const Byte opcode = lanes->Mem[first]->Data[leader];
+
+		FOR_LANES(lane)
+			mask[lane] = remaining[lane] > 0 && !lanes->Halted[lane]
+				&& lanes->PC[lane] == leader
+				&& lanes->Mem[lane]->Data[leader] == opcode;
+
+		if (lane_opcodes[opcode].operation == LANE_SCALAR)
+		{
+			FOR_LANES(lane)
+				if (mask[lane])
+					execute_scalar(lanes, lane, remaining);
+		}
+		else
+			execute_group(lanes, leader, opcode, mask, remaining);
+	}
+}
@@ -0,0 +1,66 @@
+#ifndef LANES_h
+#define LANES_h
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cpu.h"
+
+// Experimental, lanes per group; 8 or 16 fill a vector register
+#ifndef MOS_6502_LANES
+#define MOS_6502_LANES 16
+#endif
+
+/*
+ * A group of cpus executing the same programme in lockstep. Registers are
+ * stored as one array per register, so an instruction is applied to every
+ * lane at once by loops the compiler turns into vector instructions. Each
+ * lane has its own memory image.
+ */
+typedef struct Lanes
+{
+	Word PC[MOS_6502_LANES];
+	Byte A[MOS_6502_LANES];
+	Byte X[MOS_6502_LANES];
+	Byte Y[MOS_6502_LANES];
+	Byte SP[MOS_6502_LANES];
+	Byte P[MOS_6502_LANES];			// Status as pushed, see CPU_Get_Status
+	Byte Halted[MOS_6502_LANES];
+	Byte Errors[MOS_6502_LANES];
+	u64 Cycles[MOS_6502_LANES];
+
+	Mem* Mem[MOS_6502_LANES];
+	u32 Count;						// Lanes in use, at most MOS_6502_LANES
+	const struct Opcode* Opcodes;		// Dispatch table of the variant
+} Lanes;
+
+
+/**
+ * @brief Power on count lanes of the given variant.
+ *
+ * Unlike CPU_Initialise the memory images are left untouched, so they can be
+ * prepared before or after. Lanes past count are never executed.
+ *
+ * @return 0, or -1 if the variant is invalid
+*/
+const int Lanes_Initialise(Lanes* lanes,
+                           Mem** mems,
+                           const u32 count,
+                           const CPU_Variant variant);
+void Lanes_Get_CPU(const Lanes* lanes, const u32 lane, CPU* cpu);
+void Lanes_Set_CPU(Lanes* lanes, const u32 lane, const CPU* cpu);
+
+/**
+ * @brief Run every lane for the given number of cycles.
+ *
+ * Each step executes the lowest PC of all running lanes on every lane at
+ * that PC holding the same opcode; the others are masked off until their PC
+ * is the lowest, which also lets lanes that took different branches
+ * converge again. Common documented instructions run on all masked lanes at
+ * once, the rest, and decimal arithmetic, run on each lane through
+ * CPU_Execute. Results are identical to running every lane on its own, but
+ * traps are ignored.
+*/
+void Lanes_Execute(Lanes* lanes, const u32 cycles);
+
+#endif // !LANES_h
@@ -0,0 +1,319 @@
+#include "perf.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define CALIBRATION_READS 64
+
+static const char* class_names[PERF_CLASSES] =
+{
+	[PERF_CLASS_LOAD] = "load",
+	[PERF_CLASS_STORE] = "store",
+	[PERF_CLASS_ALU] = "alu",
+	[PERF_CLASS_MODIFY] = "modify",
+	[PERF_CLASS_BRANCH] = "branch",
+	[PERF_CLASS_JUMP] = "jump",
+	[PERF_CLASS_STACK] = "stack",
+	[PERF_CLASS_REGISTER] = "register",
+	[PERF_CLASS_OTHER] = "other",
+};
+
+static const char* counter_names[PERF_COUNTERS] =
+{
+	[PERF_CYCLES] = "cycles",
+	[PERF_INSTRUCTIONS] = "instructions",
+	[PERF_BRANCH_MISSES] = "branch_misses",
+	[PERF_L1D_MISSES] = "l1d_misses",
+};
+
+#ifdef __linux__
+static int open_counter(const Perf_Counter counter, const int leader)
+{
+	struct perf_event_attr attr;
+
+	(void)memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.disabled = (leader < 0);
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP;
+
+	switch (counter)
+	{
+		case PERF_CYCLES: attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+		case PERF_INSTRUCTIONS: attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+		case PERF_BRANCH_MISSES: attr.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+		case PERF_L1D_MISSES:
+		{
+			attr.type = PERF_TYPE_HW_CACHE;
+			attr.config = PERF_COUNT_HW_CACHE_L1D
+				| (PERF_COUNT_HW_CACHE_OP_READ << 8)
+				| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		} break;
+		default: return -1;
+	}
+
+	return syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+}
+#endif
+
+// Counters that are not open read as 0
+static int read_counters(const Perf* perf, u64* counts)
+{
+	(void)memset(counts, 0, sizeof(u64) * PERF_COUNTERS);
+
+#ifdef __linux__
+	u64 values[1 + PERF_COUNTERS];	// Number of counters, then their values
+	const ssize_t size = sizeof(u64) * (1 + perf->Open);
+
+	if (perf->Open == 0
+		|| read(perf->Fds[PERF_CYCLES], values, size) != size)
+		return -1;
+
+	for (int counter = 0; counter < PERF_COUNTERS; counter++)
+		if (perf->Slots[counter] >= 0)
+			counts[counter] = values[1 + perf->Slots[counter]];
+
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+// Reading the counters twice in a row, the minimum is what a read costs
+static void calibrate(Perf* perf)
+{
+	u64 before[PERF_COUNTERS], after[PERF_COUNTERS];
+
+	for (int counter = 0; counter < PERF_COUNTERS; counter++)
+		perf->Overhead[counter] = (u64)-1;
+
+	for (int i = 0; i < CALIBRATION_READS; i++)
+	{
+		(void)read_counters(perf, before);
+		(void)read_counters(perf, after);
+
+		for (int counter = 0; counter < PERF_COUNTERS; counter++)
+			if (after[counter] - before[counter] < perf->Overhead[counter])
+				perf->Overhead[counter] = after[counter] - before[counter];
+	}
+}
+
+const int Perf_Open(Perf* perf, const CPU_Variant variant)
+{
+	(void)memset(perf, 0, sizeof(Perf));
+	perf->Variant = variant;
+
+	for (int counter = 0; counter < PERF_COUNTERS; counter++)
+	{
+		perf->Fds[counter] = -1;
+		perf->Slots[counter] = -1;
+	}
+
+#ifdef __linux__
+	for (int counter = 0; counter < PERF_COUNTERS; counter++)
+	{
+		perf->Fds[counter] = open_counter(counter, perf->Fds[PERF_CYCLES]);
+
+		if (perf->Fds[counter] < 0 && counter == PERF_CYCLES)
+			return -1;
+		if (perf->Fds[counter] >= 0)
+			perf->Slots[counter] = perf->Open++;
+	}
+
+	(void)ioctl(perf->Fds[PERF_CYCLES], PERF_EVENT_IOC_RESET,
+	            PERF_IOC_FLAG_GROUP);
+	(void)ioctl(perf->Fds[PERF_CYCLES], PERF_EVENT_IOC_ENABLE,
+	            PERF_IOC_FLAG_GROUP);
+
+	calibrate(perf);
+	return perf->Open;
+#else
+	return -1;
+#endif
+}
+
+void Perf_Close(Perf* perf)
+{
+	for (int counter = 0; counter < PERF_COUNTERS; counter++)
+	{
+#ifdef __linux__
+		if (perf->Fds[counter] >= 0)
+			(void)close(perf->Fds[counter]);
+#endif
+		perf->Fds[counter] = -1;
+		perf->Slots[counter] = -1;
+	}
+
+	perf->Open = 0;
+}
+
+const int Perf_Has(const Perf* perf, const Perf_Counter counter)
+{
+	return counter < PERF_COUNTERS && perf->Slots[counter] >= 0;
+}
+
+static void add_sample(Perf_Sample* sample,
+                       const Perf* perf,
+                       const u64* before,
+                       const u64* after)
+{
+	for (int counter = 0; counter < PERF_COUNTERS; counter++)
+	{
+		const u64 events = after[counter] - before[counter];
+
+		sample->Counts[counter] += (events > perf->Overhead[counter])
+			? events - perf->Overhead[counter] : 0;
+	}
+}
+
+const Halt_Reason Perf_Execute(Perf* perf,
+                               CPU* cpu,
+                               Mem* mem,
+                               const u32 cycles)
+{
+	u64 before[PERF_COUNTERS], after[PERF_COUNTERS];
+	const u64 instructions = cpu->Instructions;
+	const u64 emulated = cpu->Cycles;
+
+	(void)read_counters(perf, before);
+	const Halt_Reason reason = CPU_Execute(cpu, mem, cycles);
+	(void)read_counters(perf, after);
+
+	add_sample(&perf->Total, perf, before, after);
+	perf->Total.Instructions += cpu->Instructions - instructions;
+	perf->Total.Cycles += cpu->Cycles - emulated;
+
+	return reason;
+}
+
+const Halt_Reason Perf_Step(Perf* perf, CPU* cpu, Mem* mem)
+{
+	u64 before[PERF_COUNTERS], after[PERF_COUNTERS];
+	const u64 instructions = cpu->Instructions;
+	const u64 emulated = cpu->Cycles;
+	Perf_Sample* class =
+		&perf->Classes[Perf_Classify(perf->Variant, Get_Memory(mem, cpu->PC))];
+
+	(void)read_counters(perf, before);
+	const Halt_Reason reason = CPU_Execute(cpu, mem, 1);
+	(void)read_counters(perf, after);
+
+	add_sample(&perf->Total, perf, before, after);
+	add_sample(class, perf, before, after);
+
+	perf->Total.Instructions += cpu->Instructions - instructions;
+	perf->Total.Cycles += cpu->Cycles - emulated;
+	class->Instructions += cpu->Instructions - instructions;
+	class->Cycles += cpu->Cycles - emulated;
+
+	return reason;
+}
+
+const double Perf_Cost(const Perf_Sample* sample,
+                       const Perf_Counter counter)
+{
+	if (sample->Instructions == 0 || counter >= PERF_COUNTERS)
+		return 0;
+
+	return (double)sample->Counts[counter] / sample->Instructions;
+}
+
+// Classes by mnemonic; BBRn, BBSn, RMBn and SMBn match on their first three
+static const struct
+{
+	const char* Mnemonic;
+	Perf_Class Class;
+} mnemonic_classes[] =
+{
+	{ "LDA", PERF_CLASS_LOAD }, { "LDX", PERF_CLASS_LOAD },
+	{ "LDY", PERF_CLASS_LOAD }, { "LAX", PERF_CLASS_LOAD },
+	{ "LAS", PERF_CLASS_LOAD },
+	{ "STA", PERF_CLASS_STORE }, { "STX", PERF_CLASS_STORE },
+	{ "STY", PERF_CLASS_STORE }, { "STZ", PERF_CLASS_STORE },
+	{ "SAX", PERF_CLASS_STORE }, { "SHA", PERF_CLASS_STORE },
+	{ "SHX", PERF_CLASS_STORE }, { "SHY", PERF_CLASS_STORE },
+	{ "TAS", PERF_CLASS_STORE },
+	{ "ADC", PERF_CLASS_ALU }, { "SBC", PERF_CLASS_ALU },
+	{ "AND", PERF_CLASS_ALU }, { "ORA", PERF_CLASS_ALU },
+	{ "EOR", PERF_CLASS_ALU }, { "CMP", PERF_CLASS_ALU },
+	{ "CPX", PERF_CLASS_ALU }, { "CPY", PERF_CLASS_ALU },
+	{ "BIT", PERF_CLASS_ALU }, { "ANC", PERF_CLASS_ALU },
+	{ "ALR", PERF_CLASS_ALU }, { "ARR", PERF_CLASS_ALU },
+	{ "SBX", PERF_CLASS_ALU }, { "XAA", PERF_CLASS_ALU },
+	{ "LXA", PERF_CLASS_ALU },
+	{ "ASL", PERF_CLASS_MODIFY }, { "LSR", PERF_CLASS_MODIFY },
+	{ "ROL", PERF_CLASS_MODIFY }, { "ROR", PERF_CLASS_MODIFY },
+	{ "INC", PERF_CLASS_MODIFY }, { "DEC", PERF_CLASS_MODIFY },
+	{ "SLO", PERF_CLASS_MODIFY }, { "RLA", PERF_CLASS_MODIFY },
+	{ "SRE", PERF_CLASS_MODIFY }, { "RRA", PERF_CLASS_MODIFY },
+	{ "DCP", PERF_CLASS_MODIFY }, { "ISC", PERF_CLASS_MODIFY },
+	{ "TSB", PERF_CLASS_MODIFY }, { "TRB", PERF_CLASS_MODIFY },
+	{ "RMB", PERF_CLASS_MODIFY }, { "SMB", PERF_CLASS_MODIFY },
+	{ "BCC", PERF_CLASS_BRANCH }, { "BCS", PERF_CLASS_BRANCH },
+	{ "BEQ", PERF_CLASS_BRANCH }, { "BNE", PERF_CLASS_BRANCH },
+	{ "BMI", PERF_CLASS_BRANCH }, { "BPL", PERF_CLASS_BRANCH },
+	{ "BVC", PERF_CLASS_BRANCH }, { "BVS", PERF_CLASS_BRANCH },
+	{ "BRA", PERF_CLASS_BRANCH }, { "BBR", PERF_CLASS_BRANCH },
+	{ "BBS", PERF_CLASS_BRANCH },
+	{ "JMP", PERF_CLASS_JUMP }, { "JSR", PERF_CLASS_JUMP },
+	{ "RTS", PERF_CLASS_JUMP }, { "RTI", PERF_CLASS_JUMP },
+	{ "BRK", PERF_CLASS_JUMP },
+	{ "PHA", PERF_CLASS_STACK }, { "PHP", PERF_CLASS_STACK },
+	{ "PHX", PERF_CLASS_STACK }, { "PHY", PERF_CLASS_STACK },
+	{ "PLA", PERF_CLASS_STACK }, { "PLP", PERF_CLASS_STACK },
+	{ "PLX", PERF_CLASS_STACK }, { "PLY", PERF_CLASS_STACK },
+	{ "TAX", PERF_CLASS_REGISTER }, { "TAY", PERF_CLASS_REGISTER },
+	{ "TSX", PERF_CLASS_REGISTER }, { "TXA", PERF_CLASS_REGISTER },
+	{ "TXS", PERF_CLASS_REGISTER }, { "TYA", PERF_CLASS_REGISTER },
+	{ "INX", PERF_CLASS_REGISTER }, { "INY", PERF_CLASS_REGISTER },
+	{ "DEX", PERF_CLASS_REGISTER }, { "DEY", PERF_CLASS_REGISTER },
+	{ "CLC", PERF_CLASS_REGISTER }, { "CLD", PERF_CLASS_REGISTER },
+	{ "CLI", PERF_CLASS_REGISTER }, { "CLV", PERF_CLASS_REGISTER },
+	{ "SEC", PERF_CLASS_REGISTER }, { "SED", PERF_CLASS_REGISTER },
+	{ "SEI", PERF_CLASS_REGISTER },
+};
+
+/*
+ * Taken from the opcode metadata, so every variant classes an opcode by what
+ * it does there. NOPs, halts and the opcodes the strict variant treats as
+ * illegal match no mnemonic and are left as other.
+*/
+const Perf_Class Perf_Classify(const CPU_Variant variant, const Byte opcode)
+{
+	const Opcode_Info* info = CPU_Opcode_Info(variant, opcode);
+
+	if (info == NULL)
+		return PERF_CLASS_OTHER;
+
+	const size_t count = sizeof(mnemonic_classes) / sizeof(mnemonic_classes[0]);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (strncmp(info->Mnemonic, mnemonic_classes[i].Mnemonic, 3) != 0)
+			continue;
+
+		// Shifts, INC and DEC only change a register in accumulator mode
+		if (mnemonic_classes[i].Class == PERF_CLASS_MODIFY
+			&& info->Mode == MODE_ACCUMULATOR)
+			return PERF_CLASS_REGISTER;
+		return mnemonic_classes[i].Class;
+	}
+
+	return PERF_CLASS_OTHER;
+}
+
+const char* Perf_Class_Name(const Perf_Class class)
+{
+	return (class < PERF_CLASSES) ? class_names[class] : "unknown";
+}
+
+const char* Perf_Counter_Name(const Perf_Counter counter)
+{
+	return (counter < PERF_COUNTERS) ? counter_names[counter] : "unknown";
+}
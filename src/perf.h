@@ -0,0 +1,104 @@
+#ifndef PERF_h
+#define PERF_h
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cpu.h"
+
+// Host events counted around CPU_Execute
+typedef enum
+{
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_BRANCH_MISSES,
+	PERF_L1D_MISSES,		// Level 1 data cache read misses
+	PERF_COUNTERS,
+} Perf_Counter;
+
+// Groups of opcodes with similar dispatch and memory behaviour
+typedef enum
+{
+	PERF_CLASS_LOAD,		// LDA, LDX, LDY, LAX, LAS
+	PERF_CLASS_STORE,		// STA, STX, STY, STZ and the undocumented ones
+	PERF_CLASS_ALU,			// Arithmetic, logic, compares and BIT
+	PERF_CLASS_MODIFY,		// Read-modify-write on memory
+	PERF_CLASS_BRANCH,		// Conditional branches, BRA, BBR and BBS
+	PERF_CLASS_JUMP,		// JMP, JSR, RTS, RTI and BRK
+	PERF_CLASS_STACK,		// Pushes and pulls
+	PERF_CLASS_REGISTER,	// Implied: transfers, flags, INX... and A shifts
+	PERF_CLASS_OTHER,		// NOPs, halts and the opcodes illegal on the variant
+	PERF_CLASSES,
+} Perf_Class;
+
+typedef struct Perf_Sample
+{
+	u64 Counts[PERF_COUNTERS];	// Host events, indexed by Perf_Counter
+	u64 Instructions;			// Emulated instructions
+	u64 Cycles;					// Emulated cycles
+} Perf_Sample;
+
+/*
+ * The counters of the calling thread, opened as one group so they are read
+ * together and always cover the same instructions. Only the host cycles are
+ * required, the others are left out where the host does not have them.
+ */
+typedef struct Perf
+{
+	int Fds[PERF_COUNTERS];			// -1 where the counter is not available
+	int Slots[PERF_COUNTERS];		// Position in a group read
+	int Open;						// Number of counters in the group
+	CPU_Variant Variant;			// Used to classify the opcodes
+	u64 Overhead[PERF_COUNTERS];	// Events spent reading the counters
+	Perf_Sample Total;
+	Perf_Sample Classes[PERF_CLASSES];
+} Perf;
+
+
+/**
+ * @brief Open the host counters for the calling thread.
+ *
+ * The Linux perf_event_open interface is used, counting user space only.
+ * Samples are still collected without counters, they just count emulated
+ * instructions and cycles, so a failure need not be fatal.
+ *
+ * @return the number of counters opened, -1 if there are none
+*/
+const int Perf_Open(Perf* perf, const CPU_Variant variant);
+void Perf_Close(Perf* perf);
+
+/**
+ * @brief Whether a counter was opened, i.e. its counts mean anything.
+*/
+const int Perf_Has(const Perf* perf, const Perf_Counter counter);
+
+/**
+ * @brief Run CPU_Execute at full speed and add what it cost to perf->Total.
+*/
+const Halt_Reason Perf_Execute(Perf* perf,
+                               CPU* cpu,
+                               Mem* mem,
+                               const u32 cycles);
+
+/**
+ * @brief Execute one instruction and add what it cost to perf->Total and to
+ * the class of its opcode.
+ *
+ * The counters are read around every instruction, so the cost of reading
+ * them, measured by Perf_Open, is subtracted. What is left is still
+ * inflated by the extra work of stepping; compare classes with each other
+ * rather than with the totals of Perf_Execute.
+*/
+const Halt_Reason Perf_Step(Perf* perf, CPU* cpu, Mem* mem);
+
+/**
+ * @brief Host events per emulated instruction, 0 if nothing was executed.
+*/
+const double Perf_Cost(const Perf_Sample* sample,
+                       const Perf_Counter counter);
+
+const Perf_Class Perf_Classify(const CPU_Variant variant, const Byte opcode);
+const char* Perf_Class_Name(const Perf_Class class);
+const char* Perf_Counter_Name(const Perf_Counter counter);
+
+#endif // !PERF_h
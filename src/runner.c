@@ -1,228 +1,1571 @@
-/*
- * A lexer, parser and interpreter that allows you to execute assembly code
- * from a file.
- */
-
-#include <ctype.h>
-
-#include "util.h"
-#include "runner.h"
-
-const char* token_name(const TokenType type)
-{
-    switch(type)
-    {
-        case TOKEN_EOF: return "EOF";
-        case TOKEN_NUM: return "NUM";
-        case TOKEN_ID: return "ID";
-        case TOKEN_COMMENT: return "COMMENT";
-        case TOKEN_IMMD: return "IMMEDIATE";
-        case TOKEN_HEXNUM: return "HEXADECIMAL";
-        case TOKEN_LPAREN: return "LPAREN";
-        case TOKEN_RPAREN: return "RPAREN";
-        default: return "ILLEGAL";
-    }
-}
-
-TokenList* tokenlist_initialise(size_t capacity)
-{
-    TokenList* list = malloc(sizeof(TokenList));
-    list->capacity = capacity;
-    list->current_size = 0;
-    list->contents = malloc(sizeof(Token) * capacity);
-
-    return list;
-}
-
-void tokenlist_free(TokenList* list)
-{
-    free(list->contents);
-    free(list);
-}
-
-const int tokenlist_resize(TokenList* list, const size_t capacity)
-{
-    Token* new_contents = realloc(list->contents, sizeof(Token) * capacity);
-    if (new_contents == NULL)
-        return -1;
-
-    list->contents = new_contents;
-    list->capacity = capacity;
-    if (capacity < list->current_size)
-        list->current_size = capacity;
-
-    return 0;
-}
-
-const int tokenlist_append(TokenList* list, const Token token)
-{
-    if (list->capacity <= list->current_size)
-        return tokenlist_resize(list, list->capacity * 1.5);
-
-    list->contents[list->current_size] = token;
-    list->current_size++;
-
-    return 0;
-}
-
-const Token tokenlist_get(TokenList* list, size_t index)
-    { return list->contents[index]; }
-
-int is_label_char(const char input)
-    { return (isalnum(input) || input == '_'); }
-
-Lexer Lexer_Initialise(const char* contents, const size_t contents_size)
-{
-    Lexer lexer = {0};
-    lexer.contents = contents;
-    lexer.contents_size = contents_size;
-
-    return lexer;
-}
-
-const char Lexer_Consume(Lexer* lexer)
-{
-    assert(lexer->position < lexer->contents_size);
-
-    char current_symbol = lexer->contents[lexer->position];
-    lexer->position++;
-
-    if (current_symbol == '\n')
-    {
-        lexer->line++;
-        lexer->beginning_of_line = lexer->position;
-    }
-
-    return current_symbol;
-}
-
-void trim_left(Lexer* lexer)
-{
-    while(lexer->position < lexer->contents_size 
-        && isspace(lexer->contents[lexer->position]))
-        (void)Lexer_Consume(lexer);
-}
-
-const Token Lexer_Advance(Lexer* lexer)
-{
-    trim_left(lexer);
-
-    Token token = 
-    {
-        .value = &lexer->contents[lexer->position],
-    };
-
-    if (lexer->position >= lexer->contents_size)
-        return token;
-
-    switch (lexer->contents[lexer->position])
-    {
-        case EOF:
-        {
-            token.type = TOKEN_EOF;
-        } break;
-        case ';':
-        {
-            token.type = TOKEN_COMMENT;
-
-            while (lexer->position < lexer->contents_size
-                && lexer->contents[lexer->position] != '\n')
-            {
-                token.value_size++;
-                (void)Lexer_Consume(lexer);
-            }
-            
-            if (lexer->position < lexer->contents_size)
-                (void)Lexer_Consume(lexer);
-
-        } break;
-        case '#':
-        {
-            token.type = TOKEN_IMMD;
-            
-            while (lexer->position < lexer->contents_size
-                && !isspace(lexer->contents[lexer->position]))
-            {
-                token.value_size++;
-                (void)Lexer_Consume(lexer);
-            }
-
-            if (lexer->position < lexer->contents_size)
-                (void)Lexer_Consume(lexer);
-        } break;
-        case '$':
-        {
-            token.type = TOKEN_HEXNUM;
-            
-            while (lexer->position < lexer->contents_size
-                && !isspace(lexer->contents[lexer->position]))
-            {
-                token.value_size++;
-                (void)Lexer_Consume(lexer);
-            }
-
-            if (lexer->position < lexer->contents_size)
-                (void)Lexer_Consume(lexer);
-        } break;
-        case '(':
-        {
-            token.type = TOKEN_LPAREN;
-            token.value_size = 1;
-            lexer->position++;
-        } break;
-        case ')':
-        {
-            token.type = TOKEN_RPAREN;
-            token.value_size = 1;
-            lexer->position++;
-        } break;
-        default:
-        {    
-            if (isalpha(lexer->contents[lexer->position])
-                || lexer->contents[lexer->position] == '_')
-            {
-                token.type = TOKEN_ID;
-                while (lexer->position < lexer->contents_size 
-                    && is_label_char(lexer->contents[lexer->position]))
-                {
-                    lexer->position++;
-                    token.value_size++;
-                }
-
-                return token;
-            }
-            else    // Illegal/undefined
-            {
-                token.type = TOKEN_INVALID;
-                while (lexer->position < lexer->contents_size
-                    && !isspace(lexer->contents[lexer->position]))
-                {
-                    lexer->position++;
-                    token.value_size++;
-                }
-
-                return token;
-            }
-        }
-    }
-    
-    return token;
-}
-
-TokenList* Lexer_Run(Lexer* lexer)
-{
-    TokenList* destination = tokenlist_initialise(123);
-    if (destination == NULL)
-        die("TokenList initialisation failed!");
-
-    Token token = Lexer_Advance(lexer);
-
-    while (token.type != TOKEN_EOF)
-	{
-		tokenlist_append(destination, token);
-
-		token = Lexer_Advance(lexer);
-	}
-
-    return destination;
-}
+/*
+ * A lexer, parser and interpreter that allows you to execute assembly code
+ * from a file.
+ */
+
+#include <ctype.h>
+#include <limits.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+#include "util.h"
+#include "runner.h"
+
+const char* token_name(const TokenType type)
+{
+    switch(type)
+    {
+        case TOKEN_EOF: return "EOF";
+        case TOKEN_NUM: return "NUM";
+        case TOKEN_ID: return "ID";
+        case TOKEN_COMMENT: return "COMMENT";
+        case TOKEN_IMMD: return "IMMEDIATE";
+        case TOKEN_HEXNUM: return "HEXADECIMAL";
+        case TOKEN_LPAREN: return "LPAREN";
+        case TOKEN_RPAREN: return "RPAREN";
+        case TOKEN_COMMA: return "COMMA";
+        case TOKEN_COLON: return "COLON";
+        case TOKEN_DIRECTIVE: return "DIRECTIVE";
+        case TOKEN_STRING: return "STRING";
+        case TOKEN_OPERATOR: return "OPERATOR";
+        case TOKEN_EOL: return "EOL";
+        default: return "ILLEGAL";
+    }
+}
+
+TokenList* tokenlist_initialise(size_t capacity)
+{
+    TokenList* list = malloc(sizeof(TokenList));
+    if (list == NULL)
+        return NULL;
+
+    list->capacity = capacity;
+    list->current_size = 0;
+    list->contents = malloc(sizeof(Token) * capacity);
+    if (list->contents == NULL)
+    {
+        free(list);
+        return NULL;
+    }
+
+    return list;
+}
+
+void tokenlist_free(TokenList* list)
+{
+    free(list->contents);
+    free(list);
+}
+
+const int tokenlist_resize(TokenList* list, const size_t capacity)
+{
+    Token* new_contents = realloc(list->contents, sizeof(Token) * capacity);
+    if (new_contents == NULL)
+        return -1;
+
+    list->contents = new_contents;
+    list->capacity = capacity;
+    if (capacity < list->current_size)
+        list->current_size = capacity;
+
+    return 0;
+}
+
+const int tokenlist_append(TokenList* list, const Token token)
+{
+    if (list->capacity <= list->current_size
+        && tokenlist_resize(list, list->capacity * 1.5 + 1) != 0)
+        return -1;
+
+    list->contents[list->current_size] = token;
+    list->current_size++;
+
+    return 0;
+}
+
+const Token tokenlist_get(TokenList* list, size_t index)
+    { return list->contents[index]; }
+
+int is_label_char(const char input)
+    { return (isalnum(input) || input == '_'); }
+
+Lexer Lexer_Initialise(const char* contents, const size_t contents_size)
+{
+    Lexer lexer = {0};
+    lexer.contents = contents;
+    lexer.contents_size = contents_size;
+
+    return lexer;
+}
+
+const char Lexer_Consume(Lexer* lexer)
+{
+    assert(lexer->position < lexer->contents_size);
+
+    char current_symbol = lexer->contents[lexer->position];
+    lexer->position++;
+
+    if (current_symbol == '\n')
+    {
+        lexer->line++;
+        lexer->beginning_of_line = lexer->position;
+    }
+
+    return current_symbol;
+}
+
+void trim_left(Lexer* lexer)
+{
+    while(lexer->position < lexer->contents_size 
+        && isspace(lexer->contents[lexer->position]))
+        (void)Lexer_Consume(lexer);
+}
+
+const Token Lexer_Advance(Lexer* lexer)
+{
+    trim_left(lexer);
+
+    Token token = 
+    {
+        .value = &lexer->contents[lexer->position],
+        .line = lexer->line,
+    };
+
+    if (lexer->position >= lexer->contents_size)
+        return token;
+
+    switch (lexer->contents[lexer->position])
+    {
+        case EOF:
+        {
+            token.type = TOKEN_EOF;
+        } break;
+        case ';':
+        {
+            token.type = TOKEN_COMMENT;
+
+            while (lexer->position < lexer->contents_size
+                && lexer->contents[lexer->position] != '\n')
+            {
+                token.value_size++;
+                (void)Lexer_Consume(lexer);
+            }
+            
+            if (lexer->position < lexer->contents_size)
+                (void)Lexer_Consume(lexer);
+
+        } break;
+        case '#':
+        {
+            token.type = TOKEN_IMMD;
+            token.value_size = 1;
+            lexer->position++;
+        } break;
+        case '.':
+        {
+            token.type = TOKEN_DIRECTIVE;
+            token.value_size = 1;
+            lexer->position++;
+
+            while (lexer->position < lexer->contents_size
+                && is_label_char(lexer->contents[lexer->position]))
+            {
+                token.value_size++;
+                lexer->position++;
+            }
+
+            if (token.value_size == 1)
+                token.type = TOKEN_INVALID;
+        } break;
+        case '"':
+        {
+            token.type = TOKEN_INVALID;
+            token.value_size = 1;
+            lexer->position++;
+
+            while (lexer->position < lexer->contents_size
+                && lexer->contents[lexer->position] != '\n')
+            {
+                token.value_size++;
+                if (lexer->contents[lexer->position++] == '"')
+                {
+                    token.type = TOKEN_STRING;
+                    break;
+                }
+            }
+        } break;
+        case '+': case '-': case '*': case '/': case '&':
+        case '|': case '^': case '~': case '<': case '>': case '=':
+        {
+            token.type = TOKEN_OPERATOR;
+            token.value_size = 1;
+            lexer->position++;
+        } break;
+        case '$':
+        {
+            token.type = TOKEN_HEXNUM;
+            token.value_size = 1;
+            (void)Lexer_Consume(lexer);
+
+            while (lexer->position < lexer->contents_size
+                && isxdigit(lexer->contents[lexer->position]))
+            {
+                token.value_size++;
+                (void)Lexer_Consume(lexer);
+            }
+        } break;
+        case '%':
+        {
+            token.type = TOKEN_NUM;
+            token.value_size = 1;
+            (void)Lexer_Consume(lexer);
+
+            while (lexer->position < lexer->contents_size
+                && (lexer->contents[lexer->position] == '0'
+                    || lexer->contents[lexer->position] == '1'))
+            {
+                token.value_size++;
+                (void)Lexer_Consume(lexer);
+            }
+        } break;
+        case '(':
+        {
+            token.type = TOKEN_LPAREN;
+            token.value_size = 1;
+            lexer->position++;
+        } break;
+        case ')':
+        {
+            token.type = TOKEN_RPAREN;
+            token.value_size = 1;
+            lexer->position++;
+        } break;
+        case ',':
+        {
+            token.type = TOKEN_COMMA;
+            token.value_size = 1;
+            lexer->position++;
+        } break;
+        case ':':
+        {
+            token.type = TOKEN_COLON;
+            token.value_size = 1;
+            lexer->position++;
+        } break;
+        default:
+        {    
+            if (isdigit(lexer->contents[lexer->position]))
+            {
+                token.type = TOKEN_NUM;
+                while (lexer->position < lexer->contents_size 
+                    && isdigit(lexer->contents[lexer->position]))
+                {
+                    lexer->position++;
+                    token.value_size++;
+                }
+
+                return token;
+            }
+            else if (isalpha(lexer->contents[lexer->position])
+                || lexer->contents[lexer->position] == '_')
+            {
+                token.type = TOKEN_ID;
+                while (lexer->position < lexer->contents_size 
+                    && is_label_char(lexer->contents[lexer->position]))
+                {
+                    lexer->position++;
+                    token.value_size++;
+                }
+
+                return token;
+            }
+            else    // Illegal/undefined
+            {
+                token.type = TOKEN_INVALID;
+                while (lexer->position < lexer->contents_size
+                    && !isspace(lexer->contents[lexer->position]))
+                {
+                    lexer->position++;
+                    token.value_size++;
+                }
+
+                return token;
+            }
+        }
+    }
+    
+    return token;
+}
+
+/**
+ * @brief Tokenise the whole input.
+ *
+ * Invalid tokens are kept so the assembler can report them, but the first
+ * one is also recorded in lexer->status and lexer->error_line.
+ *
+ * @return the tokens, NULL if they could not be allocated
+*/
+TokenList* Lexer_Run(Lexer* lexer)
+{
+    TokenList* destination = tokenlist_initialise(123);
+    if (destination == NULL)
+    {
+        lexer->status = LEXER_OUT_OF_MEMORY;
+        return NULL;
+    }
+
+    Token token = Lexer_Advance(lexer);
+
+    while (token.type != TOKEN_EOF)
+	{
+        if (token.type == TOKEN_INVALID && lexer->status == LEXER_OK)
+        {
+            lexer->status = LEXER_INVALID_TOKEN;
+            lexer->error_line = token.line + 1;
+        }
+
+		if (tokenlist_append(destination, token) != 0)
+        {
+            tokenlist_free(destination);
+            lexer->status = LEXER_OUT_OF_MEMORY;
+            return NULL;
+        }
+
+		token = Lexer_Advance(lexer);
+	}
+
+    return destination;
+}
+
+
+// Assembler
+#define ____ -1
+#define MAX_DEPTH 16        // Of nested includes and macros
+#define MAX_ARGUMENTS 16    // Of a macro
+#define MAX_PATH 4096
+
+// Opcode of an instruction by addressing mode, ____ where it has none
+typedef struct Mnemonic
+{
+    short opcodes[MODE_COUNT];
+} Mnemonic;
+
+typedef struct Operand
+{
+    AddressingMode mode;
+    int value;
+    int target;     // Branch target of MODE_ZEROPAGE_RELATIVE
+    int known;      // Value was known in the first pass (zero page allowed)
+} Operand;
+
+Assembler Assembler_Initialise(Mem* mem, const Word origin)
+{
+    Assembler assembler = {0};
+    assembler.mem = mem;
+    assembler.origin = origin;
+    assembler.variant = VARIANT_NMOS_STRICT;
+
+    return assembler;
+}
+
+void Assembler_Free(Assembler* assembler)
+{
+    free(assembler->labels);
+    assembler->labels = NULL;
+    assembler->label_count = assembler->label_capacity = 0;
+
+    free(assembler->macros);
+    assembler->macros = NULL;
+    assembler->macro_count = assembler->macro_capacity = 0;
+
+    for (size_t i = 0; i < assembler->include_count; i++)
+    {
+        free(assembler->includes[i].path);
+        free(assembler->includes[i].contents);
+        if (assembler->includes[i].tokens != NULL)
+            tokenlist_free(assembler->includes[i].tokens);
+    }
+    free(assembler->includes);
+    assembler->includes = NULL;
+    assembler->include_count = assembler->include_capacity = 0;
+}
+
+static int assembler_error(Assembler* assembler,
+                           const Token token,
+                           const char* message)
+{
+    (void)snprintf(assembler->error, sizeof(assembler->error),
+                   "%s%sline %zu: %s '%.*s'",
+                   (token.path != NULL) ? token.path : "",
+                   (token.path != NULL) ? ", " : "",
+                   token.line + 1,
+                   message,
+                   (int)token.value_size,
+                   token.value);
+    return -1;
+}
+
+const Label* Assembler_Find_Label(const Assembler* assembler,
+                                  const char* name,
+                                  const size_t name_size)
+{
+    for (size_t i = 0; i < assembler->label_count; i++)
+        if (assembler->labels[i].name_size == name_size
+            && memcmp(assembler->labels[i].name, name, name_size) == 0)
+            return &assembler->labels[i];
+
+    return NULL;
+}
+
+static int define_label(Assembler* assembler,
+                        const Token token,
+                        const size_t token_index,
+                        const Word address)
+{
+    if (assembler->pass != 1)
+        return 0;
+
+    if (Assembler_Find_Label(assembler, token.value, token.value_size))
+        return assembler_error(assembler, token, "Duplicate label");
+
+    if (assembler->label_count >= assembler->label_capacity)
+    {
+        size_t capacity = assembler->label_capacity * 2 + 16;
+        Label* labels = realloc(assembler->labels, sizeof(Label) * capacity);
+        if (labels == NULL)
+            return assembler_error(assembler, token, "Out of memory at");
+
+        assembler->labels = labels;
+        assembler->label_capacity = capacity;
+    }
+
+    Label label =
+    {
+        .name = token.value,
+        .name_size = token.value_size,
+        .address = address,
+        .token_index = token_index,
+    };
+    assembler->labels[assembler->label_count++] = label;
+
+    return 0;
+}
+
+static int is_directive(const Token token, const char* name)
+{
+    return token.type == TOKEN_DIRECTIVE
+        && token.value_size == strlen(name)
+        && strncasecmp(token.value, name, token.value_size) == 0;
+}
+
+static int is_operator(const Token token, const char name)
+{
+    return token.type == TOKEN_OPERATOR && token.value[0] == name;
+}
+
+static int is_register(const Token token, const char name)
+{
+    return token.type == TOKEN_ID
+        && token.value_size == 1
+        && toupper(token.value[0]) == name;
+}
+
+// A statement ends with its line, a comment or, once expanded, an EOL
+static size_t statement_size(const Token* tokens,
+                             const size_t count,
+                             const size_t start)
+{
+    size_t end = start + 1;
+
+    while (end < count && tokens[end].line == tokens[start].line
+        && tokens[end].type != TOKEN_COMMENT && tokens[end].type != TOKEN_EOL)
+        end++;
+
+    return end - start;
+}
+
+
+// Includes and macros
+/*
+ * Both are expanded into one token list before the first pass, so included
+ * files are only lexed once per run and the passes never see either.
+ * Statements in the expanded list are ended by TOKEN_EOL, as tokens from
+ * different files or macros may share line numbers.
+ */
+static int append(Assembler* assembler, const Token token)
+{
+    if (tokenlist_append(assembler->expanded, token) != 0)
+        return assembler_error(assembler, token, "Out of memory at");
+
+    return 0;
+}
+
+static int end_statement(Assembler* assembler, const Token last)
+{
+    Token eol =
+    {
+        .type = TOKEN_EOL,
+        .value = last.value,
+        .line = last.line,
+        .path = last.path,
+    };
+
+    return append(assembler, eol);
+}
+
+static char* read_file(const char* path, size_t* size)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    char* contents = NULL;
+    long length;
+
+    if (fseek(file, 0, SEEK_END) == 0
+        && (length = ftell(file)) >= 0
+        && fseek(file, 0, SEEK_SET) == 0
+        && (contents = malloc(length + 1)) != NULL)
+    {
+        *size = fread(contents, 1, length, file);
+        contents[*size] = '\0';
+    }
+
+    (void)fclose(file);
+    return contents;
+}
+
+/*
+ * Lex a file for .include. The tokens of a path included before are reused
+ * as long as its modification time, to the nanosecond, and size are
+ * unchanged, which is only checked once per run as the tokens may already
+ * be in use.
+ */
+static const Include* load_include(Assembler* assembler,
+                                   const Token token,
+                                   const char* path)
+{
+    struct stat status;
+    Include* include = NULL;
+
+    for (size_t i = 0; i < assembler->include_count && include == NULL; i++)
+        if (strcmp(assembler->includes[i].path, path) == 0)
+            include = &assembler->includes[i];
+
+    if (include != NULL && include->checked)
+        return include;
+
+    if (stat(path, &status) != 0)
+    {
+        (void)assembler_error(assembler, token, "Cannot read");
+        return NULL;
+    }
+
+    if (include != NULL
+        && include->mtime.tv_sec == status.st_mtim.tv_sec
+        && include->mtime.tv_nsec == status.st_mtim.tv_nsec
+        && include->size == status.st_size)
+    {
+        include->checked = 1;
+        return include;
+    }
+
+    if (include == NULL)
+    {
+        if (assembler->include_count >= assembler->include_capacity)
+        {
+            size_t capacity = assembler->include_capacity * 2 + 4;
+            Include* includes = realloc(assembler->includes,
+                                        sizeof(Include) * capacity);
+            if (includes == NULL)
+            {
+                (void)assembler_error(assembler, token, "Out of memory at");
+                return NULL;
+            }
+
+            assembler->includes = includes;
+            assembler->include_capacity = capacity;
+        }
+
+        include = &assembler->includes[assembler->include_count];
+        *include = (Include){ .path = malloc(strlen(path) + 1) };
+        if (include->path == NULL)
+        {
+            (void)assembler_error(assembler, token, "Out of memory at");
+            return NULL;
+        }
+        (void)strcpy(include->path, path);
+        assembler->include_count++;
+    }
+    else
+    {
+        free(include->contents);
+        if (include->tokens != NULL)
+            tokenlist_free(include->tokens);
+        include->contents = NULL;
+        include->tokens = NULL;
+    }
+
+    size_t size = 0;
+    include->contents = read_file(path, &size);
+    if (include->contents == NULL)
+    {
+        (void)assembler_error(assembler, token, "Cannot read");
+        return NULL;
+    }
+
+    Lexer lexer = Lexer_Initialise(include->contents, size);
+    include->tokens = Lexer_Run(&lexer);
+    if (include->tokens == NULL)
+    {
+        (void)assembler_error(assembler, token, "Out of memory at");
+        return NULL;
+    }
+
+    // Errors in the file name it, the path stays put while cached
+    for (size_t i = 0; i < include->tokens->current_size; i++)
+        include->tokens->contents[i].path = include->path;
+
+    include->mtime = status.st_mtim;
+    include->size = status.st_size;
+    include->checked = 1;
+    return include;
+}
+
+// Included paths are relative to the directory of the including file
+static int resolve_path(const char* including,
+                        const Token token,
+                        char* path,
+                        const size_t size)
+{
+    const char* name = token.value + 1;
+    const int name_size = token.value_size - 2;
+    const char* slash = (including == NULL || name[0] == '/')
+        ? NULL : strrchr(including, '/');
+    const int directory = (slash == NULL) ? 0 : slash - including + 1;
+
+    const int length = snprintf(path, size, "%.*s%.*s",
+                                directory, including, name_size, name);
+    return (length >= 0 && (size_t)length < size) ? 0 : -1;
+}
+
+static const Macro* find_macro(const Assembler* assembler, const Token token)
+{
+    for (size_t i = 0; i < assembler->macro_count; i++)
+    {
+        const Token* name = assembler->macros[i].name;
+
+        if (name->value_size == token.value_size
+            && strncasecmp(name->value, token.value, token.value_size) == 0)
+            return &assembler->macros[i];
+    }
+
+    return NULL;
+}
+
+/*
+ * .macro name parameter, ... up to .endmacro (or .endm). The body is only
+ * expanded where the macro is used, so it may use other macros.
+ */
+static int define_macro(Assembler* assembler,
+                        const TokenList* source,
+                        size_t* index)
+{
+    const Token* tokens = source->contents;
+    const size_t size = source->current_size;
+    size_t i = *index;
+    const size_t count = statement_size(tokens, size, i);
+
+    if (count < 2 || tokens[i + 1].type != TOKEN_ID)
+        return assembler_error(assembler, tokens[i], "Expected a name after");
+    if (find_macro(assembler, tokens[i + 1]) != NULL)
+        return assembler_error(assembler, tokens[i + 1], "Duplicate macro");
+
+    for (size_t j = 2; j < count; j++)
+        if (tokens[i + j].type != ((j % 2 == 0) ? TOKEN_ID : TOKEN_COMMA)
+            || (j + 1 == count && tokens[i + j].type == TOKEN_COMMA))
+            return assembler_error(assembler, tokens[i + j], "Invalid parameter");
+
+    Macro macro =
+    {
+        .name = &tokens[i + 1],
+        .parameters = &tokens[i + 2],
+        .parameters_size = count - 2,
+        .body = &tokens[i + count],
+    };
+
+    for (i += count; i < size; i++)
+    {
+        if (is_directive(tokens[i], ".endmacro")
+            || is_directive(tokens[i], ".endm"))
+            break;
+        if (is_directive(tokens[i], ".macro"))
+            return assembler_error(assembler, tokens[i], "Nested");
+    }
+
+    if (i >= size)
+        return assembler_error(assembler, *macro.name, "Missing .endmacro for");
+
+    macro.body_size = &tokens[i] - macro.body;
+    *index = i + statement_size(tokens, size, i);
+
+    if (assembler->macro_count >= assembler->macro_capacity)
+    {
+        size_t capacity = assembler->macro_capacity * 2 + 8;
+        Macro* macros = realloc(assembler->macros, sizeof(Macro) * capacity);
+        if (macros == NULL)
+            return assembler_error(assembler, *macro.name, "Out of memory at");
+
+        assembler->macros = macros;
+        assembler->macro_capacity = capacity;
+    }
+    assembler->macros[assembler->macro_count++] = macro;
+
+    return 0;
+}
+
+static int expand(Assembler* assembler,
+                  const TokenList* source,
+                  const char* path,
+                  const int depth);
+
+/*
+ * Copy the body of a macro with every parameter replaced by its argument,
+ * then expand the copy like a source of its own. Arguments are separated by
+ * commas outside parentheses, so "($10,X)" is one argument.
+ */
+static int invoke(Assembler* assembler,
+                  const Macro* macro,
+                  const Token* tokens,
+                  const size_t count,
+                  const char* path,
+                  const int depth)
+{
+    const Token* arguments[MAX_ARGUMENTS];
+    size_t sizes[MAX_ARGUMENTS];
+    size_t argument_count = 0;
+    int nesting = 0;
+
+    if (depth >= MAX_DEPTH)
+        return assembler_error(assembler, tokens[0], "Nested too deeply at");
+
+    for (size_t i = 1; i < count; i++)
+    {
+        if (i == 1 || (tokens[i - 1].type == TOKEN_COMMA && nesting == 0))
+        {
+            if (argument_count == MAX_ARGUMENTS)
+                return assembler_error(assembler, tokens[i], "Too many arguments at");
+            arguments[argument_count] = &tokens[i];
+            sizes[argument_count++] = 0;
+        }
+
+        nesting += (tokens[i].type == TOKEN_LPAREN)
+            - (tokens[i].type == TOKEN_RPAREN);
+        if (tokens[i].type != TOKEN_COMMA || nesting != 0)
+            sizes[argument_count - 1]++;
+        else if (i + 1 == count || sizes[argument_count - 1] == 0)
+            return assembler_error(assembler, tokens[i], "Missing argument at");
+    }
+
+    if (argument_count != (macro->parameters_size + 1) / 2)
+        return assembler_error(assembler, tokens[0], "Wrong number of arguments for");
+
+    TokenList* body = tokenlist_initialise(macro->body_size + 1);
+    if (body == NULL)
+        return assembler_error(assembler, tokens[0], "Out of memory at");
+
+    int result = 0;
+    for (size_t i = 0; i < macro->body_size && result == 0; i++)
+    {
+        const Token token = macro->body[i];
+        size_t parameter = 0;
+
+        while (parameter < argument_count
+            && (token.type != TOKEN_ID
+                || macro->parameters[parameter * 2].value_size != token.value_size
+                || memcmp(macro->parameters[parameter * 2].value, token.value,
+                          token.value_size) != 0))
+            parameter++;
+
+        if (parameter == argument_count)
+        {
+            result = tokenlist_append(body, token);
+            continue;
+        }
+
+        // Arguments take the place of the parameter to stay in its statement
+        for (size_t j = 0; j < sizes[parameter] && result == 0; j++)
+        {
+            Token argument = arguments[parameter][j];
+            argument.line = token.line;
+            argument.path = token.path;
+            result = tokenlist_append(body, argument);
+        }
+    }
+
+    if (result != 0)
+        result = assembler_error(assembler, tokens[0], "Out of memory at");
+    else
+        result = expand(assembler, body, path, depth + 1);
+
+    tokenlist_free(body);
+    return result;
+}
+
+/*
+ * Append the statements of a source to the expanded list, replacing
+ * .include and macro uses by what they stand for. path is the file the
+ * source comes from.
+ */
+static int expand(Assembler* assembler,
+                  const TokenList* source,
+                  const char* path,
+                  const int depth)
+{
+    const Token* tokens = source->contents;
+    const size_t size = source->current_size;
+    size_t i = 0;
+
+    while (i < size)
+    {
+        const Token token = tokens[i];
+
+        if (token.type == TOKEN_COMMENT || token.type == TOKEN_EOL)
+        {
+            i++;
+            continue;
+        }
+
+        // label: is a statement of its own
+        if (token.type == TOKEN_ID && i + 1 < size
+            && tokens[i + 1].type == TOKEN_COLON)
+        {
+            if (append(assembler, token) != 0
+                || append(assembler, tokens[i + 1]) != 0
+                || end_statement(assembler, tokens[i + 1]) != 0)
+                return -1;
+            i += 2;
+            continue;
+        }
+
+        const size_t count = statement_size(tokens, size, i);
+        const Macro* macro = (token.type == TOKEN_ID)
+            ? find_macro(assembler, token) : NULL;
+
+        if (is_directive(token, ".macro"))
+        {
+            if (define_macro(assembler, source, &i) != 0)
+                return -1;
+            continue;
+        }
+
+        if (is_directive(token, ".endmacro") || is_directive(token, ".endm"))
+            return assembler_error(assembler, token, "Unexpected");
+
+        if (is_directive(token, ".include"))
+        {
+            char file[MAX_PATH];
+            const Include* include;
+
+            if (count != 2 || tokens[i + 1].type != TOKEN_STRING)
+                return assembler_error(assembler, token, "Expected a file name after");
+            if (depth >= MAX_DEPTH)
+                return assembler_error(assembler, token, "Nested too deeply at");
+            if (resolve_path(path, tokens[i + 1], file, sizeof(file)) != 0)
+                return assembler_error(assembler, tokens[i + 1], "Path too long");
+            if ((include = load_include(assembler, tokens[i + 1], file)) == NULL)
+                return -1;
+
+            // The include may move in the cache, its tokens and path do not
+            const TokenList* included = include->tokens;
+            const char* included_path = include->path;
+            if (expand(assembler, included, included_path, depth + 1) != 0)
+                return -1;
+        }
+        else if (macro != NULL)
+        {
+            if (invoke(assembler, macro, &tokens[i], count, path, depth) != 0)
+                return -1;
+        }
+        else
+        {
+            for (size_t j = 0; j < count; j++)
+                if (append(assembler, tokens[i + j]) != 0)
+                    return -1;
+            if (end_statement(assembler, tokens[i + count - 1]) != 0)
+                return -1;
+        }
+
+        i += count;
+    }
+
+    return 0;
+}
+
+
+// Expressions
+/*
+ * Parse a number ($hex, %binary, decimal) or a label. Labels that are only
+ * defined further down are unknown in the first pass and never zero page.
+ */
+static int parse_value(Assembler* assembler,
+                       const char* text,
+                       size_t text_size,
+                       const size_t token_index,
+                       Operand* operand)
+{
+    char buffer[32];
+    char* end;
+    int base = 10;
+
+    operand->known = 1;
+
+    if (text_size > 0 && (isalpha(text[0]) || text[0] == '_'))
+    {
+        const Label* label = Assembler_Find_Label(assembler, text, text_size);
+
+        if (label == NULL && assembler->pass == 1)
+        {
+            operand->known = 0;
+            operand->value = 0;
+            return 0;
+        }
+        if (label == NULL)
+            return -1;
+
+        operand->known = (label->token_index < token_index);
+        operand->value = label->address;
+        return 0;
+    }
+
+    if (text_size > 0 && (text[0] == '$' || text[0] == '%'))
+    {
+        base = (text[0] == '$') ? 16 : 2;
+        text++;
+        text_size--;
+    }
+
+    if (text_size == 0 || text_size >= sizeof(buffer))
+        return -1;
+
+    (void)memcpy(buffer, text, text_size);
+    buffer[text_size] = '\0';
+
+    operand->value = strtol(buffer, &end, base);
+    return (*end == '\0' && operand->value <= 0xFFFF) ? 0 : -1;
+}
+
+typedef struct Expression
+{
+    Assembler* assembler;
+    const Token* tokens;
+    size_t count, position;
+    size_t token_index;     // Of the statement, to tell if labels are known
+    int known;
+    const char* error;      // Set with position on the offending token
+} Expression;
+
+// Binary operators by increasing precedence, all left associative
+static const char* operators[] = { "|", "^", "&", "+-", "*/" };
+
+static int evaluate_binary(Expression* expression,
+                           const size_t level,
+                           int* value);
+
+/*
+ * Results are computed in 64 bits and must fit back into an int, which also
+ * rejects INT_MIN / -1, so no source can overflow the host's arithmetic.
+ */
+static int store_result(Expression* expression,
+                        const size_t position,
+                        const long long result,
+                        int* value)
+{
+    if (result < INT_MIN || result > INT_MAX)
+    {
+        expression->position = position;
+        expression->error = "Expression out of range at";
+        return -1;
+    }
+
+    *value = (int)result;
+    return 0;
+}
+
+/*
+ * Unary operators: - negation and ~ complement; < low byte and > high byte
+ * apply to everything after them, so <label+2 is the low byte of label+2.
+ * * on its own is the current address.
+ */
+static int evaluate_unary(Expression* expression, int* value)
+{
+    if (expression->position >= expression->count)
+    {
+        expression->position = expression->count - 1;
+        expression->error = "Missing value after";
+        return -1;
+    }
+
+    const size_t position = expression->position++;
+    const Token token = expression->tokens[position];
+    Operand operand = {0};
+
+    if (token.type == TOKEN_OPERATOR && token.value[0] == '*')
+    {
+        *value = expression->assembler->position;
+        return 0;
+    }
+
+    if (token.type == TOKEN_OPERATOR && strchr("<>-~", token.value[0]))
+    {
+        const int whole = (token.value[0] == '<' || token.value[0] == '>');
+
+        if ((whole ? evaluate_binary(expression, 0, value)
+                   : evaluate_unary(expression, value)) != 0)
+            return -1;
+
+        switch (token.value[0])
+        {
+            case '<': *value &= 0xFF; return 0;
+            case '>': *value = (*value >> 8) & 0xFF; return 0;
+            case '-':
+                return store_result(expression, position, -(long long)*value,
+                                    value);
+            default: *value = ~*value; return 0;
+        }
+    }
+
+    if ((token.type != TOKEN_NUM && token.type != TOKEN_HEXNUM
+        && token.type != TOKEN_ID)
+        || parse_value(expression->assembler, token.value, token.value_size,
+                       expression->token_index, &operand) != 0)
+    {
+        expression->position--;
+        expression->error = (token.type == TOKEN_ID)
+            ? "Undefined label" : "Invalid value";
+        return -1;
+    }
+
+    expression->known &= operand.known;
+    *value = operand.value;
+    return 0;
+}
+
+static int evaluate_binary(Expression* expression,
+                           const size_t level,
+                           int* value)
+{
+    if (level == sizeof(operators) / sizeof(operators[0]))
+        return evaluate_unary(expression, value);
+
+    if (evaluate_binary(expression, level + 1, value) != 0)
+        return -1;
+
+    while (expression->position < expression->count)
+    {
+        const size_t position = expression->position;
+        const Token token = expression->tokens[position];
+        const int known = expression->known;
+        const long long left = *value;
+        long long result;
+        int right;
+
+        if (token.type != TOKEN_OPERATOR
+            || strchr(operators[level], token.value[0]) == NULL)
+            return 0;
+
+        expression->position++;
+        expression->known = 1;
+        if (evaluate_binary(expression, level + 1, &right) != 0)
+            return -1;
+
+        const int right_known = expression->known;
+        expression->known &= known;
+
+        switch (token.value[0])
+        {
+            case '|': result = left | right; break;
+            case '^': result = left ^ right; break;
+            case '&': result = left & right; break;
+            case '+': result = left + right; break;
+            case '-': result = left - right; break;
+            case '*': result = left * right; break;
+            default:
+            {
+                // Unknown values are 0 in the first pass, never in the second
+                if (right == 0
+                    && (right_known || expression->assembler->pass == 2))
+                {
+                    expression->position = position;
+                    expression->error = "Division by zero at";
+                    return -1;
+                }
+                result = (right == 0) ? 0 : left / right;
+            } break;
+        }
+
+        if (store_result(expression, position, result, value) != 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Evaluate the count tokens of an expression in the expanded list. Results
+ * that do not depend on labels defined further down are the same in both
+ * passes, so they are memoised by the index of their first token in the
+ * expanded list and the second pass only looks them up.
+ */
+static int evaluate(Assembler* assembler,
+                    const Token* tokens,
+                    const size_t count,
+                    const size_t token_index,
+                    Operand* operand)
+{
+    Value* memo = &assembler->values[tokens - assembler->expanded->contents];
+    Expression expression =
+    {
+        .assembler = assembler,
+        .tokens = tokens,
+        .count = count,
+        .token_index = token_index,
+        .known = 1,
+    };
+    int value;
+
+    if (memo->valid)
+    {
+        operand->value = memo->value;
+        operand->known = memo->known;
+        return 0;
+    }
+
+    if (count == 0)
+        return assembler_error(assembler, tokens[-1], "Missing value after");
+
+    if (evaluate_binary(&expression, 0, &value) != 0)
+        return assembler_error(assembler, tokens[expression.position],
+                               expression.error);
+    if (expression.position != count)
+        return assembler_error(assembler, tokens[expression.position],
+                               "Unexpected");
+
+    operand->value = value;
+    operand->known = expression.known;
+    if (expression.known)
+        *memo = (Value){ value, 1, 1 };
+
+    return 0;
+}
+
+// Addresses must fit in 16 bits
+static int evaluate_address(Assembler* assembler,
+                            const Token* tokens,
+                            const size_t count,
+                            const size_t token_index,
+                            Operand* operand)
+{
+    if (evaluate(assembler, tokens, count, token_index, operand) != 0)
+        return -1;
+
+    if (operand->value < 0 || operand->value > 0xFFFF)
+        return assembler_error(assembler, tokens[0], "Invalid value");
+
+    return 0;
+}
+
+
+// Instructions
+/*
+ * Collect the opcodes of an instruction from the opcode metadata of the
+ * assembler's variant. Where several opcodes share a mode, e.g. the
+ * undocumented NOPs, the documented one is used, or else the first one.
+ * Returns 0 if the variant has no such instruction.
+ */
+static int find_mnemonic(const Assembler* assembler,
+                         const Token token,
+                         Mnemonic* mnemonic)
+{
+    int found = 0;
+
+    for (int mode = 0; mode < MODE_COUNT; mode++)
+        mnemonic->opcodes[mode] = ____;
+
+    for (int opcode = 0; opcode < 256; opcode++)
+    {
+        const Opcode_Info* info = CPU_Opcode_Info(assembler->variant, opcode);
+        short* entry = &mnemonic->opcodes[info->Mode];
+
+        if (strlen(info->Mnemonic) != token.value_size
+            || strncasecmp(info->Mnemonic, token.value, token.value_size) != 0)
+            continue;
+
+        if (*entry == ____ || (info->Documented
+            && !CPU_Opcode_Info(assembler->variant, *entry)->Documented))
+            *entry = opcode;
+        found = 1;
+    }
+
+    return found;
+}
+
+/*
+ * Work out the addressing mode from the shape of the operand, e.g.
+ * "(expression),Y", and evaluate its expression.
+ */
+static int parse_operand(Assembler* assembler,
+                         const Token* tokens,
+                         const size_t count,
+                         const size_t token_index,
+                         const Mnemonic* mnemonic,
+                         Operand* operand)
+{
+    size_t start = 0, end = count;
+    AddressingMode zero_page = MODE_COUNT, absolute = MODE_COUNT;
+
+    if (count == 0)
+    {
+        operand->mode = (mnemonic->opcodes[MODE_IMPLIED] == ____)
+            ? MODE_ACCUMULATOR : MODE_IMPLIED;
+        return 0;
+    }
+
+    if (count == 1 && is_register(tokens[0], 'A')
+        && mnemonic->opcodes[MODE_ACCUMULATOR] != ____)
+    {
+        operand->mode = MODE_ACCUMULATOR;
+        return 0;
+    }
+
+    if (tokens[0].type == TOKEN_IMMD)
+    {
+        operand->mode = MODE_IMMEDIATE;
+        if (evaluate(assembler, &tokens[1], count - 1, token_index,
+                     operand) != 0)
+            return -1;
+        if (operand->value < -128 || operand->value > 0xFF)
+            return assembler_error(assembler, tokens[1], "Invalid value");
+
+        operand->value &= 0xFF;
+        return 0;
+    }
+
+    // BBR0 $10,label
+    if (mnemonic->opcodes[MODE_ZEROPAGE_RELATIVE] != ____)
+    {
+        Operand target = {0};
+        size_t comma = 0;
+
+        while (comma < count && tokens[comma].type != TOKEN_COMMA)
+            comma++;
+        if (comma == count)
+            return assembler_error(assembler, tokens[0], "Invalid operand");
+
+        operand->mode = MODE_ZEROPAGE_RELATIVE;
+        if (evaluate_address(assembler, tokens, comma, token_index,
+                             operand) != 0
+            || evaluate_address(assembler, &tokens[comma + 1],
+                                count - comma - 1, token_index, &target) != 0)
+            return -1;
+        if (operand->value > 0xFF)
+            return assembler_error(assembler, tokens[0], "Invalid value");
+
+        operand->target = target.value;
+        return 0;
+    }
+
+    if (tokens[0].type == TOKEN_LPAREN)
+    {
+        start = 1;
+        if (count >= 5 && tokens[count - 1].type == TOKEN_RPAREN
+            && is_register(tokens[count - 2], 'X')
+            && tokens[count - 3].type == TOKEN_COMMA)
+        {
+            end = count - 3;
+            zero_page = MODE_INDIRECTX;
+            absolute = (mnemonic->opcodes[MODE_INDIRECT_ABSOLUTEX] != ____)
+                ? MODE_INDIRECT_ABSOLUTEX : MODE_COUNT;
+        }
+        else if (count >= 5 && is_register(tokens[count - 1], 'Y')
+            && tokens[count - 2].type == TOKEN_COMMA
+            && tokens[count - 3].type == TOKEN_RPAREN)
+        {
+            end = count - 3;
+            zero_page = MODE_INDIRECTY;
+        }
+        else if (count >= 3 && tokens[count - 1].type == TOKEN_RPAREN)
+        {
+            end = count - 1;
+            zero_page = MODE_INDIRECT_ZEROPAGE;
+            absolute = MODE_INDIRECT;
+        }
+        else
+            return assembler_error(assembler, tokens[0], "Invalid operand");
+    }
+    else if (count >= 3 && tokens[count - 2].type == TOKEN_COMMA
+        && is_register(tokens[count - 1], 'X'))
+    {
+        end = count - 2;
+        zero_page = MODE_ZEROPAGEX;
+        absolute = MODE_ABSOLUTEX;
+    }
+    else if (count >= 3 && tokens[count - 2].type == TOKEN_COMMA
+        && is_register(tokens[count - 1], 'Y'))
+    {
+        end = count - 2;
+        zero_page = MODE_ZEROPAGEY;
+        absolute = MODE_ABSOLUTEY;
+    }
+    else
+    {
+        zero_page = MODE_ZEROPAGE;
+        absolute = (mnemonic->opcodes[MODE_RELATIVE] != ____)
+            ? MODE_RELATIVE : MODE_ABSOLUTE;
+    }
+
+    if (evaluate_address(assembler, &tokens[start], end - start, token_index,
+                         operand) != 0)
+        return -1;
+
+    if (zero_page != MODE_COUNT && operand->known && operand->value <= 0xFF
+        && mnemonic->opcodes[zero_page] != ____ && absolute != MODE_RELATIVE)
+        operand->mode = zero_page;
+    else if (absolute != MODE_COUNT)
+        operand->mode = absolute;
+    else
+        operand->mode = zero_page;
+
+    return 0;
+}
+
+static void emit(Assembler* assembler, const Byte data)
+{
+    if (assembler->pass == 2)
+    {
+        (void)Set_Memory(assembler->mem, assembler->position, data);
+        assembler->size++;
+    }
+    assembler->position++;
+}
+
+static int assemble_instruction(Assembler* assembler,
+                                const Token* tokens,
+                                const size_t count,
+                                const size_t token_index)
+{
+    const Token token = tokens[0];
+    Mnemonic mnemonic;
+    Operand operand = {0};
+
+    if (!find_mnemonic(assembler, token, &mnemonic))
+        return assembler_error(assembler, token, "Unknown instruction");
+
+    if (parse_operand(assembler, &tokens[1], count - 1, token_index,
+                      &mnemonic, &operand) != 0)
+        return -1;
+
+    const short opcode = mnemonic.opcodes[operand.mode];
+    if (opcode == ____)
+        return assembler_error(assembler, token, "Invalid addressing mode for");
+
+    const Byte size = CPU_Opcode_Info(assembler->variant, opcode)->Size;
+    int high = operand.value >> 8;
+
+    if (operand.mode == MODE_RELATIVE
+        || operand.mode == MODE_ZEROPAGE_RELATIVE)
+    {
+        const int target = (operand.mode == MODE_RELATIVE)
+            ? operand.value : operand.target;
+        const int offset = target - (assembler->position + size);
+        if (assembler->pass == 2 && (offset < -128 || offset > 127))
+            return assembler_error(assembler, token, "Branch out of range for");
+
+        if (operand.mode == MODE_RELATIVE)
+            operand.value = offset;
+        else
+            high = offset;
+    }
+    else if (size == 2 && operand.mode != MODE_IMMEDIATE
+        && operand.value > 0xFF)
+        return assembler_error(assembler, token, "Zero page operand out of range for");
+
+    emit(assembler, opcode);
+    if (size >= 2)
+        emit(assembler, operand.value & 0xFF);
+    if (size == 3)
+        emit(assembler, high & 0xFF);
+
+    return 0;
+}
+
+/*
+ * .org address moves the position; .byte and .word emit lists of values,
+ * .byte also strings. Negative values are stored in two's complement.
+ */
+static int assemble_directive(Assembler* assembler,
+                              const Token* tokens,
+                              const size_t count,
+                              const size_t token_index)
+{
+    const Token directive = tokens[0];
+    const int word = is_directive(directive, ".word");
+    Operand operand = {0};
+
+    if (!word && !is_directive(directive, ".byte")
+        && !is_directive(directive, ".org"))
+        return assembler_error(assembler, directive, "Unknown directive");
+
+    if (count < 2 || tokens[count - 1].type == TOKEN_COMMA)
+        return assembler_error(assembler, tokens[count - 1], "Missing value after");
+
+    if (is_directive(directive, ".org"))
+    {
+        if (evaluate_address(assembler, &tokens[1], count - 1, token_index,
+                             &operand) != 0)
+            return -1;
+        if (!operand.known)
+            return assembler_error(assembler, tokens[1], "Defined too late for .org");
+
+        assembler->position = operand.value;
+        return 0;
+    }
+
+    for (size_t start = 1, end; start < count; start = end + 1)
+    {
+        end = start;
+        while (end < count && tokens[end].type != TOKEN_COMMA)
+            end++;
+
+        if (!word && end == start + 1 && tokens[start].type == TOKEN_STRING)
+        {
+            for (size_t i = 1; i + 1 < tokens[start].value_size; i++)
+                emit(assembler, tokens[start].value[i]);
+            continue;
+        }
+
+        if (evaluate(assembler, &tokens[start], end - start, token_index,
+                     &operand) != 0)
+            return -1;
+        if (operand.value < (word ? -0x8000 : -0x80)
+            || operand.value > (word ? 0xFFFF : 0xFF))
+            return assembler_error(assembler, tokens[start], "Invalid value");
+
+        emit(assembler, operand.value & 0xFF);
+        if (word)
+            emit(assembler, (operand.value >> 8) & 0xFF);
+    }
+
+    return 0;
+}
+
+static int assemble_pass(Assembler* assembler)
+{
+    const Token* tokens = assembler->expanded->contents;
+    const size_t size = assembler->expanded->current_size;
+    size_t i = 0;
+
+    assembler->position = assembler->origin;
+
+    while (i < size)
+    {
+        const Token token = tokens[i];
+
+        if (token.type == TOKEN_COMMENT || token.type == TOKEN_EOL)
+        {
+            i++;
+            continue;
+        }
+
+        const size_t count = statement_size(tokens, size, i);
+        int result;
+
+        // label:
+        if (token.type == TOKEN_ID && count >= 2
+            && tokens[i + 1].type == TOKEN_COLON)
+        {
+            if (define_label(assembler, token, i, assembler->position) != 0)
+                return -1;
+            i += 2;
+            continue;
+        }
+
+        // name = value
+        if (token.type == TOKEN_ID && count >= 2
+            && is_operator(tokens[i + 1], '='))
+        {
+            Operand operand = {0};
+
+            if (evaluate_address(assembler, &tokens[i + 2], count - 2, i,
+                                 &operand) != 0)
+                return -1;
+            if (!operand.known)
+                return assembler_error(assembler, token, "Defined too late for");
+            result = define_label(assembler, token, i, operand.value);
+        }
+        else if (token.type == TOKEN_DIRECTIVE)
+            result = assemble_directive(assembler, &tokens[i], count, i);
+        else if (token.type == TOKEN_ID)
+            result = assemble_instruction(assembler, &tokens[i], count, i);
+        else
+            result = assembler_error(assembler, token, "Unexpected");
+
+        if (result != 0)
+            return -1;
+        i += count;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Assemble a token list into the assembler's memory.
+ *
+ * Includes and macros are expanded first. Then the first pass collects the
+ * labels and the second one emits the code starting at the origin. On
+ * failure, assembler->error describes the first problem. The files read by
+ * .include stay cached in the assembler for later runs.
+ *
+ * @return 0 on success, -1 otherwise
+ */
+const int Assembler_Run(Assembler* assembler, TokenList* tokens)
+{
+    int result = -1;
+
+    assembler->size = 0;
+    assembler->error[0] = '\0';
+    assembler->label_count = 0;
+    assembler->macro_count = 0;
+    for (size_t i = 0; i < assembler->include_count; i++)
+        assembler->includes[i].checked = 0;
+
+    assembler->expanded = tokenlist_initialise(tokens->current_size + 1);
+    if (assembler->expanded == NULL)
+    {
+        (void)snprintf(assembler->error, sizeof(assembler->error),
+                       "Out of memory");
+        return -1;
+    }
+
+    if (expand(assembler, tokens, assembler->path, 0) == 0)
+    {
+        assembler->values = calloc(assembler->expanded->current_size + 1,
+                                   sizeof(Value));
+        if (assembler->values == NULL)
+            (void)snprintf(assembler->error, sizeof(assembler->error),
+                           "Out of memory");
+        else
+            result = 0;
+    }
+
+    for (assembler->pass = 1; assembler->pass <= 2 && result == 0;
+         assembler->pass++)
+        result = assemble_pass(assembler);
+
+    free(assembler->values);
+    tokenlist_free(assembler->expanded);
+    assembler->values = NULL;
+    assembler->expanded = NULL;
+
+    return result;
+}
@@ -1,59 +1,151 @@
-#ifndef RUNNER_h
-#define RUNNER_h
-
-#include <stdio.h>
-#include <stdlib.h>
-
-typedef enum
-{
-    TOKEN_EOF,      // End of File
-    TOKEN_NUM,      // Numbers
-    TOKEN_ID,       // Identifiers
-    TOKEN_COMMENT,  // ;<Text>
-    TOKEN_IMMD,     // #<Number> (Immediate)
-    TOKEN_HEXNUM,   // $<Number> (Hexadecimal)
-    TOKEN_LPAREN,   // (
-    TOKEN_RPAREN,   // )
-    TOKEN_INVALID,
-} TokenType;
-
-typedef struct Token
-{
-    TokenType type;
-    const char* value;
-    size_t value_size;
-} Token;
-
-typedef struct TokenList
-{
-    size_t capacity;
-    size_t current_size;
-    Token* contents;
-} TokenList;
-
-typedef struct Lexer
-{
-    const char* contents;
-    size_t contents_size;
-    size_t position, line, beginning_of_line;
-} Lexer;
-
-
-// Token functions
-const char* token_name(const TokenType type);
-
-
-// Token List functions
-TokenList* tokenlist_initialise(size_t capacity);
-void tokenlist_free(TokenList* list);
-const int tokenlist_resize(TokenList* list, const size_t capacity);
-const int tokenlist_append(TokenList* list, const Token token);
-const Token tokenlist_get(TokenList* list, const size_t index);
-
-
-// Lexer funtions
-Lexer Lexer_Initialise(const char* contents, const size_t contents_size);
-const Token Lexer_Advance(Lexer* lexer);
-TokenList* Lexer_Run(Lexer* lexer);
-
-#endif // !RUNNER_h
+#ifndef RUNNER_h
+#define RUNNER_h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "cpu.h"
+
+typedef enum
+{
+    TOKEN_EOF,      // End of File
+    TOKEN_NUM,      // Numbers
+    TOKEN_ID,       // Identifiers
+    TOKEN_COMMENT,  // ;<Text>
+    TOKEN_IMMD,     // # (Immediate), followed by an expression
+    TOKEN_HEXNUM,   // $<Number> (Hexadecimal)
+    TOKEN_LPAREN,   // (
+    TOKEN_RPAREN,   // )
+    TOKEN_COMMA,    // ,
+    TOKEN_COLON,    // :
+    TOKEN_DIRECTIVE,    // .<Name>
+    TOKEN_STRING,   // "<Text>"
+    TOKEN_OPERATOR, // + - * / & | ^ ~ < > =
+    TOKEN_EOL,      // End of a statement, only in expanded token lists
+    TOKEN_INVALID,
+} TokenType;
+
+typedef struct Token
+{
+    TokenType type;
+    const char* value;
+    size_t value_size;
+    size_t line;
+    const char* path;       // Included file it comes from, NULL for the source
+} Token;
+
+typedef struct TokenList
+{
+    size_t capacity;
+    size_t current_size;
+    Token* contents;
+} TokenList;
+
+typedef enum
+{
+    LEXER_OK,
+    LEXER_INVALID_TOKEN,    // Tokenised as TOKEN_INVALID, see error_line
+    LEXER_OUT_OF_MEMORY,    // Lexer_Run returned NULL
+} LexerStatus;
+
+typedef struct Lexer
+{
+    const char* contents;
+    size_t contents_size;
+    size_t position, line, beginning_of_line;
+
+    LexerStatus status;     // First error of Lexer_Run
+    size_t error_line;      // Counted from 1
+} Lexer;
+
+
+// Token functions
+const char* token_name(const TokenType type);
+
+
+// Token List functions
+TokenList* tokenlist_initialise(size_t capacity);
+void tokenlist_free(TokenList* list);
+const int tokenlist_resize(TokenList* list, const size_t capacity);
+const int tokenlist_append(TokenList* list, const Token token);
+const Token tokenlist_get(TokenList* list, const size_t index);
+
+
+typedef struct Label
+{
+    const char* name;
+    size_t name_size;
+    Word address;
+    size_t token_index;     // Where the label is defined
+} Label;
+
+// A file lexed for .include, reused until its mtime or size changes
+typedef struct Include
+{
+    char* path;
+    struct timespec mtime;
+    off_t size;
+    char* contents;
+    TokenList* tokens;
+    int checked;            // The modification time was checked in this run
+} Include;
+
+// A .macro definition, pointing into the token list that defines it
+typedef struct Macro
+{
+    const Token* name;
+    const Token* parameters;    // Names separated by commas
+    size_t parameters_size;
+    const Token* body;
+    size_t body_size;
+} Macro;
+
+// Result of an expression, memoised by the index of its first token
+typedef struct Value
+{
+    int value;
+    int known;              // Did not depend on labels defined further down
+    int valid;
+} Value;
+
+typedef struct Assembler
+{
+    Mem* mem;               // Destination of the machine code
+    Word origin;            // Address of the first instruction
+    CPU_Variant variant;    // Instruction set, documented NMOS by default
+    const char* path;       // Source file, .include is relative to it
+    Word position;          // Address of the next instruction
+    size_t size;            // Number of bytes emitted
+    int pass;
+
+    Label* labels;
+    size_t label_count, label_capacity;
+
+    TokenList* expanded;    // Source with includes and macros expanded
+    Value* values;          // Indexed like expanded
+    Macro* macros;
+    size_t macro_count, macro_capacity;
+    Include* includes;      // Kept across runs
+    size_t include_count, include_capacity;
+
+    char error[256];        // Set when assembly fails
+} Assembler;
+
+
+// Lexer funtions
+Lexer Lexer_Initialise(const char* contents, const size_t contents_size);
+const Token Lexer_Advance(Lexer* lexer);
+TokenList* Lexer_Run(Lexer* lexer);
+
+
+// Assembler functions
+Assembler Assembler_Initialise(Mem* mem, const Word origin);
+void Assembler_Free(Assembler* assembler);
+const int Assembler_Run(Assembler* assembler, TokenList* tokens);
+const Label* Assembler_Find_Label(const Assembler* assembler,
+                                  const char* name,
+                                  const size_t name_size);
+
+#endif // !RUNNER_h
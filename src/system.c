@@ -0,0 +1,264 @@
+#include <limits.h>
+#include <pthread.h>
+
+#include "system.h"
+
+// The host threads of one System_Execute call, one per cpu
+typedef struct Crew
+{
+	System* system;
+	pthread_mutex_t lock;
+	pthread_cond_t start;		// Signalled when a quantum begins
+	pthread_cond_t done;		// Signalled when every thread finished it
+	u64 quanta;					// Quanta begun, each thread follows it
+	u32 length;					// Cycles in the current quantum
+	u32 size;					// Threads running
+	u32 finished;				// Threads done with the current quantum
+	int stop;
+} Crew;
+
+typedef struct Member
+{
+	Crew* crew;
+	u32 index;					// Of the cpu it runs
+} Member;
+
+
+const int System_Initialise(System* system,
+                            Mem** mems,
+                            const u32 count,
+                            const CPU_Variant variant,
+                            const u32 quantum)
+{
+	if (count == 0 || count > SYSTEM_MAX_CPUS || quantum == 0)
+		return -1;
+
+	(void)memset(system, 0, sizeof(*system));
+	for (u32 i = 0; i < count; i++)
+	{
+		if (CPU_Power_On(&system->CPUs[i], variant) != 0)
+			return -1;
+		system->Mems[i] = mems[i];
+	}
+
+	system->Count = count;
+	system->Quantum = quantum;
+	return 0;
+}
+
+void System_Share(System* system, const Word first, const Word last)
+{
+	for (u32 page = first / PAGE_SIZE; page <= last / PAGE_SIZE; page++)
+	{
+		Byte* bus = &system->Bus[page * PAGE_SIZE];
+
+		system->Shared[page] = 1;
+		(void)memcpy(bus, &system->Mems[0]->Data[page * PAGE_SIZE], PAGE_SIZE);
+		for (u32 i = 1; i < system->Count; i++)
+			(void)memcpy(&system->Mems[i]->Data[page * PAGE_SIZE], bus,
+			             PAGE_SIZE);
+	}
+}
+
+const int System_Set_Memory(System* system,
+                            const u32 cpu,
+                            const Word address,
+                            const Byte data)
+{
+	if (cpu >= system->Count)
+		return -1;
+
+	if (!system->Shared[address / PAGE_SIZE])
+		return Set_Memory(system->Mems[cpu], address, data);
+
+	system->Bus[address] = data;
+	for (u32 i = 0; i < system->Count; i++)
+		(void)Set_Memory(system->Mems[i], address, data);
+	return 0;
+}
+
+// Runs a cpu up to the end of a quantum of the given length
+static void run_quantum(System* system, const u32 index, const u32 length)
+{
+	CPU* cpu = &system->CPUs[index];
+	long long* ahead = &system->Ahead[index];
+
+	if (cpu->Halted)
+		return;
+
+	if (*ahead >= length)
+	{
+		*ahead -= length;
+		return;
+	}
+
+	// Longer than the quantum if a trap stopped the cpu short of the last one
+	const long long budget = length - *ahead;
+	const u64 start = cpu->Cycles;
+
+	(void)CPU_Execute(cpu, system->Mems[index],
+	                  (budget < UINT_MAX) ? (u32)budget : UINT_MAX);
+
+	*ahead = (long long)(cpu->Cycles - start) - budget;
+}
+
+// Merges what the cpus wrote to the shared pages at a boundary
+static void exchange(System* system)
+{
+	Byte before[PAGE_SIZE];
+
+	for (u32 page = 0; page < PAGE_COUNT; page++)
+	{
+		if (!system->Shared[page])
+			continue;
+
+		Byte* bus = &system->Bus[page * PAGE_SIZE];
+		int changed = 0;
+
+		for (u32 i = 0; i < system->Count; i++)
+		{
+			const Byte* data = &system->Mems[i]->Data[page * PAGE_SIZE];
+
+			if (memcmp(data, changed ? before : bus, PAGE_SIZE) == 0)
+				continue;
+
+			if (!changed)
+				(void)memcpy(before, bus, PAGE_SIZE);
+			changed = 1;
+
+			for (u32 j = 0; j < PAGE_SIZE; j++)
+				if (data[j] != before[j])
+					bus[j] = data[j];
+		}
+
+		if (changed)
+			for (u32 i = 0; i < system->Count; i++)
+				(void)memcpy(&system->Mems[i]->Data[page * PAGE_SIZE], bus,
+				             PAGE_SIZE);
+	}
+}
+
+static void* member(void* argument)
+{
+	const Member* self = argument;
+	Crew* crew = self->crew;
+	u64 quanta = 0;
+
+	(void)pthread_mutex_lock(&crew->lock);
+	for (;;)
+	{
+		while (crew->quanta == quanta && !crew->stop)
+			(void)pthread_cond_wait(&crew->start, &crew->lock);
+		if (crew->stop)
+			break;
+
+		const u32 length = crew->length;
+
+		quanta = crew->quanta;
+		(void)pthread_mutex_unlock(&crew->lock);
+
+		run_quantum(crew->system, self->index, length);
+
+		(void)pthread_mutex_lock(&crew->lock);
+		if (++crew->finished == crew->size)
+			(void)pthread_cond_signal(&crew->done);
+	}
+	(void)pthread_mutex_unlock(&crew->lock);
+
+	return NULL;
+}
+
+// Lets every thread run one quantum and waits until all of them have
+static void crew_run(Crew* crew, const u32 length)
+{
+	(void)pthread_mutex_lock(&crew->lock);
+	crew->length = length;
+	crew->finished = 0;
+	crew->quanta++;
+	(void)pthread_cond_broadcast(&crew->start);
+
+	while (crew->finished < crew->size)
+		(void)pthread_cond_wait(&crew->done, &crew->lock);
+	(void)pthread_mutex_unlock(&crew->lock);
+}
+
+static void crew_stop(Crew* crew, pthread_t* threads)
+{
+	(void)pthread_mutex_lock(&crew->lock);
+	crew->stop = 1;
+	(void)pthread_cond_broadcast(&crew->start);
+	(void)pthread_mutex_unlock(&crew->lock);
+
+	for (u32 i = 0; i < crew->size; i++)
+		(void)pthread_join(threads[i], NULL);
+
+	(void)pthread_cond_destroy(&crew->done);
+	(void)pthread_cond_destroy(&crew->start);
+	(void)pthread_mutex_destroy(&crew->lock);
+}
+
+static const int running(const System* system)
+{
+	int count = 0;
+
+	for (u32 i = 0; i < system->Count; i++)
+		count += !system->CPUs[i].Halted;
+
+	return count;
+}
+
+const int System_Execute(System* system, const u64 cycles)
+{
+	const int threaded = system->Threaded;
+	Crew crew = { system };
+	Member members[SYSTEM_MAX_CPUS];
+	pthread_t threads[SYSTEM_MAX_CPUS];
+
+	if (threaded)
+	{
+		(void)pthread_mutex_init(&crew.lock, NULL);
+		(void)pthread_cond_init(&crew.start, NULL);
+		(void)pthread_cond_init(&crew.done, NULL);
+
+		for (; crew.size < system->Count; crew.size++)
+		{
+			members[crew.size] = (Member){ &crew, crew.size };
+			if (pthread_create(&threads[crew.size], NULL, member,
+			                   &members[crew.size]) != 0)
+				break;
+		}
+
+		if (crew.size < system->Count)
+		{
+			crew_stop(&crew, threads);
+			return -1;
+		}
+	}
+
+	u64 remaining = cycles;
+	int trapped = 0;
+
+	while (remaining > 0 && !trapped && running(system) > 0)
+	{
+		const u32 length = (remaining < system->Quantum)
+			? (u32)remaining : system->Quantum;
+
+		if (threaded)
+			crew_run(&crew, length);
+		else
+			for (u32 i = 0; i < system->Count; i++)
+				run_quantum(system, i, length);
+
+		exchange(system);
+		system->Cycles += length;
+		remaining -= length;
+
+		for (u32 i = 0; i < system->Count; i++)
+			trapped |= system->CPUs[i].Trap;
+	}
+
+	if (threaded)
+		crew_stop(&crew, threads);
+
+	return running(system);
+}
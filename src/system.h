@@ -0,0 +1,90 @@
+#ifndef SYSTEM_h
+#define SYSTEM_h
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cpu.h"
+
+#ifndef SYSTEM_MAX_CPUS
+#define SYSTEM_MAX_CPUS 8
+#endif
+
+/*
+ * Several cpus sharing a bus, e.g. a computer and the 6502 of its disk
+ * drive. Each cpu runs on its own memory image, so nothing else writes to
+ * it while CPU_Execute runs. The page table marks the pages that are on the
+ * bus; they are exchanged between the cpus at the boundaries of fixed
+ * quanta of cycles. Within a quantum a cpu only sees its own writes to them.
+ *
+ * At a boundary the bytes each cpu changed in a shared page are written to
+ * the bus in cpu order, so the last cpu wins when two wrote the same byte,
+ * and the bus is copied back to every cpu. The result only depends on the
+ * quantum, never on whether or how the cpus were run in parallel.
+ */
+typedef struct System
+{
+	CPU CPUs[SYSTEM_MAX_CPUS];
+	Mem* Mems[SYSTEM_MAX_CPUS];		// Memory image of each cpu
+	long long Ahead[SYSTEM_MAX_CPUS];	// Cycles past the last boundary, < 0 if short
+	u32 Count;						// Cpus in use, at most SYSTEM_MAX_CPUS
+	u32 Quantum;					// Cycles between boundaries
+	int Threaded;					// Run every cpu on its own host thread
+	u64 Cycles;						// Cycles up to the last boundary
+	Byte Shared[PAGE_COUNT];		// Page table, non-zero for shared pages
+	Byte Bus[MAX_MEM];				// Shared pages as of the last boundary
+} System;
+
+
+/**
+ * @brief Power on count cpus of the given variant, one per memory image.
+ *
+ * As with Lanes_Initialise the images are left untouched and no page is
+ * shared. Threaded is off; set it before System_Execute to use it.
+ *
+ * @param quantum cycles between boundaries, smaller is closer to real
+ * hardware but spends more time exchanging the shared pages
+ * @return 0, or -1 if the variant is invalid, count is 0 or more than
+ * SYSTEM_MAX_CPUS, or quantum is 0
+*/
+const int System_Initialise(System* system,
+                            Mem** mems,
+                            const u32 count,
+                            const CPU_Variant variant,
+                            const u32 quantum);
+
+/**
+ * @brief Put the pages from first to last on the bus.
+ *
+ * Their contents are taken from the first cpu's image and copied to the
+ * others. Only call this between System_Execute calls.
+*/
+void System_Share(System* system, const Word first, const Word last);
+
+/**
+ * @brief Write a byte as the given cpu, and to every image if it is shared.
+ *
+ * @return 0, or -1 if there is no such cpu
+*/
+const int System_Set_Memory(System* system,
+                            const u32 cpu,
+                            const Word address,
+                            const Byte data);
+
+/**
+ * @brief Run every cpu for the given number of cycles, interleaved in
+ * quanta.
+ *
+ * Each cpu runs until it reaches the next boundary; instructions that cross
+ * it are made up for by a shorter next quantum and a cpu a trap stopped
+ * short of it runs the missing cycles in the next one, so the cpus never
+ * drift apart. With Threaded set every running cpu gets a host thread for
+ * the call, and they wait for each other at every boundary. Execution stops
+ * early at the boundary after every cpu has halted or one hit a trap.
+ *
+ * @return the number of cpus still running, -1 if the threads could not be
+ * started, in which case nothing was run
+*/
+const int System_Execute(System* system, const u64 cycles);
+
+#endif // !SYSTEM_h
@@ -0,0 +1,298 @@
+#include <ctype.h>
+
+#include "trace.h"
+
+// Finds "key" at the start of the line or after a space
+static const char* find_field(const char* line, const char* key)
+{
+	const size_t size = strlen(key);
+
+	for (const char* field = strstr(line, key);
+	     field != NULL;
+	     field = strstr(field + 1, key))
+		if (field == line || field[-1] == ' ')
+			return field + size;
+
+	return NULL;
+}
+
+static int parse_hex(const char* text, unsigned long* value)
+{
+	if (text == NULL || !isxdigit((unsigned char)*text))
+		return -1;
+
+	*value = strtoul(text, NULL, 16);
+	return 0;
+}
+
+void Trace_Capture(const CPU* cpu, Trace_State* state)
+{
+	state->PC = cpu->PC;
+	state->A = cpu->A;
+	state->X = cpu->X;
+	state->Y = cpu->Y;
+	state->P = CPU_Get_Status(cpu);
+	state->SP = cpu->SP;
+	state->Cycles = cpu->Cycles;
+	state->Has_Cycles = 1;
+}
+
+const int Trace_Parse(const char* line, Trace_State* state)
+{
+	unsigned long pc, a, x, y, p, sp;
+	const char* cycles = find_field(line, "CYC:");
+
+	while (*line == ' ')
+		line++;
+
+	if (parse_hex(line, &pc) != 0
+		|| parse_hex(find_field(line, "A:"), &a) != 0
+		|| parse_hex(find_field(line, "X:"), &x) != 0
+		|| parse_hex(find_field(line, "Y:"), &y) != 0
+		|| parse_hex(find_field(line, "P:"), &p) != 0
+		|| parse_hex(find_field(line, "SP:"), &sp) != 0)
+		return -1;
+
+	state->PC = pc;
+	state->A = a;
+	state->X = x;
+	state->Y = y;
+	state->P = p;
+	state->SP = sp;
+
+	while (cycles != NULL && *cycles == ' ')
+		cycles++;
+	state->Has_Cycles = (cycles != NULL && isdigit((unsigned char)*cycles));
+	state->Cycles = state->Has_Cycles ? strtoull(cycles, NULL, 10) : 0;
+
+	return 0;
+}
+
+const Byte Trace_Compare(const Trace_State* expected,
+                         const Trace_State* actual)
+{
+	Byte fields = 0;
+
+	fields |= (expected->PC != actual->PC) * TRACE_PC;
+	fields |= (expected->A != actual->A) * TRACE_A;
+	fields |= (expected->X != actual->X) * TRACE_X;
+	fields |= (expected->Y != actual->Y) * TRACE_Y;
+	fields |= (((expected->P ^ actual->P) & TRACE_STATUS_MASK) != 0) * TRACE_P;
+	fields |= (expected->SP != actual->SP) * TRACE_SP;
+	fields |= (expected->Has_Cycles && actual->Has_Cycles
+		&& expected->Cycles != actual->Cycles) * TRACE_CYCLES;
+
+	return fields;
+}
+
+const int Trace_Format(const Trace_State* state,
+                       char* buffer,
+                       const size_t size)
+{
+	int length = snprintf(buffer, size,
+	                      "%04X  A:%02X X:%02X Y:%02X P:%02X SP:%02X",
+	                      state->PC, state->A, state->X, state->Y,
+	                      state->P, state->SP);
+
+	if (state->Has_Cycles && length >= 0 && (size_t)length < size)
+		length += snprintf(buffer + length, size - length,
+		                   " CYC:%llu", state->Cycles);
+
+	return length;
+}
+
+const int Trace_Write(const CPU* cpu, FILE* log)
+{
+	char line[64];
+	Trace_State state;
+
+	Trace_Capture(cpu, &state);
+	(void)Trace_Format(&state, line, sizeof(line));
+
+	return (fprintf(log, "%s\n", line) < 0) ? -1 : 0;
+}
+
+const int Trace_Buffer_Initialise(Trace_Buffer* buffer,
+                                  const size_t capacity,
+                                  FILE* file)
+{
+	buffer->Records = malloc(sizeof(Trace_Record) * capacity);
+	buffer->Capacity = capacity;
+	buffer->Count = buffer->Next = 0;
+	buffer->File = file;
+
+	return (buffer->Records == NULL || capacity == 0) ? -1 : 0;
+}
+
+void Trace_Buffer_Free(Trace_Buffer* buffer)
+{
+	free(buffer->Records);
+	buffer->Records = NULL;
+	buffer->Capacity = buffer->Count = buffer->Next = 0;
+}
+
+const int Trace_Buffer_Append(Trace_Buffer* buffer,
+                              const CPU* cpu,
+                              const Mem* mem)
+{
+	if (buffer->Count == buffer->Capacity && buffer->File != NULL
+		&& Trace_Buffer_Flush(buffer) != 0)
+		return -1;
+
+	Trace_Record* record = &buffer->Records[buffer->Next];
+
+	record->Cycles = cpu->Cycles;
+	record->PC = cpu->PC;
+	record->A = cpu->A;
+	record->X = cpu->X;
+	record->Y = cpu->Y;
+	record->P = CPU_Get_Status(cpu);
+	record->SP = cpu->SP;
+	record->Bytes[0] = Get_Memory(mem, cpu->PC);
+	record->Bytes[1] = Get_Memory(mem, (Word)(cpu->PC + 1));
+	record->Bytes[2] = Get_Memory(mem, (Word)(cpu->PC + 2));
+
+	buffer->Next = (buffer->Next + 1) % buffer->Capacity;
+	if (buffer->Count < buffer->Capacity)
+		buffer->Count++;
+
+	return 0;
+}
+
+const int Trace_Buffer_Flush(Trace_Buffer* buffer)
+{
+	if (buffer->File == NULL)
+		return 0;
+
+	// The oldest records are at Next once the ring has wrapped
+	const size_t start = (buffer->Next + buffer->Capacity - buffer->Count)
+		% buffer->Capacity;
+	const size_t first = (start + buffer->Count > buffer->Capacity)
+		? buffer->Capacity - start : buffer->Count;
+	const size_t second = buffer->Count - first;
+
+	if (fwrite(&buffer->Records[start], sizeof(Trace_Record), first,
+	           buffer->File) != first
+		|| fwrite(buffer->Records, sizeof(Trace_Record), second,
+		          buffer->File) != second)
+		return -1;
+
+	buffer->Count = buffer->Next = 0;
+	return 0;
+}
+
+const Trace_Record* Trace_Buffer_Get(const Trace_Buffer* buffer,
+                                     const size_t index)
+{
+	const size_t start = (buffer->Next + buffer->Capacity - buffer->Count)
+		% buffer->Capacity;
+
+	return &buffer->Records[(start + index) % buffer->Capacity];
+}
+
+const int Trace_Read(FILE* file, Trace_Record* record)
+{
+	if (fread(record, sizeof(Trace_Record), 1, file) == 1)
+		return 1;
+
+	return ferror(file) ? -1 : 0;
+}
+
+const int Trace_Render(const Trace_Record* record,
+                       const CPU_Variant variant,
+                       const Symbols* symbols,
+                       char* buffer,
+                       const size_t size)
+{
+	char disassembly[DISASSEMBLY_SIZE];
+	char bytes[10] = "";
+	const int length = Disassemble(variant, record->PC, record->Bytes,
+	                               symbols, disassembly, sizeof(disassembly));
+
+	if (length < 0)
+		return -1;
+
+	for (int i = 0; i < length; i++)
+		(void)snprintf(bytes + i * 3, sizeof(bytes) - i * 3,
+		               "%02X ", record->Bytes[i]);
+
+	return snprintf(buffer, size,
+	                "%04X  %-10s%-31s A:%02X X:%02X Y:%02X P:%02X SP:%02X"
+	                " CYC:%llu",
+	                record->PC, bytes, disassembly, record->A, record->X,
+	                record->Y, record->P, record->SP, record->Cycles);
+}
+
+// Reads the next non-blank line, 1 at the end of the log
+static int read_state(FILE* reference,
+                      char** line,
+                      size_t* capacity,
+                      size_t* number,
+                      Trace_State* state)
+{
+	for (;;)
+	{
+		if (getline(line, capacity, reference) < 0)
+			return ferror(reference) ? -1 : 1;
+
+		++*number;
+
+		const char* text = *line;
+		while (isspace((unsigned char)*text))
+			text++;
+		if (*text != '\0')
+			return Trace_Parse(text, state);
+	}
+}
+
+const int Trace_Validate(CPU* cpu,
+                         Mem* mem,
+                         FILE* reference,
+                         Trace_Divergence* divergence)
+{
+	char* line = NULL;
+	size_t capacity = 0;
+	Trace_State first;
+	int result;
+
+	divergence->line = 0;
+	divergence->fields = 0;
+
+	result = read_state(reference, &line, &capacity, &divergence->line, &first);
+	if (result != 0)
+	{
+		free(line);
+		return (result < 0) ? -1 : 0;
+	}
+
+	cpu->PC = first.PC;
+	cpu->A = first.A;
+	cpu->X = first.X;
+	cpu->Y = first.Y;
+	cpu->SP = first.SP;
+	CPU_Set_Status(cpu, first.P);
+
+	const u64 start = cpu->Cycles;
+
+	while ((result = read_state(reference, &line, &capacity,
+	                            &divergence->line,
+	                            &divergence->expected)) == 0)
+	{
+		CPU_Execute(cpu, mem, 1);
+
+		Trace_Capture(cpu, &divergence->actual);
+		divergence->actual.Cycles += first.Cycles - start;
+		divergence->actual.Has_Cycles = first.Has_Cycles;
+
+		divergence->fields = Trace_Compare(&divergence->expected,
+		                                   &divergence->actual);
+		if (divergence->fields != 0)
+			break;
+	}
+
+	free(line);
+
+	if (result > 0)
+		return 0;
+	return (result < 0) ? -1 : 1;
+}
@@ -0,0 +1,162 @@
+#ifndef TRACE_h
+#define TRACE_h
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cpu.h"
+#include "disassembler.h"
+
+// Fields of a state, used to report which ones diverged
+#define TRACE_PC     0x01
+#define TRACE_A      0x02
+#define TRACE_X      0x04
+#define TRACE_Y      0x08
+#define TRACE_P      0x10
+#define TRACE_SP     0x20
+#define TRACE_CYCLES 0x40
+
+// B and the unused bit only exist on the stack, they are never compared
+#define TRACE_STATUS_MASK 0xCF
+
+/*
+ * The state of a cpu before executing the instruction at PC, as logged by
+ * nestest: "C000  4C F5 C5  JMP $C5F5  A:00 X:00 Y:00 P:24 SP:FD ... CYC:7".
+ * Only the leading PC and the register fields are read, so logs written by
+ * Trace_Write and other emulators with the same fields work too.
+ */
+typedef struct Trace_State
+{
+	Word PC;
+	Byte A, X, Y, P, SP;
+	u64 Cycles;
+	Byte Has_Cycles;	// CYC: is optional
+} Trace_State;
+
+/*
+ * The state before an instruction, as recorded while running. Records are
+ * only copied, never formatted, which is left to Trace_Render once the run
+ * is over. The bytes of the instruction are kept, so code that modifies
+ * itself is rendered as it was executed.
+ */
+typedef struct Trace_Record
+{
+	u64 Cycles;
+	Word PC;
+	Byte A, X, Y, P, SP;
+	Byte Bytes[3];		// The opcode and up to two operand bytes
+} Trace_Record;
+
+/*
+ * Records in memory. Full buffers are written to File as they are, in host
+ * byte order, for Trace_Read to read back. Without a file the buffer is a
+ * ring that keeps the latest records.
+ */
+typedef struct Trace_Buffer
+{
+	Trace_Record* Records;
+	size_t Capacity;
+	size_t Count;		// Records held
+	size_t Next;		// Where the next record goes
+	FILE* File;
+} Trace_Buffer;
+
+typedef struct Trace_Divergence
+{
+	size_t line;				// Line of the reference log
+	Byte fields;				// TRACE_* bits that differ
+	Trace_State expected;
+	Trace_State actual;
+} Trace_Divergence;
+
+
+void Trace_Capture(const CPU* cpu, Trace_State* state);
+const int Trace_Parse(const char* line, Trace_State* state);
+const Byte Trace_Compare(const Trace_State* expected,
+                         const Trace_State* actual);
+const int Trace_Format(const Trace_State* state,
+                       char* buffer,
+                       const size_t size);
+
+/**
+ * @brief Append the state of the cpu to a log as one line.
+ *
+ * Running a programme while writing its log after every instruction turns a
+ * trusted (e.g. unoptimised) build into a reference for Trace_Validate.
+ *
+ * @return 0 on success, -1 if the line could not be written
+*/
+const int Trace_Write(const CPU* cpu, FILE* log);
+
+/**
+ * @brief Allocate a buffer of capacity records, written to file when full.
+ *
+ * @param file where full buffers go, NULL to keep the latest records
+ * @return 0 on success, -1 if out of memory
+*/
+const int Trace_Buffer_Initialise(Trace_Buffer* buffer,
+                                  const size_t capacity,
+                                  FILE* file);
+void Trace_Buffer_Free(Trace_Buffer* buffer);
+
+/**
+ * @brief Record the state of the cpu before its next instruction.
+ *
+ * @return 0 on success, -1 if a full buffer could not be written
+*/
+const int Trace_Buffer_Append(Trace_Buffer* buffer,
+                              const CPU* cpu,
+                              const Mem* mem);
+
+/**
+ * @brief Write the records held to the buffer's file, oldest first, and
+ * empty it. Does nothing without a file.
+ *
+ * @return 0 on success, -1 if they could not be written
+*/
+const int Trace_Buffer_Flush(Trace_Buffer* buffer);
+
+/**
+ * @brief The index-th record held, counting from the oldest one.
+*/
+const Trace_Record* Trace_Buffer_Get(const Trace_Buffer* buffer,
+                                     const size_t index);
+
+/**
+ * @brief Read the next record written by Trace_Buffer_Flush.
+ *
+ * @return 1 if a record was read, 0 at the end of the file, -1 on errors
+*/
+const int Trace_Read(FILE* file, Trace_Record* record);
+
+/**
+ * @brief Render a record as one nestest style line with its disassembly,
+ * e.g. "C000  A9 80     LDA #$80  A:00 X:00 Y:00 P:24 SP:FD CYC:7", which
+ * Trace_Parse can read back.
+ *
+ * @param symbols names of addresses used in operands, may be NULL
+ * @return the length of the line, -1 if the variant is invalid
+*/
+const int Trace_Render(const Trace_Record* record,
+                       const CPU_Variant variant,
+                       const Symbols* symbols,
+                       char* buffer,
+                       const size_t size);
+
+/**
+ * @brief Execute the cpu in lockstep with a reference log.
+ *
+ * The cpu starts from the state of the first line, which also sets the
+ * origin of the cycle count. Every following line is compared with the state
+ * after executing one more instruction. The log is streamed line by line so
+ * its size does not matter. Blank lines are skipped.
+ *
+ * @return 0 if the whole log matched, 1 on the first divergence, -1 if a
+ * line could not be read; divergence->line tells which one
+*/
+const int Trace_Validate(CPU* cpu,
+                         Mem* mem,
+                         FILE* reference,
+                         Trace_Divergence* divergence);
+
+#endif // !TRACE_h
@@ -1,14 +1,14 @@
-#ifndef UTIL_h
-#define UTIL_h
-
-#include <assert.h>
-#include <stdarg.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-
-#define MAX_ITERATIONS 2500000
-
-void die(const char* format, ...);
-
-#endif // !UTIL_h
+#ifndef UTIL_h
+#define UTIL_h
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_ITERATIONS 2500000
+
+void die(const char* format, ...);
+
+#endif // !UTIL_h
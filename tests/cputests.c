@@ -1,81 +1,497 @@
-/*
- * Author:··········Malik Abdoul Hamidou
- * Date Created:····2024-02-14
- * Date Changed:····2024-03-02
- * Description:·····A small sample programme, demonstrating the emulator
- * License:·········GPL3 (See LICENCE)
-*/
-
-#include <criterion/criterion.h>
-#include <ctype.h>
-#include <time.h>
-
-#include "../src/cpu.h"
-#include "../src/runner.h"
-#include "../src/util.h"
-
-Test(cputests, jsr)
-{
-	srand(time(NULL));
-	Word address = rand() % 0xFFFF;
-
-	CPU cpu;
-	Mem mem;
-
-	MOS_6502_set_endianness(AUTO);
-	CPU_Reset(&cpu, &mem);
-	Set_Memory(&mem, 0xFFFC, INSTRUCTION_JSR_ABSOLUTE);
-	Set_Memory(&mem, 0xFFFD, address);
-
-	cr_expect(cpu.PC == address, "JSR did not jump to the correct address.");
-}
-
-/*int main(int argc, char** argv, char** envp)
-{
-	Mem mem;
-	CPU cpu;
-	int err = 0;
-
-	MOS_6502_set_endianness(AUTO);
-
-	CPU_Reset(&cpu, &mem);
-
-	cpu.X = 0x0002;
-    err += Set_Memory(&mem, 0xFFFC, INSTRUCTION_JSR_ABSOLUTE);
-    err += Set_Memory(&mem, 0xFFFD, 0x11);
-    err += Set_Memory(&mem, 0xFFFE, 0x11);
-	err += Set_Memory(&mem, 0x1111, INSTRUCTION_JMP_ABSOLUTE);
-	err += Set_Memory(&mem, 0x1112, 0xFC);
-	err += Set_Memory(&mem, 0x1113, 0xEF);
-	err += Set_Memory(&mem, 0xEFFC, INSTRUCTION_LDA_ZEROPAGEX);
-	err += Set_Memory(&mem, 0xEFFD, 0x40);
-	err += Set_Memory(&mem, 0x0042, 0xff);
-	err += Set_Memory(&mem, 0xEFFF, INSTRUCTION_ADC_IMMEDIATE);
-	err += Set_Memory(&mem, 0xF000, 0x05);
-
-	if (err != 0)
-	{
-		(void)perror("Memset failed");
-		exit(EXIT_FAILURE);
-	}
-
-	CPU_Execute(&cpu, &mem, 14);
-
-	(void)printf("Accumulator: %d\n", cpu.A);
-	(void)printf("Carry: %d\nOverflow: %d\nZero: %d\nNegative: %d\n", cpu.C, cpu.V, cpu.Z, cpu.N);
-
-	const char* test = "_label  #48 ;A Comment\nNewLine $47a 'zusasdfasdfaw4534tdgr dsf";
-	Lexer lexer = Lexer_Initialise(test, strlen(test));
-
-	TokenList* tokens = Lexer_Run(&lexer);
-
-	for (int i = 0; i < tokens->current_size; i++)
-		(void)printf("%.*s (%s)\n", 
-		(int) tokenlist_get(tokens, i).value_size,
-		tokenlist_get(tokens, i).value,
-		token_name(tokenlist_get(tokens, i).type));
-
-	free(tokens);
-
-	return 0;
-}*/
+/*
+ * Author:··········Malik Abdoul Hamidou
+ * Date Created:····2024-02-14
+ * Date Changed:····2024-03-02
+ * Description:·····A small sample programme, demonstrating the emulator
+ * License:·········GPL3 (See LICENCE)
+*/
+
+#include <criterion/criterion.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "../src/cpu.h"
+#include "../src/runner.h"
+#include "../src/util.h"
+
+Test(cputests, jsr)
+{
+	srand(time(NULL));
+	Word address = rand() % 0xFFFF;
+
+	CPU cpu;
+	Mem mem;
+
+	MOS_6502_set_endianness(AUTO);
+	CPU_Reset(&cpu, &mem);
+	Set_Memory(&mem, 0xFFFC, INSTRUCTION_JSR_ABSOLUTE);
+	Set_Memory(&mem, 0xFFFD, address & 0xFF);
+	Set_Memory(&mem, 0xFFFE, address >> 8);
+
+	CPU_Execute(&cpu, &mem, 6);
+
+	cr_expect(cpu.PC == address, "JSR did not jump to the correct address.");
+	cr_expect(cpu.SP == 0xFD, "JSR did not push the return address.");
+	cr_expect(Get_Memory(&mem, 0x01FF) == 0xFF
+	       && Get_Memory(&mem, 0x01FE) == 0xFE,
+	          "JSR pushed the wrong return address.");
+}
+
+static void run_decimal(CPU* cpu, Mem* mem, const Byte opcode,
+                        const Byte carry, const Byte a, const Byte input)
+{
+	CPU_Reset(cpu, mem);
+	Set_Memory(mem, 0xFFFC, INSTRUCTION_SED);
+	Set_Memory(mem, 0xFFFD, carry ? INSTRUCTION_SEC : INSTRUCTION_CLC);
+	Set_Memory(mem, 0xFFFE, INSTRUCTION_LDA_IMMEDIATE);
+	Set_Memory(mem, 0xFFFF, a);
+	Set_Memory(mem, 0x0000, opcode);
+	Set_Memory(mem, 0x0001, input);
+
+	CPU_Execute(cpu, mem, 8);
+}
+
+Test(cputests, adc_decimal)
+{
+	CPU cpu;
+	Mem mem;
+
+	run_decimal(&cpu, &mem, INSTRUCTION_ADC_IMMEDIATE, 0, 0x15, 0x27);
+	cr_expect(cpu.A == 0x42 && cpu.C == 0, "15 + 27 should be 42.");
+
+	run_decimal(&cpu, &mem, INSTRUCTION_ADC_IMMEDIATE, 1, 0x58, 0x46);
+	cr_expect(cpu.A == 0x05 && cpu.C == 1, "58 + 46 + 1 should be 105.");
+
+	// Z comes from the binary sum, N from the unadjusted high digit
+	run_decimal(&cpu, &mem, INSTRUCTION_ADC_IMMEDIATE, 0, 0x99, 0x01);
+	cr_expect(cpu.A == 0x00 && cpu.C == 1, "99 + 01 should be 100.");
+	cr_expect(cpu.Z == 0 && cpu.N == 1, "NMOS Z/N quirk not reproduced.");
+
+	run_decimal(&cpu, &mem, INSTRUCTION_ADC_IMMEDIATE, 0, 0x81, 0x92);
+	cr_expect(cpu.A == 0x73 && cpu.C == 1, "81 + 92 should be 173.");
+	cr_expect(cpu.V == 1 && cpu.N == 0, "NMOS V/N quirk not reproduced.");
+}
+
+Test(cputests, sbc_decimal)
+{
+	CPU cpu;
+	Mem mem;
+
+	run_decimal(&cpu, &mem, INSTRUCTION_SBC_IMMEDIATE, 1, 0x42, 0x15);
+	cr_expect(cpu.A == 0x27 && cpu.C == 1, "42 - 15 should be 27.");
+
+	run_decimal(&cpu, &mem, INSTRUCTION_SBC_IMMEDIATE, 0, 0x40, 0x13);
+	cr_expect(cpu.A == 0x26 && cpu.C == 1, "40 - 13 - 1 should be 26.");
+
+	run_decimal(&cpu, &mem, INSTRUCTION_SBC_IMMEDIATE, 1, 0x15, 0x27);
+	cr_expect(cpu.A == 0x88 && cpu.C == 0, "15 - 27 should borrow to 88.");
+	cr_expect(cpu.N == 1 && cpu.Z == 0, "Flags should match binary mode.");
+}
+
+// The 65C02 takes a cycle more in decimal mode, in every addressing mode
+Test(cputests, cmos_decimal)
+{
+	CPU cpu;
+	Mem mem;
+	const Byte opcodes[] = { INSTRUCTION_ADC_IMMEDIATE, INSTRUCTION_SBC_IMMEDIATE,
+	                         INSTRUCTION_ADC_ZEROPAGE, INSTRUCTION_SBC_ZEROPAGE };
+	const u64 cycles[] = { 3, 3, 4, 4 };
+
+	for (int i = 0; i < 4; i++)
+	{
+		CPU_Initialise(&cpu, &mem, VARIANT_CMOS);
+		cpu.D = 1;
+		cpu.C = (i % 2);
+		cpu.A = 0x99;
+		Set_Memory(&mem, 0xFFFC, opcodes[i]);
+		Set_Memory(&mem, 0xFFFD, 0x01);
+		Set_Memory(&mem, 0x0001, 0x01);
+
+		CPU_Execute(&cpu, &mem, 1);
+
+		cr_expect(cpu.Cycles == cycles[i],
+		          "Opcode %02X took %llu cycles in decimal mode.",
+		          opcodes[i], cpu.Cycles);
+		cr_expect(cpu.A == ((i % 2) ? 0x98 : 0x00),
+		          "Opcode %02X computed %02X.", opcodes[i], cpu.A);
+	}
+
+	// Unlike the NMOS, Z comes from the decimal result
+	CPU_Initialise(&cpu, &mem, VARIANT_CMOS);
+	cpu.D = 1;
+	cpu.A = 0x99;
+	Set_Memory(&mem, 0xFFFC, INSTRUCTION_ADC_IMMEDIATE);
+	Set_Memory(&mem, 0xFFFD, 0x01);
+	CPU_Execute(&cpu, &mem, 1);
+	cr_expect(cpu.A == 0x00 && cpu.Z == 1 && cpu.C == 1);
+}
+
+Test(cputests, lax_undocumented)
+{
+	CPU cpu;
+	Mem mem;
+
+	CPU_Initialise(&cpu, &mem, VARIANT_NMOS);
+	Set_Memory(&mem, 0xFFFC, INSTRUCTION_LAX_ZEROPAGE);
+	Set_Memory(&mem, 0xFFFD, 0x42);
+	Set_Memory(&mem, 0x0042, 0x80);
+
+	CPU_Execute(&cpu, &mem, 3);
+
+	cr_expect(cpu.A == 0x80 && cpu.X == 0x80, "LAX did not load A and X.");
+	cr_expect(cpu.N == 1 && cpu.Z == 0, "LAX set the wrong flags.");
+	cr_expect(cpu.PC == 0xFFFE, "LAX did not consume its operand.");
+}
+
+Test(cputests, dcp_isc_undocumented)
+{
+	CPU cpu;
+	Mem mem;
+
+	CPU_Initialise(&cpu, &mem, VARIANT_NMOS);
+	cpu.A = 0x10;
+	Set_Memory(&mem, 0xFFFC, INSTRUCTION_DCP_ZEROPAGE);
+	Set_Memory(&mem, 0xFFFD, 0x20);
+	Set_Memory(&mem, 0xFFFE, INSTRUCTION_ISC_ZEROPAGE);
+	Set_Memory(&mem, 0xFFFF, 0x21);
+	Set_Memory(&mem, 0x0020, 0x11);
+	Set_Memory(&mem, 0x0021, 0x04);
+
+	CPU_Execute(&cpu, &mem, 10);
+
+	cr_expect(Get_Memory(&mem, 0x0020) == 0x10, "DCP did not decrement.");
+	cr_expect(Get_Memory(&mem, 0x0021) == 0x05, "ISC did not increment.");
+	cr_expect(cpu.A == 0x0B, "ISC did not subtract the incremented value.");
+}
+
+Test(cputests, strict_variant)
+{
+	CPU cpu;
+	Mem mem;
+
+	CPU_Initialise(&cpu, &mem, VARIANT_NMOS_STRICT);
+	Set_Memory(&mem, 0xFFFC, INSTRUCTION_LAX_ZEROPAGE);
+	Set_Memory(&mem, 0x0000, 0x80);
+
+	CPU_Execute(&cpu, &mem, 2);
+
+	cr_expect(cpu.A == 0 && cpu.X == 0, "Strict NMOS executed LAX.");
+}
+
+Test(cputests, illegal_halts)
+{
+	CPU cpu;
+	Mem mem;
+
+	CPU_Initialise(&cpu, &mem, VARIANT_NMOS_STRICT);
+	for (Word i = 0; i < 0x20; i++)
+		Set_Memory(&mem, 0xFFE0 + i, INSTRUCTION_LAX_ZEROPAGE);
+	cpu.PC = 0xFFE0;
+
+	cr_expect(CPU_Execute(&cpu, &mem, 1000) == HALT_ILLEGAL,
+	          "Illegal opcodes should halt the cpu instead of exiting.");
+	cr_expect(cpu.Errors == MAX_ERRORS && cpu.PC == 0xFFE0 + MAX_ERRORS,
+	          "The cpu should halt on the last tolerated illegal opcode.");
+	cr_expect(CPU_Initialise(&cpu, &mem, (CPU_Variant)42) == -1,
+	          "Invalid variants should be rejected.");
+}
+
+Test(cputests, jam)
+{
+	CPU cpu;
+	Mem mem;
+
+	CPU_Initialise(&cpu, &mem, VARIANT_NMOS);
+	Set_Memory(&mem, 0xFFFC, INSTRUCTION_JAM);
+
+	CPU_Execute(&cpu, &mem, 100);
+
+	cr_expect(cpu.Halted == HALT_JAM, "JAM did not halt the cpu.");
+	cr_expect(cpu.PC == 0xFFFC, "JAM did not stay on its opcode.");
+}
+
+Test(cputests, jmp_indirect_page_wrap)
+{
+	CPU cpu;
+	Mem mem;
+
+	CPU_Variant variants[] = { VARIANT_NMOS, VARIANT_CMOS };
+	Word expected[] = { 0x1234, 0x5634 };
+
+	for (int i = 0; i < 2; i++)
+	{
+		CPU_Initialise(&cpu, &mem, variants[i]);
+		Set_Memory(&mem, 0xFFFC, INSTRUCTION_JMP_INDIRECT);
+		Set_Memory(&mem, 0xFFFD, 0xFF);
+		Set_Memory(&mem, 0xFFFE, 0x02);
+		Set_Memory(&mem, 0x02FF, 0x34);
+		Set_Memory(&mem, 0x0200, 0x12);
+		Set_Memory(&mem, 0x0300, 0x56);
+
+		CPU_Execute(&cpu, &mem, 5);
+
+		cr_expect(cpu.PC == expected[i], "JMP indirect went to %04X.", cpu.PC);
+	}
+}
+
+Test(cputests, cmos_instructions)
+{
+	CPU cpu;
+	Mem mem;
+
+	CPU_Initialise(&cpu, &mem, VARIANT_CMOS);
+	cpu.X = 0x07;
+	Set_Memory(&mem, 0x0010, 0xAA);
+	Set_Memory(&mem, 0xFFFC, INSTRUCTION_STZ_ZEROPAGE);
+	Set_Memory(&mem, 0xFFFD, 0x10);
+	Set_Memory(&mem, 0xFFFE, INSTRUCTION_PHX);
+	Set_Memory(&mem, 0xFFFF, INSTRUCTION_PLY);
+	Set_Memory(&mem, 0x0000, INSTRUCTION_BRA_RELATIVE);
+	Set_Memory(&mem, 0x0001, 0x10);
+
+	CPU_Execute(&cpu, &mem, 3 + 3 + 4 + 3);
+
+	cr_expect(Get_Memory(&mem, 0x0010) == 0, "STZ did not clear memory.");
+	cr_expect(cpu.Y == 0x07 && cpu.SP == 0xFF, "PHX/PLY did not move X to Y.");
+	cr_expect(cpu.PC == 0x0012, "BRA did not branch.");
+}
+
+Test(cputests, subroutine_roundtrip)
+{
+	CPU cpu;
+	Mem mem;
+
+	CPU_Reset(&cpu, &mem);
+	Set_Memory(&mem, 0xFFFC, INSTRUCTION_JSR_ABSOLUTE);
+	Set_Memory(&mem, 0xFFFD, 0x00);
+	Set_Memory(&mem, 0xFFFE, 0x20);
+	Set_Memory(&mem, 0x2000, INSTRUCTION_LDA_IMMEDIATE);
+	Set_Memory(&mem, 0x2001, 0x99);
+	Set_Memory(&mem, 0x2002, INSTRUCTION_PHA);
+	Set_Memory(&mem, 0x2003, INSTRUCTION_PLP);
+	Set_Memory(&mem, 0x2004, INSTRUCTION_RTS_IMPLIED);
+
+	CPU_Execute(&cpu, &mem, 6 + 2 + 3 + 4 + 6);
+
+	cr_expect(cpu.PC == 0xFFFF, "RTS did not return after the JSR.");
+	cr_expect(cpu.SP == 0xFF, "The stack is unbalanced.");
+	cr_expect(CPU_Get_Status(&cpu) == 0xA9, "PLP restored the wrong status.");
+}
+
+Test(cputests, stack_wrap)
+{
+	CPU cpu;
+	Mem mem;
+
+	CPU_Initialise(&cpu, &mem, VARIANT_NMOS);
+	Set_Memory(&mem, 0x0600, INSTRUCTION_JSR_ABSOLUTE);
+	Set_Memory(&mem, 0x0601, 0x00);
+	Set_Memory(&mem, 0x0602, 0x07);
+	Set_Memory(&mem, 0x0700, INSTRUCTION_PHP);
+	Set_Memory(&mem, 0x0701, INSTRUCTION_PLA);
+	Set_Memory(&mem, 0x0702, INSTRUCTION_RTS_IMPLIED);
+	cpu.PC = 0x0600;
+	cpu.SP = 0x00;
+
+	CPU_Execute(&cpu, &mem, 6);
+	cr_expect(cpu.SP == 0xFE && Get_Memory(&mem, 0x0100) == 0x06
+	          && Get_Memory(&mem, 0x01FF) == 0x02,
+	          "JSR should wrap around within the stack page.");
+
+	CPU_Execute(&cpu, &mem, 3 + 4 + 6);
+	cr_expect(cpu.PC == 0x0603 && cpu.SP == 0x00,
+	          "RTS should pull the return address across the wrap.");
+	cr_expect(cpu.A == 0x34,
+	          "PHP should push the status with B set.");
+}
+
+Test(cputests, page_cross_penalty)
+{
+	CPU cpu;
+	Mem mem;
+
+	// LDA $10FF,X takes 5 cycles, so LDX # does not fit into the budget
+	Byte low[] = { 0xFF, 0x00 };
+	Byte expected[] = { 0x01, 0x05 };
+
+	for (int i = 0; i < 2; i++)
+	{
+		CPU_Reset(&cpu, &mem);
+		cpu.X = 0x01;
+		Set_Memory(&mem, 0xFFFC, INSTRUCTION_LDA_ABSOLUTEX);
+		Set_Memory(&mem, 0xFFFD, low[i]);
+		Set_Memory(&mem, 0xFFFE, 0x10);
+		Set_Memory(&mem, 0xFFFF, INSTRUCTION_LDX_IMMEDIATE);
+		Set_Memory(&mem, 0x0000, 0x05);
+
+		CPU_Execute(&cpu, &mem, 5);
+
+		cr_expect(cpu.X == expected[i], "Wrong page crossing penalty.");
+	}
+}
+
+Test(cputests, word_access)
+{
+	CPU cpu;
+	Mem mem;
+	u32 cycles = 4;
+
+	CPU_Reset(&cpu, &mem);
+	Set_Memory(&mem, 0x1000, 0x34);
+	Set_Memory(&mem, 0x1001, 0x12);
+	Set_Memory(&mem, 0xFFFF, 0x78);
+	Set_Memory(&mem, 0x0000, 0x56);
+
+	cr_expect(Mem_Read_Word(&cpu, &mem, &cycles, 0x1000) == 0x1234,
+	          "Words are not read as little endian.");
+	cr_expect(Mem_Read_Word(&cpu, &mem, &cycles, 0xFFFF) == 0x5678,
+	          "Word reads do not wrap around the address space.");
+	cr_expect(cycles == 0, "Each word read should take two cycles.");
+}
+
+Test(cputests, traps)
+{
+	CPU cpu;
+	Mem mem;
+	const Byte programme[] = {
+		INSTRUCTION_LDA_IMMEDIATE, 0x01,
+		INSTRUCTION_STA_ZEROPAGE, 0x10,
+		INSTRUCTION_LDA_ZEROPAGE, 0x11,
+		INSTRUCTION_INX,
+		INSTRUCTION_JAM,
+	};
+
+	CPU_Reset(&cpu, &mem);
+	for (Word i = 0; i < sizeof(programme); i++)
+		Set_Memory(&mem, 0x0200 + i, programme[i]);
+	cpu.PC = 0x0200;
+
+	cr_expect(Mem_Set_Trap(&mem, 0x0010, TRAP_NONE) == -1,
+	          "Setting no kind of trap should fail.");
+	Mem_Set_Trap(&mem, 0x0206, TRAP_EXECUTE);
+	Mem_Set_Trap(&mem, 0x0010, TRAP_WRITE);
+	Mem_Set_Trap(&mem, 0x0011, TRAP_READ);
+	Mem_Set_Trap(&mem, 0x0201, TRAP_READ);	// Immediate data is fetched
+
+	CPU_Execute(&cpu, &mem, 100);
+	cr_expect(cpu.Trap == TRAP_WRITE && cpu.Trap_Address == 0x0010,
+	          "Writing a watched address should stop execution.");
+	cr_expect(cpu.PC == 0x0204 && Get_Memory(&mem, 0x0010) == 0x01,
+	          "A watchpoint should stop after the instruction completes.");
+	Mem_Clear_Trap(&mem, 0x0201, TRAP_READ);
+
+	CPU_Execute(&cpu, &mem, 100);
+	cr_expect(cpu.Trap == TRAP_READ && cpu.Trap_Address == 0x0011,
+	          "Reading a watched address should stop execution.");
+
+	Mem_Clear_Trap(&mem, 0x0206, TRAP_EXECUTE);
+	Mem_Set_Trap(&mem, 0x0207, TRAP_EXECUTE);
+	CPU_Execute(&cpu, &mem, 100);
+	cr_expect(cpu.Trap == TRAP_EXECUTE && cpu.PC == 0x0207 && cpu.X == 1,
+	          "A removed breakpoint should not stop execution.");
+
+	CPU_Execute(&cpu, &mem, 100);
+	cr_expect(cpu.Trap == TRAP_NONE && cpu.Halted,
+	          "Execution should resume past the breakpoint it stopped at.");
+	cr_expect(mem.Traps[0x02] == TRAP_EXECUTE && mem.Traps[0x00] != 0,
+	          "Page flags should only keep the traps still set.");
+
+	Mem_Clear_Traps(&mem);
+	cr_expect(mem.Traps[0x00] == TRAP_NONE && mem.Traps[0x02] == TRAP_NONE,
+	          "Clearing all traps should clear every page.");
+}
+
+// Skipping idle loops must leave the cpu exactly where stepping leaves it
+static void run_stepped_and_whole(const Byte* programme, const Word size,
+                                  CPU* stepped, CPU* whole, const u32 cycles)
+{
+	Mem mem;
+
+	CPU_Initialise(stepped, &mem, VARIANT_NMOS);
+	for (Word i = 0; i < size; i++)
+		Set_Memory(&mem, 0x0600 + i, programme[i]);
+	stepped->PC = 0x0600;
+	*whole = *stepped;
+
+	while (stepped->Cycles < cycles)
+		CPU_Execute(stepped, &mem, 1);
+	CPU_Execute(whole, &mem, cycles);
+}
+
+Test(cputests, idle_loop)
+{
+	CPU stepped, whole;
+	const Byte poll[] = {
+		INSTRUCTION_LDA_ZEROPAGE, 0x10,		// 0600 LDA $10
+		INSTRUCTION_CMP_IMMEDIATE, 0x03,	// 0602 CMP #3
+		INSTRUCTION_BNE_RELATIVE, 0xFA,		// 0604 BNE $0600
+	};
+	const Byte count[] = {
+		INSTRUCTION_DEX,					// 0600 DEX
+		INSTRUCTION_BNE_RELATIVE, 0xFD,		// 0601 BNE $0600
+		INSTRUCTION_STX_ZEROPAGE, 0x10,		// 0603 STX $10
+		INSTRUCTION_JMP_ABSOLUTE, 0x03, 0x06,	// 0605 JMP $0603
+	};
+
+	run_stepped_and_whole(poll, sizeof(poll), &stepped, &whole, 100003);
+	cr_expect(whole.Cycles == stepped.Cycles && whole.PC == stepped.PC
+	          && whole.Instructions == stepped.Instructions
+	          && whole.A == stepped.A && whole.X == stepped.X
+	          && CPU_Get_Status(&whole) == CPU_Get_Status(&stepped),
+	          "Skipping a polling loop should credit the cycles it would use.");
+
+	run_stepped_and_whole(count, sizeof(count), &stepped, &whole, 100003);
+	cr_expect(whole.Cycles == stepped.Cycles && whole.PC == stepped.PC
+	          && whole.Instructions == stepped.Instructions,
+	          "Loops with changing registers or stores should run normally.");
+}
+
+/*int main(int argc, char** argv, char** envp)
+{
+	Mem mem;
+	CPU cpu;
+	int err = 0;
+
+	MOS_6502_set_endianness(AUTO);
+
+	CPU_Reset(&cpu, &mem);
+
+	cpu.X = 0x0002;
+    err += Set_Memory(&mem, 0xFFFC, INSTRUCTION_JSR_ABSOLUTE);
+    err += Set_Memory(&mem, 0xFFFD, 0x11);
+    err += Set_Memory(&mem, 0xFFFE, 0x11);
+	err += Set_Memory(&mem, 0x1111, INSTRUCTION_JMP_ABSOLUTE);
+	err += Set_Memory(&mem, 0x1112, 0xFC);
+	err += Set_Memory(&mem, 0x1113, 0xEF);
+	err += Set_Memory(&mem, 0xEFFC, INSTRUCTION_LDA_ZEROPAGEX);
+	err += Set_Memory(&mem, 0xEFFD, 0x40);
+	err += Set_Memory(&mem, 0x0042, 0xff);
+	err += Set_Memory(&mem, 0xEFFF, INSTRUCTION_ADC_IMMEDIATE);
+	err += Set_Memory(&mem, 0xF000, 0x05);
+
+	if (err != 0)
+	{
+		(void)perror("Memset failed");
+		exit(EXIT_FAILURE);
+	}
+
+	CPU_Execute(&cpu, &mem, 14);
+
+	(void)printf("Accumulator: %d\n", cpu.A);
+	(void)printf("Carry: %d\nOverflow: %d\nZero: %d\nNegative: %d\n", cpu.C, cpu.V, cpu.Z, cpu.N);
+
+	const char* test = "_label  #48 ;A Comment\nNewLine $47a 'zusasdfasdfaw4534tdgr dsf";
+	Lexer lexer = Lexer_Initialise(test, strlen(test));
+
+	TokenList* tokens = Lexer_Run(&lexer);
+
+	for (int i = 0; i < tokens->current_size; i++)
+		(void)printf("%.*s (%s)\n", 
+		(int) tokenlist_get(tokens, i).value_size,
+		tokenlist_get(tokens, i).value,
+		token_name(tokenlist_get(tokens, i).type));
+
+	free(tokens);
+
+	return 0;
+}*/
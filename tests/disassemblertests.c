@@ -0,0 +1,123 @@
+#include <criterion/criterion.h>
+
+#include "../src/cpu.h"
+#include "../src/disassembler.h"
+
+static void expect_disassembly(const CPU_Variant variant,
+                               const Byte* bytes,
+                               const char* expected,
+                               const int size)
+{
+	char text[DISASSEMBLY_SIZE];
+	const int length = Disassemble(variant, 0xC000, bytes, NULL,
+	                               text, sizeof(text));
+
+	cr_expect(length == size, "%s: expected %d bytes, got %d.",
+	          expected, size, length);
+	cr_expect_str_eq(text, expected);
+}
+
+Test(disassemblertests, addressing_modes)
+{
+	expect_disassembly(VARIANT_NMOS, (Byte[]){ 0x18 }, "CLC", 1);
+	expect_disassembly(VARIANT_NMOS, (Byte[]){ 0x0A }, "ASL A", 1);
+	expect_disassembly(VARIANT_NMOS, (Byte[]){ 0xA9, 0x10 }, "LDA #$10", 2);
+	expect_disassembly(VARIANT_NMOS, (Byte[]){ 0xB6, 0x20 }, "LDX $20,Y", 2);
+	expect_disassembly(VARIANT_NMOS, (Byte[]){ 0xBD, 0x00, 0x30 },
+	                   "LDA $3000,X", 3);
+	expect_disassembly(VARIANT_NMOS, (Byte[]){ 0x6C, 0xFC, 0xFF },
+	                   "JMP ($FFFC)", 3);
+	expect_disassembly(VARIANT_NMOS, (Byte[]){ 0xA1, 0x50 }, "LDA ($50,X)", 2);
+	expect_disassembly(VARIANT_NMOS, (Byte[]){ 0xB1, 0x60 }, "LDA ($60),Y", 2);
+	expect_disassembly(VARIANT_NMOS, (Byte[]){ 0xD0, 0xFE }, "BNE $C000", 2);
+	expect_disassembly(VARIANT_NMOS, (Byte[]){ 0x10, 0x10 }, "BPL $C012", 2);
+
+	// Undocumented opcodes, which the strict variant treats as illegal
+	expect_disassembly(VARIANT_NMOS, (Byte[]){ 0xB3, 0x40 }, "LAX ($40),Y", 2);
+	expect_disassembly(VARIANT_NMOS_STRICT, (Byte[]){ 0xB3, 0x40 }, "???", 1);
+
+	expect_disassembly(VARIANT_CMOS, (Byte[]){ 0xB2, 0x20 }, "LDA ($20)", 2);
+	expect_disassembly(VARIANT_CMOS, (Byte[]){ 0x7C, 0x34, 0x12 },
+	                   "JMP ($1234,X)", 3);
+	expect_disassembly(VARIANT_CMOS, (Byte[]){ 0x8F, 0x10, 0x03 },
+	                   "BBS0 $10,$C006", 3);
+}
+
+Test(disassemblertests, symbols)
+{
+	Mem mem;
+	Symbols symbols;
+	char text[DISASSEMBLY_SIZE];
+	const char* source =
+		"start:  LDA counter\n"
+		"again:  BNE start\n"
+		"        JMP (vector)\n"
+		"counter: BRK\n"
+		"vector:  BRK\n";
+
+	Mem_Initialise(&mem);
+	Lexer lexer = Lexer_Initialise(source, strlen(source));
+	TokenList* tokens = Lexer_Run(&lexer);
+	Assembler assembler = Assembler_Initialise(&mem, 0x0600);
+
+	cr_assert(Assembler_Run(&assembler, tokens) == 0,
+	          "Assembly failed: %s", assembler.error);
+	cr_assert(Symbols_Load(&symbols, &assembler) == 0);
+	Assembler_Free(&assembler);
+	tokenlist_free(tokens);
+
+	cr_expect_str_eq(Symbols_Find(&symbols, 0x0600), "start");
+	cr_expect(Symbols_Find(&symbols, 0x0601) == NULL);
+
+	const char* expected[] =
+		{ "LDA counter", "BNE start", "JMP (vector)", "BRK", "BRK" };
+	Word address = 0x0600;
+
+	for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++)
+	{
+		const Byte bytes[3] = {
+			Get_Memory(&mem, address),
+			Get_Memory(&mem, address + 1),
+			Get_Memory(&mem, address + 2),
+		};
+
+		address += Disassemble(VARIANT_NMOS_STRICT, address, bytes, &symbols,
+		                       text, sizeof(text));
+		cr_expect_str_eq(text, expected[i]);
+	}
+
+	Symbols_Free(&symbols);
+}
+
+// Every documented opcode reassembles to itself
+Test(disassemblertests, round_trip)
+{
+	Mem mem;
+	char text[DISASSEMBLY_SIZE];
+
+	for (int opcode = 0; opcode < 256; opcode++)
+	{
+		const Opcode_Info* info = CPU_Opcode_Info(VARIANT_CMOS, opcode);
+		const Byte bytes[3] = { opcode, 0x12, 0x34 };
+
+		if (!info->Documented || info->Mode == MODE_RELATIVE
+			|| info->Mode == MODE_ZEROPAGE_RELATIVE)
+			continue;
+
+		(void)Disassemble(VARIANT_CMOS, 0x0600, bytes, NULL,
+		                  text, sizeof(text));
+
+		Lexer lexer = Lexer_Initialise(text, strlen(text));
+		TokenList* tokens = Lexer_Run(&lexer);
+		Assembler assembler = Assembler_Initialise(&mem, 0x0600);
+		assembler.variant = VARIANT_CMOS;
+
+		cr_expect(Assembler_Run(&assembler, tokens) == 0,
+		          "%s: %s", text, assembler.error);
+		cr_expect(assembler.size == info->Size && Get_Memory(&mem, 0x0600)
+		          == opcode, "%s does not reassemble to $%02X.", text, opcode);
+
+		Assembler_Free(&assembler);
+		tokenlist_free(tokens);
+	}
+}
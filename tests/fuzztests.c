@@ -0,0 +1,95 @@
+#include <criterion/criterion.h>
+
+#include "../src/cpu.h"
+#include "../src/fuzz.h"
+
+static const Byte programme[] =
+{
+	0xA5, 0x10,			// 0200 LDA $10
+	0xC9, 'F',			// 0202 CMP #'F'
+	0xD0, 0x15,			// 0204 BNE $021B
+	0xA5, 0x11,			// 0206 LDA $11
+	0xC9, 'U',			// 0208 CMP #'U'
+	0xD0, 0x0F,			// 020A BNE $021B
+	0xA5, 0x12,			// 020C LDA $12
+	0xC9, 'Z',			// 020E CMP #'Z'
+	0xD0, 0x09,			// 0210 BNE $021B
+	0xA5, 0x13,			// 0212 LDA $13
+	0xC9, 'Z',			// 0214 CMP #'Z'
+	0xD0, 0x03,			// 0216 BNE $021B
+	0x4C, 0x00, 0x03,	// 0218 JMP $0300	breakpoint
+	0x02,				// 021B JAM
+};
+
+// Taken and untaken branches hit edges, straight line code does not
+Test(fuzztests, coverage)
+{
+	static Coverage coverage;
+	CPU cpu;
+	Mem mem;
+	const Byte loop[] = {
+		INSTRUCTION_LDX_IMMEDIATE, 0x03,	// 0200 LDX #3
+		INSTRUCTION_DEX,					// 0202 DEX
+		INSTRUCTION_BNE_RELATIVE, 0xFD,		// 0203 BNE $0202
+		INSTRUCTION_JAM,
+	};
+
+	CPU_Reset(&cpu, &mem);
+	cr_expect(cpu.Coverage == NULL);
+	for (Word i = 0; i < sizeof(loop); i++)
+		Set_Memory(&mem, 0x0200 + i, loop[i]);
+	cpu.PC = 0x0200;
+	cpu.Coverage = &coverage;
+
+	(void)CPU_Execute(&cpu, &mem, 100);
+	cr_expect_eq(coverage.Count, 3);
+	for (u32 i = 0; i < coverage.Count; i++)
+		cr_expect_eq(coverage.Hits[coverage.Edges[i]], 1);
+
+	Coverage_Clear(&coverage);
+	cr_expect_eq(coverage.Count, 0);
+	for (u32 i = 0; i < COVERAGE_SIZE; i++)
+		cr_assert_eq(coverage.Hits[i], 0);
+}
+
+static void prepare(Fuzz* fuzz, CPU* cpu, Mem* mem, const u64 seed)
+{
+	CPU_Reset(cpu, mem);
+	for (Word i = 0; i < sizeof(programme); i++)
+		Set_Memory(mem, 0x0200 + i, programme[i]);
+	cpu->PC = 0x0200;
+	cr_assert(Mem_Set_Trap(mem, 0x0300, TRAP_EXECUTE) == 0);
+
+	cr_assert(Fuzz_Initialise(fuzz, cpu, mem, 1000, seed) == 0);
+	cr_expect(Fuzz_Run(fuzz, 10) == -1, "There is nothing to fuzz yet.");
+	cr_assert(Fuzz_Add_Input(fuzz, 0x0010, 4) == 0);
+	cr_expect(Fuzz_Add_Input(fuzz, 0xFFFF, 2) == -1);
+
+	// Only the zero page holds anything the programme reads or writes
+	(void)memset(fuzz->Restore, 0, sizeof(fuzz->Restore));
+	fuzz->Restore[0] = 1;
+}
+
+Test(fuzztests, finds_input)
+{
+	Fuzz fuzz;
+	CPU cpu;
+	Mem mem;
+
+	prepare(&fuzz, &cpu, &mem, 1);
+	const long long executions = Fuzz_Run(&fuzz, 10000000);
+
+	cr_assert(executions > 0 && executions < 10000000,
+	          "The input was not found.");
+	cr_expect(memcmp(fuzz.Input, "FUZZ", 4) == 0);
+	cr_expect(cpu.Trap == TRAP_EXECUTE && cpu.PC == 0x0300);
+	cr_expect(Get_Memory(&mem, 0x0013) == 'Z');
+	cr_expect(fuzz.Corpus_Count >= 5, "Every matching byte is new coverage.");
+	cr_expect_eq(fuzz.Executions, (u64)executions);
+	Fuzz_Free(&fuzz);
+
+	// Runs with the same seed are identical
+	prepare(&fuzz, &cpu, &mem, 1);
+	cr_expect(Fuzz_Run(&fuzz, 10000000) == executions);
+	Fuzz_Free(&fuzz);
+}
@@ -0,0 +1,94 @@
+#include <criterion/criterion.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../src/cpu.h"
+#include "../src/gdb.h"
+
+static char* append_packet(char* out, const char* data)
+{
+	Byte sum = 0;
+
+	for (const char* c = data; *c != '\0'; c++)
+		sum += *c;
+
+	return out + sprintf(out, "$%s#%02x", data, sum);
+}
+
+Test(gdbtests, session)
+{
+	CPU cpu;
+	Mem mem;
+	int fds[2];
+	char request[1024], expected[1024], registers[32], response[1024];
+	char* in = request;
+	char* out = expected;
+	const Byte programme[] = {
+		INSTRUCTION_LDA_IMMEDIATE, 0x42,
+		INSTRUCTION_STA_ZEROPAGE, 0x10,
+		INSTRUCTION_INX,
+		INSTRUCTION_JAM,
+	};
+
+	CPU_Reset(&cpu, &mem);
+	for (Word i = 0; i < sizeof(programme); i++)
+		Set_Memory(&mem, 0x0200 + i, programme[i]);
+	cpu.PC = 0x0200;
+
+	in = append_packet(in, "QStartNoAckMode");
+	in += sprintf(in, "+");
+	out += sprintf(out, "+");
+	out = append_packet(out, "OK");
+
+	in = append_packet(in, "Z0,205,1");
+	out = append_packet(out, "OK");
+	in = append_packet(in, "Z2,10,1");
+	out = append_packet(out, "OK");
+	in = append_packet(in, "c");
+	out = append_packet(out, "T05watch:0010;");
+	in = append_packet(in, "c");
+	out = append_packet(out, "S05");
+
+	in = append_packet(in, "g");
+	(void)sprintf(registers, "420100%02xff0502", CPU_Get_Status(&cpu));
+	out = append_packet(out, registers);
+	in = append_packet(in, "P0=07");
+	out = append_packet(out, "OK");
+	in = append_packet(in, "p0");
+	out = append_packet(out, "07");
+
+	in = append_packet(in, "m10,1");
+	out = append_packet(out, "42");
+	in = append_packet(in, "M20,2:abcd");
+	out = append_packet(out, "OK");
+	in = append_packet(in, "m20,2");
+	out = append_packet(out, "abcd");
+
+	in = append_packet(in, "s");
+	out = append_packet(out, "S05");
+	in = append_packet(in, "qXfer:features:read:target.xml:0,5");
+	out = append_packet(out, "m<?xml");
+	in = append_packet(in, "vMustReplyEmpty");
+	out = append_packet(out, "");
+	in = append_packet(in, "D");
+	out = append_packet(out, "OK");
+
+	cr_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	cr_assert(write(fds[0], request, in - request) == in - request);
+
+	cr_expect(GDB_Serve(&cpu, &mem, fds[1]) == 0,
+	          "Detaching should end the session successfully.");
+
+	const ssize_t size = recv(fds[0], response, sizeof(response) - 1,
+	                          MSG_DONTWAIT);
+	response[size < 0 ? 0 : size] = '\0';
+
+	cr_expect_str_eq(response, expected, "Unexpected replies.");
+	cr_expect(cpu.Halted && cpu.A == 0x07,
+	          "The session should have stepped the cpu into JAM.");
+	cr_expect(Get_Memory(&mem, 0x0020) == 0xAB,
+	          "Memory writes should reach the cpu's memory.");
+
+	(void)close(fds[0]);
+	(void)close(fds[1]);
+}
@@ -0,0 +1,90 @@
+#include <criterion/criterion.h>
+
+#include "../src/cpu.h"
+#include "../src/lanes.h"
+
+static const Byte programme[] =
+{
+	0xA5, 0x10,			// 0200 LDA $10		per lane input
+	0x29, 0x0F,			// 0202 AND #$0F
+	0xAA,				// 0204 TAX
+	0xF0, 0x06,			// 0205 BEQ $020D
+	0x18,				// 0207 CLC
+	0x69, 0x03,			// 0208 ADC #$03	decimal on odd lanes
+	0xCA,				// 020A DEX
+	0xD0, 0xFA,			// 020B BNE $0207
+	0x95, 0x20,			// 020D STA $20,X
+	0x48,				// 020F PHA			no lane version
+	0x2A,				// 0210 ROL A
+	0xE6, 0x11,			// 0211 INC $11
+	0xBC, 0xF0, 0x02,	// 0213 LDY $02F0,X
+	0xC9, 0x10,			// 0216 CMP #$10
+	0xB0, 0x01,			// 0218 BCS $021B
+	0xC8,				// 021A INY
+	0x4C, 0x1F, 0x02,	// 021B JMP $021F
+	0xEA,				// 021E NOP			skipped
+	0x02,				// 021F JAM
+};
+
+static void prepare(CPU* cpu, Mem* mem, const int lane)
+{
+	for (Word i = 0; i < sizeof(programme); i++)
+		Set_Memory(mem, 0x0200 + i, programme[i]);
+	Set_Memory(mem, 0x0010, lane * 0x13);
+	cpu->PC = 0x0200;
+	cpu->D = lane & 1;
+}
+
+Test(lanetests, matches_scalar)
+{
+	Mem* mems[MOS_6502_LANES];
+	Lanes lanes;
+
+	for (int lane = 0; lane < MOS_6502_LANES; lane++)
+	{
+		CPU cpu;
+
+		mems[lane] = malloc(sizeof(Mem));
+		cr_assert(mems[lane] != NULL);
+		CPU_Initialise(&cpu, mems[lane], VARIANT_NMOS);
+	}
+
+	Lanes_Initialise(&lanes, mems, MOS_6502_LANES, VARIANT_NMOS);
+	for (int lane = 0; lane < MOS_6502_LANES; lane++)
+	{
+		CPU cpu;
+
+		Lanes_Get_CPU(&lanes, lane, &cpu);
+		prepare(&cpu, mems[lane], lane);
+		Lanes_Set_CPU(&lanes, lane, &cpu);
+	}
+
+	Lanes_Execute(&lanes, 1000);
+
+	for (int lane = 0; lane < MOS_6502_LANES; lane++)
+	{
+		CPU cpu, expected;
+		Mem* mem = malloc(sizeof(Mem));
+
+		cr_assert(mem != NULL);
+		CPU_Initialise(&expected, mem, VARIANT_NMOS);
+		prepare(&expected, mem, lane);
+		CPU_Execute(&expected, mem, 1000);
+
+		Lanes_Get_CPU(&lanes, lane, &cpu);
+		cr_expect(cpu.Halted && cpu.PC == expected.PC,
+		          "Lane %d did not halt at the JAM.", lane);
+		cr_expect(cpu.A == expected.A && cpu.X == expected.X
+		          && cpu.Y == expected.Y && cpu.SP == expected.SP
+		          && CPU_Get_Status(&cpu) == CPU_Get_Status(&expected),
+		          "Registers of lane %d differ from a single cpu.", lane);
+		cr_expect(cpu.Cycles == expected.Cycles,
+		          "Lane %d took %llu cycles instead of %llu.",
+		          lane, cpu.Cycles, expected.Cycles);
+		cr_expect(memcmp(mems[lane]->Data, mem->Data, 0x0200) == 0,
+		          "Zero page and stack of lane %d differ.", lane);
+
+		free(mem);
+		free(mems[lane]);
+	}
+}
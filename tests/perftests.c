@@ -0,0 +1,69 @@
+#include <criterion/criterion.h>
+
+#include "../src/cpu.h"
+#include "../src/perf.h"
+
+Test(perftests, classify)
+{
+	cr_expect(Perf_Classify(VARIANT_NMOS, INSTRUCTION_LDA_INDIRECTY) == PERF_CLASS_LOAD);
+	cr_expect(Perf_Classify(VARIANT_NMOS, INSTRUCTION_LDX_IMMEDIATE) == PERF_CLASS_LOAD);
+	cr_expect(Perf_Classify(VARIANT_NMOS, INSTRUCTION_STY_ZEROPAGEX) == PERF_CLASS_STORE);
+	cr_expect(Perf_Classify(VARIANT_NMOS, INSTRUCTION_CPX_IMMEDIATE) == PERF_CLASS_ALU);
+	cr_expect(Perf_Classify(VARIANT_NMOS, INSTRUCTION_INC_ZEROPAGEX) == PERF_CLASS_MODIFY);
+	cr_expect(Perf_Classify(VARIANT_NMOS, INSTRUCTION_BNE_RELATIVE) == PERF_CLASS_BRANCH);
+	cr_expect(Perf_Classify(VARIANT_NMOS, INSTRUCTION_RTS_IMPLIED) == PERF_CLASS_JUMP);
+	cr_expect(Perf_Classify(VARIANT_NMOS, INSTRUCTION_PLA) == PERF_CLASS_STACK);
+	cr_expect(Perf_Classify(VARIANT_NMOS, INSTRUCTION_TXS) == PERF_CLASS_REGISTER);
+	cr_expect(Perf_Classify(VARIANT_NMOS, INSTRUCTION_ROR_ACCUMULATOR) == PERF_CLASS_REGISTER);
+	cr_expect(Perf_Classify(VARIANT_NMOS, INSTRUCTION_LAX_INDIRECTY) == PERF_CLASS_LOAD);
+	cr_expect(Perf_Classify(VARIANT_NMOS, INSTRUCTION_DCP_ABSOLUTEY) == PERF_CLASS_MODIFY);
+	cr_expect(Perf_Classify(VARIANT_NMOS, INSTRUCTION_JAM) == PERF_CLASS_OTHER);
+
+	// The same opcodes mean something else on the 65C02
+	cr_expect(Perf_Classify(VARIANT_NMOS, INSTRUCTION_PHX) == PERF_CLASS_OTHER);
+	cr_expect(Perf_Classify(VARIANT_CMOS, INSTRUCTION_PHX) == PERF_CLASS_STACK);
+	cr_expect(Perf_Classify(VARIANT_CMOS, INSTRUCTION_STZ_ABSOLUTEX) == PERF_CLASS_STORE);
+	cr_expect(Perf_Classify(VARIANT_CMOS, INSTRUCTION_LDA_INDIRECT) == PERF_CLASS_LOAD);
+	cr_expect(Perf_Classify(VARIANT_CMOS, INSTRUCTION_BRA_RELATIVE) == PERF_CLASS_BRANCH);
+	cr_expect(Perf_Classify(VARIANT_CMOS, INSTRUCTION_LAX_INDIRECTY) == PERF_CLASS_OTHER);
+
+	// Undocumented opcodes are illegal on the strict variant
+	cr_expect(Perf_Classify(VARIANT_NMOS_STRICT, INSTRUCTION_LAX_ZEROPAGE) == PERF_CLASS_OTHER);
+	cr_expect(Perf_Classify(VARIANT_NMOS_STRICT, INSTRUCTION_LDA_ZEROPAGE) == PERF_CLASS_LOAD);
+	cr_expect(Perf_Classify(VARIANT_NMOS, INSTRUCTION_NOP_IMPLIED) == PERF_CLASS_OTHER);
+}
+
+// Emulated instructions are counted per class with or without host counters
+Test(perftests, step)
+{
+	CPU cpu;
+	Mem mem;
+	Perf perf;
+	const Byte programme[] = {
+		INSTRUCTION_LDX_IMMEDIATE, 0x03,	// 0200 LDX #3
+		INSTRUCTION_DEX,					// 0202 DEX
+		INSTRUCTION_BNE_RELATIVE, 0xFD,		// 0203 BNE $0202
+		INSTRUCTION_STX_ZEROPAGE, 0x10,		// 0205 STX $10
+		INSTRUCTION_JAM,
+	};
+
+	CPU_Reset(&cpu, &mem);
+	for (Word i = 0; i < sizeof(programme); i++)
+		Set_Memory(&mem, 0x0200 + i, programme[i]);
+	cpu.PC = 0x0200;
+
+	(void)Perf_Open(&perf, VARIANT_NMOS);
+	while (Perf_Step(&perf, &cpu, &mem) == HALT_NONE)
+		;
+	Perf_Close(&perf);
+
+	cr_expect_eq(perf.Total.Instructions, 9);
+	cr_expect_eq(perf.Total.Cycles, cpu.Cycles);
+	cr_expect_eq(perf.Classes[PERF_CLASS_LOAD].Instructions, 1);
+	cr_expect_eq(perf.Classes[PERF_CLASS_REGISTER].Instructions, 3);
+	cr_expect_eq(perf.Classes[PERF_CLASS_BRANCH].Instructions, 3);
+	cr_expect_eq(perf.Classes[PERF_CLASS_STORE].Instructions, 1);
+	cr_expect_eq(perf.Classes[PERF_CLASS_OTHER].Instructions, 1);
+	cr_expect_eq(perf.Classes[PERF_CLASS_BRANCH].Cycles, 3 + 3 + 2);
+	cr_expect_eq(cpu.Instructions, 9);
+}
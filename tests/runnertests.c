@@ -0,0 +1,361 @@
+#include <criterion/criterion.h>
+
+#include "../src/cpu.h"
+#include "../src/runner.h"
+#include "../src/util.h"
+
+static int assemble(Assembler* assembler, Mem* mem, const char* source)
+{
+	Lexer lexer = Lexer_Initialise(source, strlen(source));
+	TokenList* tokens = Lexer_Run(&lexer);
+
+	*assembler = Assembler_Initialise(mem, 0x0600);
+	int result = Assembler_Run(assembler, tokens);
+
+	tokenlist_free(tokens);
+	return result;
+}
+
+Test(runnertests, addressing_modes)
+{
+	Mem mem;
+	Assembler assembler;
+	const Byte expected[] =
+	{
+		0xA9, 0x10,             // LDA #$10
+		0xB5, 0x20,             // LDA $20,X
+		0xBD, 0x00, 0x30,       // LDA $3000,X
+		0xB9, 0x40, 0x00,       // LDA $40,Y (no zero page,Y for LDA)
+		0xA1, 0x50,             // LDA ($50,X)
+		0xB1, 0x60,             // LDA ($60),Y
+		0x6C, 0xFC, 0xFF,       // JMP ($FFFC)
+		0x0A,                   // ASL A
+		0x4A,                   // LSR
+		0xA2, 0x0C,             // LDX #%1100
+		0xA0, 0x0F,             // LDY #15
+	};
+
+	Mem_Initialise(&mem);
+	int result = assemble(&assembler, &mem,
+		"  LDA #$10\n"
+		"  lda $20,X\n"
+		"  LDA $3000,x ; comment\n"
+		"  LDA $40,Y\n"
+		"  LDA ($50,X)\n"
+		"  LDA ($60),Y\n"
+		"  JMP ($FFFC)\n"
+		"  ASL A\n"
+		"  LSR\n"
+		"  LDX #%1100\n"
+		"  LDY #15\n");
+
+	cr_assert(result == 0, "Assembly failed: %s", assembler.error);
+	cr_expect(assembler.size == sizeof(expected), "Wrong programme size.");
+	for (size_t i = 0; i < sizeof(expected); i++)
+		cr_expect(Get_Memory(&mem, 0x0600 + i) == expected[i],
+		          "Wrong byte at offset %zu.", i);
+
+	Assembler_Free(&assembler);
+}
+
+Test(runnertests, labels_and_execution)
+{
+	CPU cpu;
+	Mem mem;
+	Assembler assembler;
+
+	CPU_Reset(&cpu, &mem);
+	int result = assemble(&assembler, &mem,
+		"start:  LDX #5\n"
+		"        LDA #0\n"
+		"loop:   CLC\n"
+		"        ADC #3\n"
+		"        DEX\n"
+		"        BNE loop\n"
+		"        JSR store\n"
+		"        JMP end\n"
+		"store:  STA $10\n"
+		"        RTS\n"
+		"end:    .foo\n");
+
+	cr_expect(result != 0, "Unknown directives should fail.");
+	cr_expect(strstr(assembler.error, "line 11: Unknown directive") != NULL,
+	          "Error does not name the line: %s", assembler.error);
+	Assembler_Free(&assembler);
+
+	result = assemble(&assembler, &mem,
+		"start:  LDX #5\n"
+		"        LDA #0\n"
+		"loop:   CLC\n"
+		"        ADC #3\n"
+		"        DEX\n"
+		"        BNE loop\n"
+		"        JSR store\n"
+		"        JMP end\n"
+		"store:  STA $10\n"
+		"        RTS\n"
+		"end:    NOP\n");
+
+	cr_assert(result == 0, "Assembly failed: %s", assembler.error);
+
+	const Label* end = Assembler_Find_Label(&assembler, "end", 3);
+	cr_assert(end != NULL, "Label 'end' was not defined.");
+
+	cpu.PC = 0x0600;
+	while (cpu.PC != end->address)
+		CPU_Execute(&cpu, &mem, 1);
+
+	cr_expect(Get_Memory(&mem, 0x0010) == 15, "The loop computed %d.",
+	          Get_Memory(&mem, 0x0010));
+	Assembler_Free(&assembler);
+}
+
+Test(runnertests, undefined_label)
+{
+	Mem mem;
+	Assembler assembler;
+
+	Mem_Initialise(&mem);
+	cr_expect(assemble(&assembler, &mem, "  JMP nowhere\n") != 0,
+	          "Undefined labels should fail.");
+	cr_expect(strstr(assembler.error, "Undefined label") != NULL,
+	          "Unexpected error: %s", assembler.error);
+	Assembler_Free(&assembler);
+}
+
+Test(runnertests, lexer_status)
+{
+	const char* source = "  LDA #$10\n  LDA @10\n";
+	Lexer lexer = Lexer_Initialise(source, strlen(source));
+	TokenList* tokens = Lexer_Run(&lexer);
+
+	cr_assert(tokens != NULL);
+	cr_expect(lexer.status == LEXER_INVALID_TOKEN && lexer.error_line == 2,
+	          "The invalid token on line 2 was not reported.");
+	tokenlist_free(tokens);
+}
+
+// The instruction set follows the assembler's variant
+Test(runnertests, variants)
+{
+	Mem mem;
+	Assembler assembler;
+	const char* source =
+		"loop:  BBR0 $10,loop\n"
+		"       LDA ($20)\n"
+		"       STZ $30,X\n"
+		"       JMP ($1234,X)\n"
+		"       NOP\n";
+	const Byte expected[] =
+	{
+		0x0F, 0x10, 0xFD,       // BBR0 $10,loop
+		0xB2, 0x20,             // LDA ($20)
+		0x74, 0x30,             // STZ $30,X
+		0x7C, 0x34, 0x12,       // JMP ($1234,X)
+		0xEA,                   // NOP, not one of the reserved ones
+	};
+
+	Mem_Initialise(&mem);
+	cr_expect(assemble(&assembler, &mem, source) != 0,
+	          "65C02 instructions should not assemble for the NMOS 6502.");
+	Assembler_Free(&assembler);
+
+	Lexer lexer = Lexer_Initialise(source, strlen(source));
+	TokenList* tokens = Lexer_Run(&lexer);
+
+	assembler = Assembler_Initialise(&mem, 0x0600);
+	assembler.variant = VARIANT_CMOS;
+	cr_assert(Assembler_Run(&assembler, tokens) == 0,
+	          "Assembly failed: %s", assembler.error);
+	for (size_t i = 0; i < sizeof(expected); i++)
+		cr_expect(Get_Memory(&mem, 0x0600 + i) == expected[i],
+		          "Wrong byte at offset %zu.", i);
+	Assembler_Free(&assembler);
+	tokenlist_free(tokens);
+
+	// Undocumented opcodes only exist on the full NMOS variant
+	source = "  LAX ($40),Y\n  SBC #1\n";
+	lexer = Lexer_Initialise(source, strlen(source));
+	tokens = Lexer_Run(&lexer);
+	assembler = Assembler_Initialise(&mem, 0x0600);
+	assembler.variant = VARIANT_NMOS;
+	cr_assert(Assembler_Run(&assembler, tokens) == 0,
+	          "Assembly failed: %s", assembler.error);
+	cr_expect(Get_Memory(&mem, 0x0600) == INSTRUCTION_LAX_INDIRECTY);
+	cr_expect(Get_Memory(&mem, 0x0602) == INSTRUCTION_SBC_IMMEDIATE,
+	          "The documented SBC should be preferred.");
+	Assembler_Free(&assembler);
+	tokenlist_free(tokens);
+}
+
+Test(runnertests, expressions_and_directives)
+{
+	Mem mem;
+	Assembler assembler;
+	const Byte expected[] =
+	{
+		0x01, 0xFF, 'A', 'B',   // table: .byte 1, -1, "AB"
+		0x18, 0x07, 0x34, 0x12, // vector: .word end, $1233+1
+		0xA9, 0x08,             // LDA #<vector+4
+		0xA2, 0x08,             // LDX #>vector+$100
+		0xA0, 0x10,             // LDY #size*2+8
+		0xA5, 0x11,             // LDA zp+1
+		0x9D, 0x01, 0x07,       // STA table+1,X
+		0xB1, 0x10,             // LDA (zp),Y
+		0x8D, 0x18, 0x07,       // STA end
+	};
+
+	Mem_Initialise(&mem);
+	int result = assemble(&assembler, &mem,
+		"zp = $10\n"
+		"        .org $0700\n"
+		"table:  .byte 1, -1, \"AB\"\n"
+		"vector: .word end, $1233+1\n"
+		"size = vector - table\n"
+		"        LDA #<vector+4\n"
+		"        LDX #>vector+$100\n"
+		"        LDY #size*2+8\n"
+		"        LDA zp+1\n"
+		"        STA table+1,X\n"
+		"        LDA (zp),Y\n"
+		"        STA end\n"
+		"end:\n");
+
+	cr_assert(result == 0, "Assembly failed: %s", assembler.error);
+	cr_expect(assembler.size == sizeof(expected), "Wrong programme size.");
+	for (size_t i = 0; i < sizeof(expected); i++)
+		cr_expect(Get_Memory(&mem, 0x0700 + i) == expected[i],
+		          "Wrong byte at offset %zu.", i);
+	Assembler_Free(&assembler);
+
+	cr_expect(assemble(&assembler, &mem, "  .byte 256\n") != 0,
+	          "Bytes should not overflow.");
+	Assembler_Free(&assembler);
+	cr_expect(assemble(&assembler, &mem, "  .byte later/0\nlater:\n") != 0,
+	          "Division by zero should fail even with unknown operands.");
+	cr_expect(strstr(assembler.error, "Division by zero") != NULL,
+	          "Unexpected error: %s", assembler.error);
+	Assembler_Free(&assembler);
+	// Values a source builds must not overflow the host's arithmetic
+	cr_expect(assemble(&assembler, &mem, "  .word -32768*32768*2/-1\n") != 0,
+	          "INT_MIN / -1 should be out of range.");
+	cr_expect(strstr(assembler.error, "Expression out of range at '/'") != NULL,
+	          "Unexpected error: %s", assembler.error);
+	Assembler_Free(&assembler);
+	cr_expect(assemble(&assembler, &mem, "  .word 10*65535*65535\n") != 0,
+	          "Products leaving 32 bits should be out of range.");
+	cr_expect(strstr(assembler.error, "Expression out of range at '*'") != NULL,
+	          "Unexpected error: %s", assembler.error);
+	Assembler_Free(&assembler);
+	cr_expect(assemble(&assembler, &mem, "  .byte 4/later\nlater:\n") == 0,
+	          "Forward divisors are only zero in the first pass: %s",
+	          assembler.error);
+	Assembler_Free(&assembler);
+	cr_expect(assemble(&assembler, &mem, "  .org later\nlater:\n") != 0,
+	          ".org cannot depend on labels defined after it.");
+	Assembler_Free(&assembler);
+}
+
+Test(runnertests, macros)
+{
+	Mem mem;
+	Assembler assembler;
+	const Byte expected[] =
+	{
+		0xA9, 0x01, 0x85, 0x10,         // store 1, $10
+		0xA9, 0x07, 0x8D, 0x00, 0x02,   // store <$0207, $0200
+		0xA9, 0x02, 0x85, 0x10,         // double 1, $10
+		0xA9, 0x02, 0x85, 0x11,
+	};
+
+	Mem_Initialise(&mem);
+	int result = assemble(&assembler, &mem,
+		".macro store value, address\n"
+		"        LDA #value\n"
+		"        STA address ; comment\n"
+		".endmacro\n"
+		".macro double value, address\n"
+		"        store value*2, address\n"
+		"        store value+value, address+1\n"
+		".endm\n"
+		"        store 1, $10\n"
+		"        store <$0207, $0200\n"
+		"again:  double 1, $10\n");
+
+	cr_assert(result == 0, "Assembly failed: %s", assembler.error);
+	cr_expect(assembler.size == sizeof(expected), "Wrong programme size.");
+	for (size_t i = 0; i < sizeof(expected); i++)
+		cr_expect(Get_Memory(&mem, 0x0600 + i) == expected[i],
+		          "Wrong byte at offset %zu.", i);
+	cr_expect(Assembler_Find_Label(&assembler, "again", 5)->address == 0x0609);
+	Assembler_Free(&assembler);
+
+	cr_expect(assemble(&assembler, &mem,
+	                   ".macro store value\n  LDA #value\n.endmacro\n"
+	                   "  store 1, 2\n") != 0,
+	          "Extra arguments should fail.");
+	cr_expect(strstr(assembler.error, "Wrong number of arguments") != NULL,
+	          "Unexpected error: %s", assembler.error);
+	Assembler_Free(&assembler);
+}
+
+// Included files are relative to the includer and cached by modification time
+Test(runnertests, include)
+{
+	Mem mem;
+	char directory[] = "/tmp/runnertestsXXXXXX";
+	char path[64], defines[64];
+	const char* source = ".include \"defines.s\"\n  twice value\n";
+
+	cr_assert(mkdtemp(directory) != NULL);
+	(void)snprintf(path, sizeof(path), "%s/main.s", directory);
+	(void)snprintf(defines, sizeof(defines), "%s/defines.s", directory);
+
+	FILE* file = fopen(defines, "w");
+	cr_assert(file != NULL);
+	(void)fputs("value = 42\n.macro twice x\n  .byte x, x\n.endmacro\n", file);
+	(void)fclose(file);
+
+	Lexer lexer = Lexer_Initialise(source, strlen(source));
+	TokenList* tokens = Lexer_Run(&lexer);
+	Assembler assembler = Assembler_Initialise(&mem, 0x0600);
+	assembler.path = path;
+
+	Mem_Initialise(&mem);
+	cr_assert(Assembler_Run(&assembler, tokens) == 0,
+	          "Assembly failed: %s", assembler.error);
+	cr_expect(Get_Memory(&mem, 0x0600) == 42 && Get_Memory(&mem, 0x0601) == 42);
+
+	// Unchanged files are not lexed again
+	const TokenList* cached = assembler.includes[0].tokens;
+	cr_assert(Assembler_Run(&assembler, tokens) == 0,
+	          "Assembly failed: %s", assembler.error);
+	cr_expect(assembler.include_count == 1
+	          && assembler.includes[0].tokens == cached,
+	          "The include should have come from the cache.");
+
+	file = fopen(defines, "w");
+	cr_assert(file != NULL);
+	(void)fputs("value = 7\n.macro twice x\n  .byte x, x\n.endmacro\n", file);
+	(void)fclose(file);
+
+	cr_assert(Assembler_Run(&assembler, tokens) == 0,
+	          "Assembly failed: %s", assembler.error);
+	cr_expect(Get_Memory(&mem, 0x0600) == 7,
+	          "An include modified within the same second should be read again.");
+
+	// Errors in an included file name it
+	file = fopen(defines, "w");
+	cr_assert(file != NULL);
+	(void)fputs("value = 7\n  FOO\n", file);
+	(void)fclose(file);
+
+	cr_assert(Assembler_Run(&assembler, tokens) != 0);
+	cr_expect(strstr(assembler.error, "defines.s, line 2: Unknown instruction")
+	          != NULL, "Unexpected error: %s", assembler.error);
+
+	Assembler_Free(&assembler);
+	tokenlist_free(tokens);
+	(void)remove(defines);
+	(void)remove(directory);
+}
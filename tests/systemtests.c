@@ -0,0 +1,143 @@
+#include <criterion/criterion.h>
+
+#include "../src/cpu.h"
+#include "../src/system.h"
+
+static const Byte producer[] =
+{
+	0xA2, 0x00,			// 0200 LDX #$00
+	0xE8,				// 0202 INX
+	0x8E, 0x00, 0x03,	// 0203 STX $0300	shared
+	0xE0, 0x20,			// 0206 CPX #$20
+	0xD0, 0xF8,			// 0208 BNE $0202
+	0x02,				// 020A JAM
+};
+
+static const Byte consumer[] =
+{
+	0xAD, 0x00, 0x03,	// 0200 LDA $0300	idle until the producer is done
+	0xC9, 0x20,			// 0203 CMP #$20
+	0xD0, 0xF9,			// 0205 BNE $0200
+	0x8D, 0x01, 0x03,	// 0207 STA $0301	shared
+	0x8D, 0x00, 0x04,	// 020A STA $0400	private
+	0x02,				// 020D JAM
+};
+
+static void prepare(System* system, Mem** mems, const u32 quantum)
+{
+	Mem_Initialise(mems[0]);
+	Mem_Initialise(mems[1]);
+	cr_assert(System_Initialise(system, mems, 2, VARIANT_NMOS, quantum) == 0);
+	System_Share(system, 0x0300, 0x03FF);
+
+	for (Word i = 0; i < sizeof(producer); i++)
+		(void)System_Set_Memory(system, 0, 0x0200 + i, producer[i]);
+	for (Word i = 0; i < sizeof(consumer); i++)
+		(void)System_Set_Memory(system, 1, 0x0200 + i, consumer[i]);
+	system->CPUs[0].PC = 0x0200;
+	system->CPUs[1].PC = 0x0200;
+}
+
+Test(systemtests, shared_pages)
+{
+	static System system;
+	static Mem first, second;
+	Mem* mems[] = { &first, &second };
+
+	cr_expect(System_Initialise(&system, mems, 0, VARIANT_NMOS, 8) == -1);
+	cr_expect(System_Initialise(&system, mems, 2, VARIANT_NMOS, 0) == -1);
+
+	prepare(&system, mems, 8);
+	cr_expect(System_Execute(&system, 100000) == 0, "Both cpus should halt.");
+
+	for (int i = 0; i < 2; i++)
+	{
+		cr_expect(system.CPUs[i].Halted == HALT_JAM);
+		cr_expect(Get_Memory(mems[i], 0x0300) == 0x20);
+		cr_expect(Get_Memory(mems[i], 0x0301) == 0x20,
+		          "Shared writes should reach every cpu.");
+	}
+	cr_expect(Get_Memory(&first, 0x0400) == 0x00,
+	          "Private writes should stay with their cpu.");
+	cr_expect(Get_Memory(&second, 0x0400) == 0x20);
+	cr_expect(Get_Memory(&first, 0x0200) == producer[0]);
+	cr_expect(Get_Memory(&second, 0x0200) == consumer[0]);
+
+	// The later cpu wins when both write the same byte in a quantum
+	prepare(&system, mems, 8);
+	Set_Memory(&first, 0x0300, 0x11);
+	Set_Memory(&second, 0x0300, 0x22);
+	system.CPUs[0].PC = 0x020A;		// JAM
+	system.CPUs[1].PC = 0x020D;
+	cr_expect(System_Execute(&system, 100) == 0);
+	cr_expect(Get_Memory(&first, 0x0300) == 0x22);
+	cr_expect(Get_Memory(&second, 0x0300) == 0x22);
+}
+
+// A cpu a trap stopped early makes up the rest of its quantum later
+Test(systemtests, trap_keeps_cpus_together)
+{
+	static System system;
+	static Mem first, second;
+	Mem* mems[] = { &first, &second };
+
+	prepare(&system, mems, 100);
+
+	const u64 start[] = { system.CPUs[0].Cycles, system.CPUs[1].Cycles };
+
+	cr_assert(Mem_Set_Trap(&first, 0x0206, TRAP_EXECUTE) == 0);
+	cr_expect(System_Execute(&system, 1000) == 2);
+	cr_expect(system.CPUs[0].Trap == TRAP_EXECUTE);
+	cr_expect(system.Cycles == 100, "Execution should stop at the boundary.");
+	cr_expect(system.CPUs[0].Cycles - start[0] < 100);
+
+	(void)Mem_Clear_Trap(&first, 0x0206, TRAP_EXECUTE);
+	cr_expect(System_Execute(&system, 200) == 2);
+	for (int i = 0; i < 2; i++)
+	{
+		const u64 cycles = system.CPUs[i].Cycles - start[i];
+
+		cr_expect(cycles >= system.Cycles && cycles < system.Cycles + 8,
+		          "Cpu %d ran %llu cycles of %llu.", i, cycles,
+		          system.Cycles);
+	}
+}
+
+// Threads change how the cpus are run, never the result
+Test(systemtests, threaded_matches_sequential)
+{
+	static System sequential, threaded;
+	static Mem mems[4];
+	Mem* sequential_mems[] = { &mems[0], &mems[1] };
+	Mem* threaded_mems[] = { &mems[2], &mems[3] };
+
+	prepare(&sequential, sequential_mems, 7);
+	prepare(&threaded, threaded_mems, 7);
+	threaded.Threaded = 1;
+
+	int running = 2;
+
+	for (u64 cycles = 5; running > 0; cycles += 13)
+	{
+		running = System_Execute(&sequential, cycles);
+
+		cr_assert(System_Execute(&threaded, cycles) == running);
+		cr_assert(threaded.Cycles == sequential.Cycles);
+		for (int i = 0; i < 2; i++)
+		{
+			const CPU* expected = &sequential.CPUs[i];
+			const CPU* actual = &threaded.CPUs[i];
+
+			cr_assert(actual->PC == expected->PC
+			          && actual->A == expected->A
+			          && actual->X == expected->X
+			          && actual->Cycles == expected->Cycles,
+			          "Cpu %d differs after %llu cycles.", i,
+			          sequential.Cycles);
+			cr_assert(sequential.Ahead[i] < 8,
+			          "Cpus should stay within an instruction of the bus.");
+		}
+		cr_assert(memcmp(mems[0].Data, mems[2].Data, MAX_MEM) == 0);
+		cr_assert(memcmp(mems[1].Data, mems[3].Data, MAX_MEM) == 0);
+	}
+}
@@ -0,0 +1,156 @@
+#include <criterion/criterion.h>
+
+#include "../src/cpu.h"
+#include "../src/trace.h"
+
+static void load_programme(CPU* cpu, Mem* mem)
+{
+	const Byte programme[] = {
+		INSTRUCTION_LDA_IMMEDIATE, 0x80,	// C000 LDA #$80
+		INSTRUCTION_TAX,					// C002 TAX
+		INSTRUCTION_INX,					// C003 INX
+		INSTRUCTION_JMP_ABSOLUTE, 0x00, 0xC0,	// C004 JMP $C000
+	};
+
+	CPU_Reset(cpu, mem);
+	for (Word i = 0; i < sizeof(programme); i++)
+		Set_Memory(mem, 0xC000 + i, programme[i]);
+}
+
+static int validate(const char* log, Trace_Divergence* divergence)
+{
+	CPU cpu;
+	Mem mem;
+	FILE* reference = fmemopen((void*)log, strlen(log), "r");
+
+	load_programme(&cpu, &mem);
+	const int result = Trace_Validate(&cpu, &mem, reference, divergence);
+
+	(void)fclose(reference);
+	return result;
+}
+
+Test(tracetests, nestest_log)
+{
+	Trace_Divergence divergence;
+	const char* log =
+		"C000  A9 80     LDA #$80                        A:00 X:00 Y:00 P:24 SP:FD PPU:  0, 21 CYC:7\n"
+		"C002  AA        TAX                             A:80 X:00 Y:00 P:A4 SP:FD PPU:  0, 27 CYC:9\n"
+		"C003  E8        INX                             A:80 X:80 Y:00 P:A4 SP:FD PPU:  0, 33 CYC:11\n"
+		"\n"
+		"C004  4C 00 C0  JMP $C000                       A:80 X:81 Y:00 P:A4 SP:FD PPU:  0, 39 CYC:13\n"
+		"C000  A9 80     LDA #$80                        A:80 X:81 Y:00 P:A4 SP:FD PPU:  0, 48 CYC:16\n";
+
+	cr_expect(validate(log, &divergence) == 0,
+	          "The log should match, diverged at line %zu.", divergence.line);
+}
+
+Test(tracetests, divergence)
+{
+	Trace_Divergence divergence;
+	const char* log =
+		"C000  A:00 X:00 Y:00 P:24 SP:FD CYC:7\n"
+		"C002  A:80 X:00 Y:00 P:A4 SP:FD CYC:9\n"
+		"C003  A:80 X:80 Y:00 P:24 SP:FD CYC:11\n"
+		"C004  A:80 X:81 Y:00 P:A4 SP:FD CYC:13\n";
+
+	cr_expect(validate(log, &divergence) == 1, "The log should diverge.");
+	cr_expect(divergence.line == 3 && divergence.fields == TRACE_P,
+	          "Only the flags on line 3 should diverge.");
+	cr_expect(divergence.expected.P == 0x24 && divergence.actual.P == 0xA4,
+	          "Both states should be reported.");
+}
+
+Test(tracetests, write_and_parse)
+{
+	CPU cpu;
+	Mem mem;
+	char line[64];
+	Trace_State state;
+
+	load_programme(&cpu, &mem);
+	cpu.PC = 0xC000;
+	CPU_Execute(&cpu, &mem, 1);
+
+	FILE* log = fmemopen(line, sizeof(line), "w");
+	cr_assert(Trace_Write(&cpu, log) == 0);
+	(void)fclose(log);
+
+	cr_expect(Trace_Parse(line, &state) == 0, "Written lines should parse.");
+	cr_expect(state.PC == 0xC002 && state.A == 0x80 && state.Cycles == 2,
+	          "Parsed state does not match the cpu.");
+	cr_expect(Trace_Parse("C000  A:00 X:00", &state) == -1,
+	          "Incomplete lines should not parse.");
+}
+
+// Without a file the buffer keeps the latest records
+Test(tracetests, ring_buffer)
+{
+	CPU cpu;
+	Mem mem;
+	Trace_Buffer buffer;
+
+	load_programme(&cpu, &mem);
+	cpu.PC = 0xC000;
+	cr_assert(Trace_Buffer_Initialise(&buffer, 3, NULL) == 0);
+
+	for (int i = 0; i < 5; i++)
+	{
+		cr_assert(Trace_Buffer_Append(&buffer, &cpu, &mem) == 0);
+		CPU_Execute(&cpu, &mem, 1);
+	}
+
+	cr_expect(buffer.Count == 3, "The buffer should be full.");
+	cr_expect(Trace_Buffer_Get(&buffer, 0)->PC == 0xC003);
+	cr_expect(Trace_Buffer_Get(&buffer, 1)->PC == 0xC004);
+	cr_expect(Trace_Buffer_Get(&buffer, 2)->PC == 0xC000);
+	cr_expect(Trace_Buffer_Get(&buffer, 2)->Cycles == 9);
+
+	Trace_Buffer_Free(&buffer);
+}
+
+// Records written while running render to a log that validates
+Test(tracetests, render)
+{
+	CPU cpu;
+	Mem mem;
+	Trace_Buffer buffer;
+	Trace_Record record;
+	Trace_State state;
+	char line[128];
+	int count = 0;
+	FILE* file = tmpfile();
+
+	cr_assert(file != NULL);
+	load_programme(&cpu, &mem);
+	cpu.PC = 0xC000;
+	cr_assert(Trace_Buffer_Initialise(&buffer, 2, file) == 0);
+
+	for (int i = 0; i < 5; i++)
+	{
+		cr_assert(Trace_Buffer_Append(&buffer, &cpu, &mem) == 0);
+		CPU_Execute(&cpu, &mem, 1);
+	}
+	cr_assert(Trace_Buffer_Flush(&buffer) == 0);
+	Trace_Buffer_Free(&buffer);
+
+	rewind(file);
+	while (Trace_Read(file, &record) == 1)
+	{
+		cr_assert(Trace_Render(&record, VARIANT_NMOS, NULL,
+		                       line, sizeof(line)) > 0);
+		if (count == 0)
+			cr_expect_str_eq(line, "C000  A9 80     LDA #$80                        "
+			                 "A:00 X:00 Y:00 P:24 SP:FF CYC:0");
+		if (count == 3)
+			cr_expect_str_eq(line, "C004  4C 00 C0  JMP $C000                       "
+			                 "A:80 X:81 Y:00 P:A4 SP:FF CYC:6");
+
+		cr_expect(Trace_Parse(line, &state) == 0 && state.PC == record.PC,
+		          "Rendered lines should parse.");
+		count++;
+	}
+
+	cr_expect(count == 5, "Expected 5 records, read %d.", count);
+	(void)fclose(file);
+}